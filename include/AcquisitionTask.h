@@ -0,0 +1,73 @@
+#ifndef ACQUISITION_TASK_H
+#define ACQUISITION_TASK_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include "config.h"
+#include "BatteryProtocol.h"
+#include "BluetoothManager.h"
+#include "PollScheduler.h"
+
+// Event handed from the acquisition task to the network side
+struct AcquisitionEvent {
+    enum Type : uint8_t {
+        PRESENCE,   // Presence check before a poll
+        SAMPLE      // Poll result, data is valid when success is set
+    };
+    
+    Type type;
+    int8_t batteryIndex;
+    bool present;
+    int rssi;
+    bool success;
+    BatteryData batteryData;
+};
+
+// FreeRTOS task that owns all BLE work (presence scans, scheduling, battery
+// reads) and posts results to a bounded queue. The network stack in loop()
+// consumes the queue on the other core, so the web UI, MQTT keepalive and
+// OTA keep running while batteries are read.
+class AcquisitionTask {
+public:
+    AcquisitionTask(BluetoothManager& bluetoothManager, PollScheduler& pollScheduler);
+    ~AcquisitionTask();
+    
+    // Creates the queues and starts the task pinned to ACQ_TASK_CORE
+    bool begin();
+    
+    // Consumer side: next event, false when the queue is empty
+    bool receive(AcquisitionEvent& event);
+    
+    // Blocks up to timeoutMs until an event is waiting, true if one is
+    bool waitForEvent(uint32_t timeoutMs);
+    
+    // Safe to call from any task
+    void requestImmediate();
+    bool isPolling() const;
+    uint32_t getDroppedEvents() const;
+
+private:
+    BluetoothManager& bluetoothManager;
+    PollScheduler& pollScheduler;
+    
+    TaskHandle_t taskHandle;
+    
+    // Events are copied into the queue, samples have no heap members
+    QueueHandle_t eventQueue;
+    
+    std::atomic<bool> immediateRequested;
+    std::atomic<bool> polling;
+    std::atomic<uint32_t> droppedEvents;
+    
+    static void taskEntry(void* param);
+    void run();
+    void pollDueBatteries();
+    void postPresence(int batteryIndex, bool present, int rssi);
+    void postSample(int batteryIndex, bool success, const BatteryData& batteryData);
+    void feedWatchdog();
+};
+
+#endif // ACQUISITION_TASK_H
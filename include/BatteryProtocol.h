@@ -3,20 +3,50 @@
 
 #include <Arduino.h>
 
-struct BatteryData {
-    String macAddress;
-    float voltage;          // V
-    float current;          // A
-    float remainingAh;      // Ah
-    float maxAh;            // Ah
-    float watts;            // W
-    float soc;              // %
-    float temperature;      // °C
-    String switches;        // Charge/Discharge status
+#define BATTERY_MAX_CELLS 32
+
+// Compact battery sample, stored in the raw fixed-point units of the BMS.
+// No heap members, so samples can be copied, queued and buffered freely;
+// floats and strings are derived only where values are output.
+struct __attribute__((packed)) BatteryData {
+    uint8_t mac[6];
+    uint16_t voltage10mV;
+    int16_t current10mA;        // Positive while charging
+    uint16_t remaining10mAh;
+    uint16_t nominal10mAh;
+    uint16_t temperature01K;    // First NTC, 0 if the BMS reported none
+    uint8_t switches;           // Bit 0 charge FET, bit 1 discharge FET
     uint8_t numCells;
-    float cellVoltages[32]; // mV
     bool dataValid;
-    unsigned long timestamp;
+    uint32_t timestamp;         // Epoch seconds of the measurement, 0 while the clock is not set
+    uint16_t cellMillivolts[BATTERY_MAX_CELLS];
+    
+    // Derived values
+    float getVoltage() const { return voltage10mV / 100.0f; }
+    float getCurrent() const { return current10mA / 100.0f; }
+    float getRemainingAh() const { return remaining10mAh / 100.0f; }
+    float getMaxAh() const { return nominal10mAh / 100.0f; }
+    float getWatts() const { return getVoltage() * getCurrent(); }
+    float getSoc() const { return nominal10mAh > 0 ? 100.0f * remaining10mAh / nominal10mAh : 0.0f; }
+    float getTemperature() const { return temperature01K > 0 ? ((int)temperature01K - 2731) * 0.1f : 0.0f; }
+    float getCellVoltage(uint8_t cell) const { return cell < numCells ? cellMillivolts[cell] / 1000.0f : 0.0f; }
+    bool isChargeEnabled() const { return switches & 0x01; }
+    bool isDischargeEnabled() const { return switches & 0x02; }
+    
+    // Output edge helpers
+    const char* getSwitches() const;
+    String getMacAddress() const;
+    bool setMacAddress(const String& macAddress);
+    void clear();
+};
+
+// Outcome of feeding bytes into the incremental frame parser
+enum class FrameResult : uint8_t {
+    NEED_MORE,          // Frame not complete yet, feed the next fragment
+    COMPLETE,           // Valid frame decoded and applied to BatteryData
+    DEVICE_ERROR,       // Valid frame, but the BMS reported a non-zero status
+    CHECKSUM_ERROR,     // Length matched but checksum did not
+    FORMAT_ERROR        // Missing end byte or unexpected command echo
 };
 
 class BatteryProtocol {
@@ -29,7 +59,15 @@ public:
     void createCellVoltageCommand(uint8_t* buffer, uint8_t& length);
     void createHardwareVersionCommand(uint8_t* buffer, uint8_t& length);
     
-    // Parse response data
+    // Incremental frame parser
+    // Consumes notification fragments as they arrive and decodes fields on the fly.
+    // Returns as soon as one frame ends (consumed tells how many bytes were used),
+    // so callers loop until the whole fragment is consumed.
+    void resetParser();
+    FrameResult feed(const uint8_t* data, size_t length, size_t& consumed, BatteryData& batteryData);
+    uint8_t getLastFrameCommand() const;
+    
+    // Parse complete response buffers (runs the incremental parser over the buffer)
     bool parseBasicInfoResponse(const uint8_t* data, uint8_t length, BatteryData& batteryData);
     bool parseCellVoltageResponse(const uint8_t* data, uint8_t length, BatteryData& batteryData);
     
@@ -37,6 +75,48 @@ public:
     uint16_t calculateChecksum(const uint8_t* data, uint8_t length);
     bool verifyChecksum(const uint8_t* data, uint8_t length);
     void printHex(const uint8_t* data, uint8_t length);
+
+private:
+    enum class ParserState : uint8_t {
+        WAIT_START,
+        COMMAND,
+        STATUS,
+        LENGTH,
+        PAYLOAD,
+        CHECKSUM_HIGH,
+        CHECKSUM_LOW,
+        END
+    };
+    
+    // Decoded values of the frame in flight, applied only after checksum and end byte match
+    struct StagedFields {
+        uint16_t voltageRaw;        // 10 mV
+        int16_t currentRaw;         // 10 mA
+        uint16_t remainingRaw;      // 10 mAh
+        uint16_t nominalRaw;        // 10 mAh
+        uint8_t switches;
+        bool hasSwitches;
+        uint16_t temperatureRaw;    // 0.1 K
+        bool hasTemperature;
+        uint8_t numCells;
+        uint16_t cellMillivolts[BATTERY_MAX_CELLS];
+    };
+    
+    ParserState parserState;
+    uint8_t frameCommand;
+    uint8_t frameStatus;
+    uint8_t payloadLength;
+    uint8_t payloadIndex;
+    uint8_t previousByte;
+    uint16_t runningSum;
+    uint16_t receivedChecksum;
+    uint8_t lastFrameCommand;
+    StagedFields staged;
+    
+    FrameResult consumeByte(uint8_t byte, BatteryData& batteryData);
+    void decodePayloadByte(uint8_t byte);
+    void applyStagedFields(BatteryData& batteryData);
+    bool parseSingleFrame(const uint8_t* data, uint8_t length, uint8_t expectedCmd, BatteryData& batteryData);
 };
 
 #endif
@@ -0,0 +1,136 @@
+#ifndef BATTERY_SESSION_H
+#define BATTERY_SESSION_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEClient.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config.h"
+#include "BatteryProtocol.h"
+#include "NotificationRing.h"
+
+// BLE session with one battery: its client, cached GATT handles, notification
+// ring, frame parser and outstanding commands. Notifications are routed to the
+// owning session by GATT interface and connection id, so several sessions can
+// run requests at the same time.
+class BatterySession {
+public:
+    BatterySession();
+    ~BatterySession();
+    
+    // Initialization, wakeSemaphore is given on every notification and link drop
+    bool begin(const String& macAddress, SemaphoreHandle_t wakeSemaphore);
+    const String& getMacAddress() const;
+    
+    // Connection management
+    bool connect();
+    void disconnect();
+    bool isConnected() const;
+    bool isReady() const;
+    
+    // Request cycle: start writes the commands back to back, service drains
+    // notifications and expires deadlines until the request is finished
+    bool startRequest(const uint8_t* cmds, uint8_t count, BatteryData& batteryData, unsigned long timeoutMs);
+    bool serviceRequest();
+    long msUntilNextDeadline() const;
+    void endRequest();
+    bool commandSucceeded(uint8_t cmd) const;
+    
+    // Poll bookkeeping, returns false when the link was dropped
+    bool finishPoll(bool success);
+    
+    // Statistics
+    unsigned long getLastRoundTripMicros(uint8_t cmd) const;
+    uint32_t getDroppedNotifications() const;
+    int readRssi();
+    
+    // Status callbacks
+    void setOnConnect(std::function<void()> callback);
+    void setOnDisconnect(std::function<void()> callback);
+    
+    // Static GATT client event hook for BLE, routes events to the owning session
+    static void gattcEventHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t* param);
+
+private:
+    // GATT attribute handles of the BMS service, cached so that reconnects can skip service discovery
+    struct GattHandles {
+        uint16_t writeHandle;
+        uint16_t readHandle;
+        uint16_t cccdHandle;
+        bool valid;
+    };
+    
+    // Outstanding command, matched to its response frame by the echoed command byte
+    static const uint8_t MAX_PENDING_COMMANDS = 3;
+    struct PendingCommand {
+        uint8_t cmd;
+        unsigned long sentMicros;
+        unsigned long deadlineMs;
+        bool done;
+        FrameResult result;
+    };
+    
+    String macAddress;
+    BLEClient* client;
+    GattHandles handles;
+    bool handlesFromCache;      // Handles of the current connection were not rediscovered
+    volatile bool connected;
+    bool notificationsEnabled;
+    uint8_t consecutiveFailures;
+    volatile bool descriptorWriteDone;
+    volatile bool descriptorWriteOk;
+    SemaphoreHandle_t wakeSemaphore;
+    
+    // Response state. The BLE task only pushes notification fragments into
+    // notificationRing and gives wakeSemaphore; the polling task drains the
+    // ring through the protocol parser, so parser and pending state are
+    // touched by one task only.
+    NotificationRing notificationRing;
+    BatteryProtocol protocol;
+    BatteryData* requestData;
+    PendingCommand pendingCommands[MAX_PENDING_COMMANDS];
+    uint8_t pendingCount;
+    unsigned long lastRoundTripMicros[3];   // Indexed by command - CMD_READ_BASIC_INFO
+    
+    // Callbacks
+    std::function<void()> onConnectCallback;
+    std::function<void()> onDisconnectCallback;
+    
+    // Connection setup
+    bool discoverHandles();
+    bool enableNotifications();
+    
+    // GATT handle cache (RAM, optionally NVS)
+    void loadCachedHandles();
+    void storeHandles();
+    void invalidateHandles();
+    String cacheKey() const;
+    
+    // Notification handling
+    void handleGattcEvent(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t* param);
+    void handleNotification(const uint8_t* pData, size_t length);
+    void drainNotifications();
+    void feedFragment(const uint8_t* data, size_t length, uint32_t timestampMicros);
+    void handleConnect();
+    void handleDisconnect();
+    
+    // Sessions known to the GATT event hook
+    static BatterySession* registry[BATTERY_COUNT];
+    static uint8_t registryCount;
+    
+    // BLE client callback class
+    class ClientCallback : public BLEClientCallbacks {
+    public:
+        ClientCallback(BatterySession* session) : session(session) {}
+        void onConnect(BLEClient* pclient) override;
+        void onDisconnect(BLEClient* pclient) override;
+    private:
+        BatterySession* session;
+    };
+    
+    ClientCallback* clientCallback;
+};
+
+#endif // BATTERY_SESSION_H
@@ -4,9 +4,12 @@
 #include <Arduino.h>
 #include <BLEDevice.h>
 #include <BLEUtils.h>
-#include <BLEClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "config.h"
 #include "BatteryProtocol.h"
+#include "BatterySession.h"
+#include "PresenceScanner.h"
 
 class BluetoothManager {
 public:
@@ -16,68 +19,52 @@ public:
     // Initialization
     void begin();
     
+    // Background work (presence scan windows)
+    void loop();
+    
     // Connection management
     bool connectToBattery(const String& macAddress);
-    void disconnect();
+    void disconnect(const String& macAddress);
+    void disconnectAll();
     bool isConnected() const;
+    bool isBatteryConnected(const String& macAddress) const;
+    
+    // Presence, from advertisements or an open link
+    bool isBatteryPresent(const String& macAddress) const;
+    int getBatteryRssi(const String& macAddress) const;
     
-    // Battery data reading
+    // Battery data reading. readBatteries polls several batteries at once:
+    // links are set up one after the other, then the commands go out on all
+    // links and the responses are collected in parallel. Returns the number
+    // of batteries read successfully.
     bool readBatteryData(const String& macAddress, BatteryData& batteryData);
+    int readBatteries(const int* batteryIndices, int count, BatteryData* results, bool* success);
+    
+    // Round-trip time of the last successful command (write to complete frame), 0 if none yet
+    unsigned long getLastRoundTripMicros(const String& macAddress, uint8_t cmd) const;
+    
+    // Notification fragments dropped because a ring was full, summed over all batteries
+    uint32_t getDroppedNotifications() const;
     
     // Status callbacks
     void setOnConnect(std::function<void()> callback);
     void setOnDisconnect(std::function<void()> callback);
 
 private:
-    // BLE objects
-    BLEClient* pClient;
-    BLERemoteCharacteristic* pWriteCharacteristic;
-    BLERemoteCharacteristic* pReadCharacteristic;
-    
-    // State variables
-    bool bleConnected;
-    String currentBatteryMac;
-    
-    // Data buffer for BLE responses
-    uint8_t responseBuffer[256];
-    int responseLength;
-    bool responseReceived;
-    bool expectingMoreData;
-    int expectedTotalLength;
+    // One session per configured battery, index matches BATTERY_MAC_ADDRESSES
+    BatterySession sessions[BATTERY_COUNT];
     
-    // Protocol handler
-    BatteryProtocol protocol;
+    // Given by every session on notifications and link drops, the polling task waits on it
+    SemaphoreHandle_t wakeSemaphore;
     
-    // Callbacks
-    std::function<void()> onConnectCallback;
-    std::function<void()> onDisconnectCallback;
+    // Passive advertisement scanner
+    PresenceScanner presenceScanner;
     
     // Private methods
-    bool sendCommandAndWaitResponse(uint8_t* command, uint8_t commandLength, unsigned long timeoutMs = 5000);
-    bool tryCommand(const String& macAddress, uint8_t cmd, const String& cmdName, BatteryData& batteryData);
-    
-    // Static callback functions for BLE
-    static void notifyCallback(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify);
-    
-    // Static instance pointer for callbacks
-    static BluetoothManager* instance;
-    
-    // Internal callback handlers
-    void handleNotification(uint8_t* pData, size_t length);
-    void handleConnect();
-    void handleDisconnect();
-    
-    // BLE client callback class
-    class MyClientCallback : public BLEClientCallbacks {
-    public:
-        MyClientCallback(BluetoothManager* manager) : manager(manager) {}
-        void onConnect(BLEClient* pclient) override;
-        void onDisconnect(BLEClient* pclient) override;
-    private:
-        BluetoothManager* manager;
-    };
-    
-    MyClientCallback* clientCallback;
+    BatterySession* findSession(const String& macAddress);
+    const BatterySession* findSession(const String& macAddress) const;
+    bool ensureLink(BatterySession& session);
+    void runRequests(BatterySession** active, BatteryData** data, int count, const uint8_t* cmds, uint8_t cmdCount);
 };
 
 #endif // BLUETOOTH_MANAGER_H
@@ -0,0 +1,64 @@
+#ifndef HISTORY_BUFFER_H
+#define HISTORY_BUFFER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config.h"
+#include "BatteryProtocol.h"
+
+// One history entry, raw BMS units like BatteryData
+struct __attribute__((packed)) HistorySample {
+    uint32_t time;              // Uptime in seconds
+    uint16_t voltage10mV;
+    int16_t current10mA;
+    uint16_t soc01;             // State of charge in 0.1 %
+    uint16_t temperature01K;    // 0 if the BMS reported none
+};
+
+// Aggregate of all samples in one time range
+struct HistoryBucket {
+    uint16_t count;
+    uint16_t minVoltage10mV;
+    uint16_t maxVoltage10mV;
+    int16_t minCurrent10mA;
+    int16_t maxCurrent10mA;
+    int32_t sumVoltage10mV;
+    int32_t sumCurrent10mA;
+    uint32_t sumSoc01;
+    uint32_t sumTemperature01K;
+    uint16_t temperatureCount;
+};
+
+// Fixed-memory ring of compact samples per battery (HISTORY_SAMPLES each).
+// The time covered follows the poll interval: 24 hours at the base scan
+// interval, a third of that while a battery is polled at the fastest rate.
+// Times are uptime seconds, available before NTP. Samples are appended in
+// time order, so ranges are found by binary search. Safe to use from
+// several tasks. The lock is a mutex rather than a spinlock: a summary
+// walks up to HISTORY_SAMPLES entries, too long to keep interrupts off.
+class HistoryBuffer {
+public:
+    HistoryBuffer();
+    
+    void add(int batteryIndex, const BatteryData& data, uint32_t time);
+    
+    // Aggregates the samples with from <= time < to. Returns false if there are none.
+    bool summarize(int batteryIndex, uint32_t from, uint32_t to, HistoryBucket& bucket) const;
+    
+    // Time of the oldest stored sample, 0 if empty
+    uint32_t getOldestTime(int batteryIndex) const;
+    uint16_t size(int batteryIndex) const;
+
+private:
+    HistorySample samples[BATTERY_COUNT][HISTORY_SAMPLES];
+    uint16_t head[BATTERY_COUNT];       // Oldest sample
+    uint16_t count[BATTERY_COUNT];
+    StaticSemaphore_t lockBuffer;
+    SemaphoreHandle_t lock;
+    
+    const HistorySample& at(int batteryIndex, uint16_t position) const;
+    uint16_t lowerBound(int batteryIndex, uint32_t time) const;
+};
+
+#endif // HISTORY_BUFFER_H
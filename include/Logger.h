@@ -0,0 +1,83 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "config.h"
+
+// Log levels, LOG_LEVEL in config.h selects which ones are compiled in
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Leveled logger. Lines are formatted with printf-style arguments into a
+// stack buffer and appended to a fixed ring; a background task drains the
+// ring to Serial. Callers never allocate and never wait on the UART. When
+// the drain falls behind, the oldest text is overwritten and counted.
+class Logger {
+public:
+    static const size_t LINE_MAX = 160;     // Longer lines are truncated
+    
+    Logger();
+    
+    // Starts the drain task
+    void begin();
+    
+    // Writes everything not yet drained to Serial from the calling task, before a restart
+    void flush();
+    
+    // Appends one line, safe to call from any task
+    void write(uint8_t level, const char* tag, const char* format, ...) __attribute__((format(printf, 4, 5)));
+    
+    // Reads ring content from position on, oldest available text first when
+    // position fell out of the ring. Advances position past the returned bytes.
+    size_t read(uint32_t& position, char* out, size_t maxLength) const;
+    uint32_t getOldestPosition() const;
+    uint32_t getDroppedBytes() const;
+
+private:
+    char buffer[LOG_BUFFER_SIZE];
+    uint32_t head;              // Total bytes ever written, ring index is head % LOG_BUFFER_SIZE
+    uint32_t drainPosition;     // Next byte to send to Serial
+    uint32_t droppedBytes;      // Overwritten before they reached Serial
+    mutable portMUX_TYPE lock;
+    TaskHandle_t drainTask;
+    
+    void append(const char* text, size_t length);
+    size_t copyOut(uint32_t position, char* out, size_t maxLength) const;
+    static void drainTaskEntry(void* param);
+    void drain();
+    void drainPending();
+};
+
+extern Logger logger;
+
+// Logging macros, levels above LOG_LEVEL compile to nothing including their arguments
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(tag, format, ...) logger.write(LOG_LEVEL_ERROR, tag, format, ##__VA_ARGS__)
+#else
+#define LOG_E(tag, format, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(tag, format, ...) logger.write(LOG_LEVEL_WARN, tag, format, ##__VA_ARGS__)
+#else
+#define LOG_W(tag, format, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(tag, format, ...) logger.write(LOG_LEVEL_INFO, tag, format, ##__VA_ARGS__)
+#else
+#define LOG_I(tag, format, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(tag, format, ...) logger.write(LOG_LEVEL_DEBUG, tag, format, ##__VA_ARGS__)
+#else
+#define LOG_D(tag, format, ...) do {} while (0)
+#endif
+
+#endif // LOGGER_H
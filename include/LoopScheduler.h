@@ -0,0 +1,67 @@
+#ifndef LOOP_SCHEDULER_H
+#define LOOP_SCHEDULER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Deadline-based cooperative scheduler for the jobs of loop().
+// Jobs sit in a min-heap ordered by their next deadline. Each job has a
+// period and a time budget; a run that exceeds its budget is counted as an
+// overrun and the excess is charged to the job by deferring its next run,
+// so a slow job cannot starve the others. One pass also stops after
+// LOOP_PASS_BUDGET_MS, the remaining due jobs run first on the next pass.
+class LoopScheduler {
+public:
+    typedef void (*JobFunction)();
+    
+    static const uint8_t MAX_JOBS = 12;
+    
+    struct JobStats {
+        const char* name;
+        uint32_t periodMs;
+        uint32_t budgetMs;
+        uint32_t runs;
+        uint32_t overruns;
+        uint32_t lastDurationUs;
+        uint32_t maxDurationUs;
+        uint32_t maxLatenessMs;     // Start delay past the deadline
+    };
+    
+    LoopScheduler();
+    
+    // Registration, returns the job id or -1 when the table is full
+    int addJob(const char* name, JobFunction function, uint32_t periodMs, uint32_t budgetMs, uint32_t firstDelayMs = 0);
+    
+    // Runs the due jobs, returns the number of jobs run
+    int runDue();
+    
+    // Time until the earliest deadline, 0 when a job is due
+    uint32_t getMsUntilNextJob() const;
+    
+    // Statistics
+    uint8_t getJobCount() const;
+    const JobStats& getJobStats(uint8_t jobId) const;
+    uint32_t getTotalOverruns() const;
+
+private:
+    struct Job {
+        JobFunction function;
+        unsigned long nextRun;
+        JobStats stats;
+    };
+    
+    Job jobs[MAX_JOBS];
+    uint8_t jobCount;
+    
+    // Min-heap of job ids by nextRun
+    uint8_t heap[MAX_JOBS];
+    uint8_t heapSize;
+    
+    bool runsBefore(uint8_t a, uint8_t b) const;
+    void siftUp(uint8_t position);
+    void siftDown(uint8_t position);
+    void push(uint8_t jobId);
+    uint8_t pop();
+};
+
+#endif // LOOP_SCHEDULER_H
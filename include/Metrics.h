@@ -0,0 +1,112 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Counters and histograms served at /metrics in the Prometheus text format.
+// All metrics are static objects that chain themselves into a list during
+// static initialization, so the registry itself never changes at runtime.
+// Updates are relaxed 32-bit atomics: any task on either core records
+// without a lock, and a scrape reads each value once.
+class Metric {
+public:
+    // Writes the exposition lines, HELP and TYPE only with header (once per
+    // name). Returns the full length like snprintf, >= capacity if cut off.
+    virtual size_t render(char* buffer, size_t capacity, bool header) const = 0;
+    
+    const char* getName() const { return name; }
+    const Metric* getNext() const { return next; }
+    static const Metric* first() { return head; }
+
+protected:
+    Metric(const char* name, const char* help, const char* labels);
+    
+    const char* name;
+    const char* help;
+    const char* labels;     // Fixed label set such as handler="data", may be empty
+
+private:
+    const Metric* next;
+    static Metric* head;
+    static Metric* tail;
+};
+
+class MetricCounter : public Metric {
+public:
+    MetricCounter(const char* name, const char* help, const char* labels = "");
+    
+    void increment(uint32_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+    uint32_t get() const { return value.load(std::memory_order_relaxed); }
+    
+    size_t render(char* buffer, size_t capacity, bool header) const override;
+
+private:
+    std::atomic<uint32_t> value;
+};
+
+// Durations in microseconds, exposed in seconds. The sum is a 32-bit
+// microsecond counter as well and wraps after about 71 minutes of observed
+// time, which rate() treats like a counter reset.
+class MetricHistogram : public Metric {
+public:
+    static const int MAX_BOUNDS = 12;
+    
+    // bounds: ascending upper bucket limits in microseconds, at most MAX_BOUNDS
+    MetricHistogram(const char* name, const char* help, const uint32_t* bounds, int boundCount, const char* labels = "");
+    
+    void observe(uint32_t micros);
+    uint32_t getCount() const;
+    
+    size_t render(char* buffer, size_t capacity, bool header) const override;
+
+private:
+    const uint32_t* bounds;
+    int boundCount;
+    std::atomic<uint32_t> buckets[MAX_BOUNDS + 1];  // Per bucket, not cumulative; the last one is +Inf
+    std::atomic<uint32_t> sumMicros;
+};
+
+// Observes the time until it goes out of scope
+class MetricTimer {
+public:
+    explicit MetricTimer(MetricHistogram& histogram) : histogram(histogram), start(micros()) {}
+    ~MetricTimer() { histogram.observe(micros() - start); }
+
+private:
+    MetricHistogram& histogram;
+    uint32_t start;
+};
+
+// BLE
+extern MetricCounter metricBleConnectAttempts;
+extern MetricCounter metricBleConnectFailures;
+extern MetricHistogram metricBleConnectDuration;
+extern MetricHistogram metricBleDiscoveryDuration;
+extern MetricHistogram metricBleCommandRoundTrip;
+extern MetricCounter metricBlePolls;
+extern MetricCounter metricBlePollFailures;
+
+// MQTT
+extern MetricCounter metricMqttConnectAttempts;
+extern MetricCounter metricMqttConnectFailures;
+extern MetricHistogram metricMqttConnectDuration;
+extern MetricCounter metricMqttPublishes;
+extern MetricCounter metricMqttPublishFailures;
+extern MetricHistogram metricMqttPublishDuration;
+
+// WiFi
+extern MetricCounter metricWifiDisconnects;
+extern MetricCounter metricWifiReconnectAttempts;
+extern MetricHistogram metricWifiConnectDuration;
+
+// HTTP, one series per handler
+extern MetricHistogram metricHttpRoot;
+extern MetricHistogram metricHttpData;
+extern MetricHistogram metricHttpEvents;
+extern MetricHistogram metricHttpHistory;
+extern MetricHistogram metricHttpExport;
+extern MetricHistogram metricHttpLog;
+extern MetricHistogram metricHttpMetrics;
+
+#endif // METRICS_H
@@ -4,7 +4,10 @@
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include <lwip/dns.h>
+#include "config.h"
 #include "BatteryProtocol.h"
+#include "PublishQueue.h"
 
 class MqttClient {
 public:
@@ -13,11 +16,28 @@ public:
     bool begin(const char* server, int port, const char* user, const char* password, const char* clientId);
     void loop();
     bool isConnected();
-    void reconnect();
     
-    bool publishBatteryData(const BatteryData& data);
-    bool publishStatus(const String& message);
+    // Publishes right away when possible, otherwise queues the sample for replay
+    // after reconnect. Samples where no field moved beyond its deadband are
+    // skipped until the heartbeat is due. Returns true if the sample was
+    // published immediately or skipped as unchanged. time is the UTC epoch
+    // second of the sample; it is queued along with it and published as
+    // "timestamp", which is left out while the clock is not set.
+    bool publishBatteryData(const BatteryData& data, uint32_t time);
+    bool publishPresence(int batteryIndex, bool present, int rssi);
+    bool publishStatus(const char* message);
     
+    // Store-and-forward queue status
+    uint32_t getQueuedSamples() const;
+    uint32_t getDroppedSamples() const;
+    
+    // Samples skipped by the deadband filter
+    uint32_t getSuppressedSamples() const;
+    
+    // Broker connection metrics
+    uint32_t getConnectAttempts() const;
+    uint32_t getConnectFailures() const;
+    unsigned long getLastConnectLatencyMs() const;   // Attempt start to CONNACK, 0 if never connected
     
 private:
     WiFiClient wifiClient;
@@ -28,14 +48,92 @@ private:
     String user;
     String password;
     String clientId;
-    String topicPrefix;
     
-    unsigned long lastReconnectAttempt;
-    static const unsigned long RECONNECT_INTERVAL = 5000; // 5 seconds
+    // Connection state machine. Name lookup and TCP connect run on a
+    // non-blocking socket and are polled from loop(); only the MQTT
+    // handshake on an established socket is left to PubSubClient.
+    enum class ConnectState : uint8_t {
+        BACKOFF,        // Waiting for the next attempt
+        RESOLVING,      // Asynchronous DNS lookup running
+        CONNECTING,     // Non-blocking TCP connect in flight
+        CONNECTED
+    };
+    ConnectState connectState;
+    unsigned long stateSince;
+    unsigned long attemptStart;
+    unsigned long backoffDelay;
+    uint8_t consecutiveFailures;
+    int socketFd;
+    
+    // Written by the lwIP DNS callback
+    enum : uint8_t { DNS_PENDING, DNS_RESOLVED, DNS_FAILED };
+    volatile uint8_t dnsStatus;
+    volatile uint32_t resolvedAddress;
+    
+    uint32_t connectAttempts;
+    uint32_t connectFailures;
+    unsigned long lastConnectLatency;
+    
+    void serviceConnection();
+    void startAttempt();
+    void pollResolve();
+    void openSocket(uint32_t address);
+    void pollSocket();
+    void completeHandshake();
+    void failAttempt(const char* reason);
+    void scheduleRetry();
+    void closeSocket();
+    void enterState(ConnectState state);
+    static void dnsFound(const char* name, const ip_addr_t* address, void* arg);
+    
+    // Samples waiting for the broker, replayed oldest first in rate-limited batches
+    PublishQueue publishQueue;
+    unsigned long lastReplayBatch;
+    
+    bool publishSample(const BatteryData& data);
+    void replayQueued();
+    
+    // Topics and MAC strings are built once in begin(), payloads are
+    // serialized into a fixed document and buffer, so publishing does not allocate
+    static const size_t TOPIC_MAX = 96;
+    static const size_t JSON_CAPACITY = JSON_OBJECT_SIZE(13) + JSON_ARRAY_SIZE(BATTERY_MAX_CELLS);
+    char dataTopics[BATTERY_COUNT][TOPIC_MAX];
+    char presenceTopics[BATTERY_COUNT][TOPIC_MAX];
+    char statusTopic[TOPIC_MAX];
+    char macStrings[BATTERY_COUNT][18];
+    BatteryData macLookup[BATTERY_COUNT];   // Only the mac field is used
+    StaticJsonDocument<JSON_CAPACITY> jsonDocument;
+    char payloadBuffer[MQTT_PAYLOAD_BUFFER_SIZE];
+    
+    // Change-only publishing. Deadbands are checked against the last accepted
+    // sample, so slow drift still goes out once it adds up to a deadband.
+    // Field topics compare against what actually reached the broker.
+    enum Field : uint8_t {
+        FIELD_VOLTAGE     = 0x01,
+        FIELD_CURRENT     = 0x02,
+        FIELD_SOC         = 0x04,
+        FIELD_TEMPERATURE = 0x08,
+        FIELD_SWITCHES    = 0x10,
+        FIELD_CELLS       = 0x20,
+        FIELD_ALL         = 0x3F
+    };
+    BatteryData lastAccepted[BATTERY_COUNT];
+    unsigned long lastAcceptedTime[BATTERY_COUNT];
+    bool hasAccepted[BATTERY_COUNT];
+    BatteryData lastSent[BATTERY_COUNT];
+    unsigned long lastSentTime[BATTERY_COUNT];
+    bool hasSent[BATTERY_COUNT];
+    uint32_t suppressedSamples;
+    char fieldTopicBases[BATTERY_COUNT][TOPIC_MAX];
     
+    static uint8_t changedFields(const BatteryData& previous, const BatteryData& current);
+    static bool cellMoved(const BatteryData& previous, const BatteryData& current, int cell);
+    void publishFieldTopics(int batteryIndex, const BatteryData& data, uint8_t fields);
+    bool publishField(int batteryIndex, const char* field, const char* value);
     
-    String createBatteryTopic(const String& macAddress, const String& subtopic);
-    String createStatusTopic();
+    void buildTopics();
+    int findBattery(const BatteryData& data) const;
+    bool publishPayload(const char* topic, size_t length, bool retained);
 };
 
 #endif
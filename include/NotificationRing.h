@@ -0,0 +1,50 @@
+#ifndef NOTIFICATION_RING_H
+#define NOTIFICATION_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Lock-free single-producer/single-consumer byte ring for BLE notifications.
+// The BLE callback task pushes fragments with their arrival time, the task that
+// waits for responses drains them. Each record keeps its fragment boundary;
+// its payload may wrap around the end of the buffer, so it is handed out as
+// up to two contiguous segments without copying.
+class NotificationRing {
+public:
+    static const size_t CAPACITY = 2048;    // Bytes, must be a power of two
+    
+    struct RecordView {
+        const uint8_t* first;
+        size_t firstLength;
+        const uint8_t* second;
+        size_t secondLength;
+        uint32_t timestampMicros;
+    };
+    
+    NotificationRing();
+    
+    // Producer side (BLE callback task)
+    bool push(const uint8_t* data, size_t length, uint32_t timestampMicros);
+    
+    // Consumer side
+    bool peek(RecordView& record) const;
+    void consume();
+    void clear();
+    
+    // Statistics
+    uint32_t getDroppedFragments() const;
+
+private:
+    static const size_t HEADER_SIZE = 6;    // 2 bytes length, 4 bytes timestamp
+    static const size_t MASK = CAPACITY - 1;
+    
+    uint8_t buffer[CAPACITY];
+    std::atomic<uint32_t> head;     // Written by the producer only
+    std::atomic<uint32_t> tail;     // Written by the consumer only
+    std::atomic<uint32_t> droppedFragments;
+    
+    void writeByte(uint32_t position, uint8_t value);
+    uint8_t readByte(uint32_t position) const;
+};
+
+#endif // NOTIFICATION_RING_H
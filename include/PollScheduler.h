@@ -0,0 +1,56 @@
+#ifndef POLL_SCHEDULER_H
+#define POLL_SCHEDULER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "BatteryProtocol.h"
+
+// Adaptive per-battery polling scheduler.
+// Each battery gets its own next-due time: fast polling while power flows or
+// current/SOC move, exponential back-off while idle, and a leaky-bucket radio
+// budget that caps the long-run share of time spent on BLE polls.
+class PollScheduler {
+public:
+    PollScheduler();
+    
+    // Initialization, first polls are staggered after firstDelayMs
+    void begin(unsigned long firstDelayMs);
+    
+    // Index of the most overdue battery, or -1 when none is due or the budget is spent
+    int nextDueBattery();
+    
+    // All due batteries, most overdue first, so they can be polled together.
+    // Returns the number written to indices (0 when the budget is spent).
+    int collectDueBatteries(int* indices, int maxCount);
+    
+    // Poll bookkeeping
+    void recordPoll(int batteryIndex, bool success, const BatteryData& batteryData, unsigned long airtimeMs);
+    void recordSkipped(int batteryIndex);
+    void requestImmediate();
+    
+    // Status
+    unsigned long getInterval(int batteryIndex) const;
+    unsigned long getNextDue(int batteryIndex) const;
+    long getBudgetMs() const;
+
+private:
+    struct BatterySchedule {
+        unsigned long nextDue;
+        unsigned long interval;
+        bool hasSample;
+        float lastCurrent;
+        float lastSoc;
+        unsigned long lastSampleTime;
+    };
+    
+    BatterySchedule schedules[BATTERY_COUNT];
+    
+    // Leaky bucket for radio airtime, refilled at POLL_RADIO_DUTY_PERCENT of wall time
+    long budgetMs;
+    unsigned long lastRefill;
+    
+    void refillBudget();
+    bool isActive(const BatterySchedule& schedule, const BatteryData& batteryData, unsigned long now) const;
+};
+
+#endif // POLL_SCHEDULER_H
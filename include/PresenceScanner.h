@@ -0,0 +1,69 @@
+#ifndef PRESENCE_SCANNER_H
+#define PRESENCE_SCANNER_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEScan.h>
+#include "config.h"
+
+// Passive BLE scanner that tracks which configured batteries are advertising.
+// Runs short, non-blocking scan windows between polls; pause() stops the radio
+// scan before a connection attempt.
+class PresenceScanner {
+public:
+    PresenceScanner();
+    
+    // Initialization (after BLEDevice::init)
+    void begin();
+    
+    // Starts the next scan window when due
+    void loop();
+    
+    // Scan coordination with connection setup
+    void pause();
+    void resume();
+    bool isScanning() const;
+    
+    // Presence table
+    bool isPresent(const String& macAddress) const;
+    int getRssi(const String& macAddress) const;
+    unsigned long getLastSeen(const String& macAddress) const;
+    bool hasCompletedWindow() const;
+    void updateRssi(const String& macAddress, int rssi);
+
+private:
+    struct PresenceEntry {
+        uint8_t address[6];
+        volatile int rssi;
+        volatile unsigned long lastSeen;
+        volatile bool seen;
+    };
+    
+    PresenceEntry entries[BATTERY_COUNT];
+    BLEScan* pScan;
+    volatile bool scanning;
+    bool paused;
+    bool windowCompleted;
+    unsigned long lastWindowStart;
+    
+    int findEntry(const String& macAddress) const;
+    int findEntry(const uint8_t* address) const;
+    static bool parseMac(const String& macAddress, uint8_t* address);
+    
+    // Static scan completion callback
+    static void scanComplete(BLEScanResults results);
+    static PresenceScanner* instance;
+    
+    // Advertisement callback class
+    class AdvertisedCallback : public BLEAdvertisedDeviceCallbacks {
+    public:
+        AdvertisedCallback(PresenceScanner* scanner) : scanner(scanner) {}
+        void onResult(BLEAdvertisedDevice advertisedDevice) override;
+    private:
+        PresenceScanner* scanner;
+    };
+    
+    AdvertisedCallback* advertisedCallback;
+};
+
+#endif // PRESENCE_SCANNER_H
@@ -0,0 +1,61 @@
+#ifndef PUBLISH_QUEUE_H
+#define PUBLISH_QUEUE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "BatteryProtocol.h"
+
+// Store-and-forward queue for battery samples that could not be published.
+// Samples go to a RAM ring first. When the ring is full, its oldest samples
+// move in batches to append-only segment files on LittleFS (if enabled), so
+// everything on flash is older than everything in RAM and replay stays in
+// timestamp order. Segments are never rewritten: the read position lives in
+// a small file of its own, and a segment is deleted once it was replayed.
+// Beyond MQTT_QUEUE_SPILL_SAMPLES the oldest segment is dropped whole.
+class PublishQueue {
+public:
+    PublishQueue();
+    
+    // Mounts LittleFS and picks up samples spilled before a reboot
+    bool begin();
+    
+    void push(const BatteryData& sample);
+    
+    // Oldest queued sample; pop removes it after it was published
+    bool peek(BatteryData& sample);
+    void pop();
+    
+    // Stores the read position after a batch of pops. Samples popped since
+    // the last call are replayed once more after a reboot.
+    void savePosition();
+    
+    bool isEmpty() const;
+    uint32_t size() const;
+    uint32_t getDroppedSamples() const;
+
+private:
+    BatteryData ram[MQTT_QUEUE_RAM_SAMPLES];
+    uint16_t ramHead;
+    uint16_t ramCount;
+    
+    bool spillReady;
+    uint32_t readSequence;      // Segment replayed from
+    uint32_t readIndex;         // Records of it already published
+    bool positionDirty;         // readIndex moved since it was last stored
+    uint32_t writeSequence;     // Segment appended to
+    uint32_t writeCount;        // Records in it
+    uint32_t spillCount;        // Unpublished records on flash
+    uint32_t droppedSamples;
+    
+    void spillOldest();
+    bool readSpilled(BatteryData& sample);
+    void finishReadSegment();
+    void dropReadSegment();
+    bool writeReadPosition();
+    void resetSpill();
+    
+    static void getSegmentPath(uint32_t sequence, char* path, size_t size);
+    static int32_t countRecords(uint32_t sequence);
+};
+
+#endif // PUBLISH_QUEUE_H
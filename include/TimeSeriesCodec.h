@@ -0,0 +1,65 @@
+#ifndef TIME_SERIES_CODEC_H
+#define TIME_SERIES_CODEC_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "BatteryProtocol.h"
+
+// Record encoding of the persisted time-series log. Each record holds one
+// battery sample in the raw BMS units:
+//
+//   battery index           1 byte
+//   time                    varint, absolute for the first record of a battery,
+//                           then zigzag delta-of-delta (0 for a steady interval)
+//   changed-field mask      1 byte, see FIELD_*
+//   changed fields          zigzag varint delta per field, switches and cell count raw
+//   changed-cell mask       varint, only if FIELD_CELLS is set
+//   changed cells           zigzag varint delta per cell in the mask
+//
+// Unchanged fields cost nothing, so an idle battery takes about 3 bytes per
+// sample. Deltas refer to the previous record of the same battery, so the
+// encoder and decoder must see the same records in the same order; reset()
+// starts a new independent run (one per segment file).
+class TimeSeriesCodec {
+public:
+    static const size_t RECORD_MAX = 1 + 5 + 1 + 5 * 3 + 2 + 5 + BATTERY_MAX_CELLS * 3;
+    
+    TimeSeriesCodec();
+    
+    void reset();
+    
+    // Encodes into out (at least RECORD_MAX bytes), returns the record length
+    size_t encode(int batteryIndex, const BatteryData& data, uint32_t time, uint8_t* out);
+    
+    // Decodes one record from in. Returns the bytes consumed, 0 if the record is
+    // incomplete or invalid. data.mac and data.timestamp are left empty.
+    size_t decode(const uint8_t* in, size_t length, int& batteryIndex, uint32_t& time, BatteryData& data);
+
+private:
+    enum Field : uint8_t {
+        FIELD_VOLTAGE     = 0x01,
+        FIELD_CURRENT     = 0x02,
+        FIELD_REMAINING   = 0x04,
+        FIELD_NOMINAL     = 0x08,
+        FIELD_TEMPERATURE = 0x10,
+        FIELD_FLAGS       = 0x20,   // Switches, dataValid in bit 7
+        FIELD_NUM_CELLS   = 0x40,
+        FIELD_CELLS       = 0x80
+    };
+    
+    struct Track {
+        bool seen;
+        uint32_t lastTime;
+        int32_t lastInterval;
+        BatteryData previous;
+    };
+    Track tracks[BATTERY_COUNT];
+    
+    static size_t putVarint(uint8_t* out, uint32_t value);
+    static size_t getVarint(const uint8_t* in, size_t length, uint32_t& value);
+    static bool readDelta(const uint8_t* in, size_t length, size_t& position, int32_t& delta);
+    static uint32_t zigzag(int32_t value);
+    static int32_t unzigzag(uint32_t value);
+};
+
+#endif // TIME_SERIES_CODEC_H
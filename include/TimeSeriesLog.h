@@ -0,0 +1,112 @@
+#ifndef TIME_SERIES_LOG_H
+#define TIME_SERIES_LOG_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config.h"
+#include "BatteryProtocol.h"
+#include "TimeSeriesCodec.h"
+
+// Persistent sample log on LittleFS. Records (see TimeSeriesCodec) are
+// collected in RAM and appended to the current segment file in blocks, at
+// most every TSLOG_FLUSH_INTERVAL_MS or when the buffer fills. Segments are
+// closed at TSLOG_SEGMENT_SIZE and on reboot; each starts a fresh codec run,
+// so it can be decoded on its own. Closed segments are listed in a small
+// index file (sequence, first and last time, records, bytes) used for range
+// seeks and retention: beyond TSLOG_MAX_BYTES the oldest segments are deleted.
+// Times are UTC epoch seconds, samples before the clock is set are skipped.
+class TimeSeriesLog {
+public:
+    struct SegmentInfo {
+        uint32_t sequence;
+        uint32_t firstTime;
+        uint32_t lastTime;
+        uint32_t records;
+        uint32_t bytes;
+    };
+    
+    // Upper bound of segments on flash, closed ones plus the open one
+    static const int MAX_SEGMENTS = TSLOG_MAX_BYTES / TSLOG_SEGMENT_SIZE + 2;
+    
+    TimeSeriesLog();
+    
+    // Mounts LittleFS, loads the index and closes the segment left open before the reboot
+    bool begin();
+    
+    // Encodes a sample into the RAM buffer. Returns false if it was not logged.
+    bool append(int batteryIndex, const BatteryData& data, uint32_t time);
+    
+    // Writes the buffer once the flush interval passed, called periodically from loop()
+    void loop();
+    
+    // Writes the buffer now (before export, OTA or restart)
+    void flush();
+    
+    // Segments with samples in [from, to], oldest first, the open one included.
+    // Flushes first, so everything appended so far can be read.
+    int findSegments(uint32_t from, uint32_t to, SegmentInfo* segments, int maxCount);
+    
+    static void getSegmentPath(uint32_t sequence, char* path, size_t size);
+    
+    // Statistics
+    uint32_t getStoredBytes() const;
+    uint32_t getSegmentCount() const;
+    uint32_t getBytesWritten() const;       // Payload bytes handed to the filesystem
+    uint32_t getFlushCount() const;         // Write operations, one per flushed block
+    uint32_t getDroppedRecords() const;
+
+private:
+    bool ready;
+    SemaphoreHandle_t mutex;
+    
+    SegmentInfo segments[MAX_SEGMENTS];     // Closed segments, oldest first
+    int segmentCount;
+    SegmentInfo current;                    // Open segment, bytes include the file header
+    TimeSeriesCodec encoder;
+    
+    uint8_t pending[TSLOG_BUFFER_SIZE];
+    size_t pendingLength;
+    uint32_t pendingRecords;
+    unsigned long lastFlush;
+    
+    uint32_t bytesWritten;
+    uint32_t flushCount;
+    uint32_t droppedRecords;
+    
+    void loadIndex();
+    bool appendIndex(const SegmentInfo& info);
+    bool rewriteIndex();
+    bool recoverSegment(uint32_t sequence, SegmentInfo& info);
+    void flushLocked();
+    void closeSegment();
+    void enforceRetention();
+    void startSegment(uint32_t sequence);
+};
+
+// Decodes one segment file record by record through a small fixed buffer
+class TimeSeriesReader {
+public:
+    TimeSeriesReader();
+    ~TimeSeriesReader();
+    
+    bool open(uint32_t sequence);
+    
+    // Next record, false at the end of the segment or on a truncated record
+    bool next(int& batteryIndex, uint32_t& time, BatteryData& data);
+    
+    void close();
+
+private:
+    File file;
+    TimeSeriesCodec decoder;
+    uint8_t buffer[2 * TimeSeriesCodec::RECORD_MAX];
+    size_t length;
+    size_t position;
+    bool endOfFile;
+    
+    void refill();
+};
+
+#endif // TIME_SERIES_LOG_H
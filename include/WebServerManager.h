@@ -3,41 +3,144 @@
 
 #include <Arduino.h>
 #include <WebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
 #include "config.h"
 #include "BatteryProtocol.h"
+#include "HistoryBuffer.h"
+#include "TimeSeriesLog.h"
+#include "LoopScheduler.h"
+#include "AcquisitionTask.h"
+#include "MqttClient.h"
+#include "Metrics.h"
+#include "Logger.h"
+
+// WebServer that hands the connection of the running request to the caller.
+// A detached client is no longer the server's current client, so
+// handleClient() drops it as soon as the handler returns and accepts the
+// next request. Kept by the server, an event stream that never closes would
+// hold it in HC_WAIT_CLOSE for up to HTTP_MAX_CLOSE_WAIT (2 s) on every
+// new stream, and on cores with SSE support indefinitely.
+class DetachableWebServer : public WebServer {
+public:
+    explicit DetachableWebServer(int port) : WebServer(port) {}
+    
+    WiFiClient detachClient() {
+        WiFiClient client = _currentClient;
+        _currentClient = WiFiClient();
+        return client;
+    }
+};
 
 class WebServerManager {
 public:
     WebServerManager();
     ~WebServerManager();
     
-    // Initialization
+    // Initialization, starts the HTTP task
     void begin();
     
-    // Main loop handling
-    void handleClient();
-    
-    // Data management
+    // Data management, safe to call from any task
     void updateBatteryData(int batteryIndex, const BatteryData& batteryData);
     void setBatteryDataUpdateTime(int batteryIndex, unsigned long updateTime);
+    void updateBatteryPresence(int batteryIndex, bool present, int rssi);
+    
+    // Source of /api/export, without it the endpoint answers 503
+    void setTimeSeriesLog(TimeSeriesLog* log);
+    
+    // Job statistics for /metrics. Read from the HTTP task without a lock:
+    // each value is a single 32-bit word the loop task only ever overwrites.
+    void setLoopScheduler(const LoopScheduler* scheduler);
+    
+    // Loss and queue counters for /metrics, read the same way
+    void setAcquisitionTask(const AcquisitionTask* task);
+    void setMqttClient(const MqttClient* client);
+    void setBluetoothManager(const BluetoothManager* manager);
     
     // Status
     bool isRunning() const;
 
 private:
-    WebServer* webServer;
+    DetachableWebServer* webServer;
     bool serverRunning;
     
+    // HTTP is served from its own task, independent of loop() and BLE polling.
+    // The battery fields, snapshot and pending events below are shared with
+    // the updating task and guarded by dataMutex; handlers copy what they
+    // need and send outside the lock.
+    TaskHandle_t taskHandle;
+    SemaphoreHandle_t dataMutex;
+    
     // Battery data storage for web display
     BatteryData latestBatteryData[BATTERY_COUNT];
     unsigned long lastDataUpdate[BATTERY_COUNT];
+    bool batteryPresent[BATTERY_COUNT];
+    int batteryRssi[BATTERY_COUNT];
+    
+    // Trend data for /api/history, has its own lock
+    HistoryBuffer history;
+    
+    // /api/data payload, rendered whenever the data changes instead of per request.
+    // Ages are left to the client: each battery carries the uptime of its last
+    // update and every response the current uptime in X-Uptime-Ms.
+    static const size_t BATTERY_JSON_SIZE = 256 + BATTERY_MAX_CELLS * 8;
+    static const size_t SNAPSHOT_SIZE = BATTERY_COUNT * (BATTERY_JSON_SIZE + 1) + 8;
+    char dataSnapshot[SNAPSHOT_SIZE];
+    size_t dataSnapshotLength;
+    uint32_t snapshotVersion;
+    char snapshotEtag[24];
+    uint32_t bootId;
+    char responseBuffer[SNAPSHOT_SIZE];     // HTTP task only
+    
+    // /api/events subscribers. Updates are collected per battery and pushed
+    // from handleClient(), so data and update time arrive as one event. The
+    // streams are detached from the server and only ever written from here.
+    WiFiClient eventClients[WEB_SSE_MAX_CLIENTS];
+    uint32_t pendingEvents;
+    unsigned long lastEventKeepalive;
+    char eventBuffer[BATTERY_JSON_SIZE + 64];
+    
+    // /api/export, decoded segment by segment into a fixed buffer (HTTP task only).
+    // /metrics streams through the same buffer.
+    static const size_t EXPORT_ROW_MAX = 96 + BATTERY_MAX_CELLS * 6;
+    static const size_t METRIC_LINE_MAX = 256;
+    TimeSeriesLog* timeSeriesLog;
+    const LoopScheduler* loopScheduler;
+    const AcquisitionTask* acquisitionTask;
+    const MqttClient* mqttClient;
+    const BluetoothManager* bluetoothManager;
+    TimeSeriesLog::SegmentInfo exportSegments[TimeSeriesLog::MAX_SEGMENTS];
+    TimeSeriesReader exportReader;
+    char exportBuffer[WEB_EXPORT_BUFFER_SIZE];
     
     // HTTP handlers
     void handleRoot();
     void handleApiData();
+    void handleApiLog();
+    void handleApiEvents();
+    void handleApiHistory();
+    void handleApiExport();
+    void handleMetrics();
+    
+    // HTTP task
+    static void taskEntry(void* param);
+    void run();
+    void lock();
+    void unlock();
     
     // Helper methods
     void initializeBatteryData();
+    static uint32_t uptimeSeconds();
+    void renderSnapshot();
+    size_t renderBattery(int batteryIndex, char* buffer, size_t capacity);
+    static void appendJson(char* buffer, size_t capacity, size_t& length, const char* format, ...);
+    void batteryChanged(int batteryIndex);
+    void pushEvents();
+    void broadcastEvent(const char* event, size_t length);
+    void exportCsv(uint32_t sequence, uint32_t from, uint32_t to, size_t& length, size_t& sent, uint32_t& records);
+    bool exportBinary(const TimeSeriesLog::SegmentInfo& segment, size_t& sent);
+    void appendMetricLine(size_t& length, const char* format, ...);
 };
 
 #endif // WEBSERVER_MANAGER_H
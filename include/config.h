@@ -14,6 +14,30 @@
 #define MQTT_PASSWORD "YOUR_MQTT_PASSWORD"
 #define MQTT_CLIENT_ID "eco-worthy-logger"
 #define MQTT_TOPIC_PREFIX "eco-worthy"
+#define MQTT_PAYLOAD_BUFFER_SIZE 1024    // Serialization buffer, fits a full sample with 32 cells
+#define MQTT_CONNECT_TIMEOUT_MS 5000     // DNS lookup and TCP connect, polled without blocking
+#define MQTT_HANDSHAKE_TIMEOUT_S 2       // CONNACK wait once the socket is up, blocks loop()
+#define MQTT_BACKOFF_MIN_MS 1000         // First retry delay after a failed attempt
+#define MQTT_BACKOFF_MAX_MS 60000        // Retry delay doubles per failure up to this limit
+
+// MQTT Publish Queue Configuration
+#define MQTT_QUEUE_RAM_SAMPLES 32        // Samples kept in RAM while the broker is unreachable
+#define MQTT_QUEUE_SPILL_ENABLED true    // Move older samples to LittleFS segments when RAM is full
+#define MQTT_QUEUE_SPILL_SAMPLES 2048    // Capacity on LittleFS (87 bytes per sample)
+#define MQTT_QUEUE_SPILL_SEGMENT_SAMPLES 64  // Samples per segment file, deleted whole once replayed
+#define MQTT_QUEUE_SPILL_BATCH 8         // Samples moved to flash per write when RAM is full
+#define MQTT_REPLAY_BATCH 5              // Samples replayed per batch after reconnect
+#define MQTT_REPLAY_INTERVAL_MS 200      // Pause between replay batches
+
+// MQTT Change-Only Publishing Configuration
+#define MQTT_DEADBAND_ENABLED true       // Skip samples where no field moved beyond its deadband
+#define MQTT_DEADBAND_VOLTAGE_MV 10      // Pack voltage
+#define MQTT_DEADBAND_CURRENT_MA 100     // Pack current
+#define MQTT_DEADBAND_SOC_PERCENT 0.5    // State of charge
+#define MQTT_DEADBAND_TEMPERATURE_C 0.5  // Temperature
+#define MQTT_DEADBAND_CELL_MV 5          // Any single cell voltage
+#define MQTT_HEARTBEAT_MS 300000         // Publish at least this often even if nothing changed (5 minutes)
+#define MQTT_FIELD_TOPICS_ENABLED false  // Also publish changed fields to <prefix>/battery/<mac>/<field>
 
 // OTA Configuration
 #define OTA_ENABLED true
@@ -22,16 +46,78 @@
 // LED Configuration
 #define LED_ENABLED true  // Enable/disable LED status indicators
 
+// Web Server Configuration
+#define WEB_PAGE_MAX_AGE_S 86400     // Browser cache lifetime of the dashboard page, revalidated by ETag afterwards
+#define WEB_SSE_MAX_CLIENTS 4        // Open /api/events streams, further dashboards fall back to polling
+#define WEB_SSE_KEEPALIVE_MS 15000   // Keepalive comment on idle event streams
+#define WEB_TASK_CORE 1              // HTTP task runs next to loop(), BLE acquisition has core 0
+#define WEB_TASK_STACK_SIZE 6144
+#define WEB_TASK_PRIORITY 1
+#define WEB_TASK_INTERVAL_MS 5       // Pause between handleClient() passes
+#define WEB_EXPORT_BUFFER_SIZE 1460  // Chunk buffer of /api/export, one TCP segment
+
+// History Configuration
+#define HISTORY_SAMPLES 2880         // Samples kept per battery (12 bytes each): 24 h at SCAN_INTERVAL_MS, 8 h at POLL_INTERVAL_MIN_MS
+#define HISTORY_DEFAULT_POINTS 120   // Buckets returned by /api/history without points=
+#define HISTORY_MAX_POINTS 500       // Upper limit for points=
+
+// Persistent Time-Series Log Configuration
+#define TSLOG_ENABLED true               // Append every sample to a compressed log on LittleFS
+#define TSLOG_SEGMENT_SIZE 16384         // Segment file size, the unit of retention
+#define TSLOG_MAX_BYTES 524288           // Oldest segments are deleted beyond this total (512 KB)
+#define TSLOG_BUFFER_SIZE 1024           // RAM buffer, written to flash as one block
+#define TSLOG_FLUSH_INTERVAL_MS 300000   // Write the buffer at least this often (5 minutes)
+#define NTP_SERVER "pool.ntp.org"        // Wall clock for the log and MQTT timestamps
+#define NTP_VALID_AFTER 1609459200       // 2021-01-01, an earlier clock means no NTP time yet
+
 // Watchdog Configuration
 #define WATCHDOG_ENABLED true        // Enable hardware watchdog timer
 #define WATCHDOG_TIMEOUT_MS 30000    // 30 seconds watchdog timeout
-#define MANAGER_TIMEOUT_MS 5000      // 5 seconds timeout for manager operations
+
+// Logging Configuration
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 3                  // 0 none, 1 error, 2 warn, 3 info, 4 debug; higher levels compile out
+#endif
+#define LOG_BUFFER_SIZE 4096         // Ring buffer for log lines, also served at /api/log
+#define LOG_DRAIN_INTERVAL_MS 20     // How often the background task writes the ring to Serial
+
+// Loop Scheduler Configuration
+#define LOOP_PASS_BUDGET_MS 50       // One scheduler pass yields after this long, remaining jobs run next
+#define LOOP_MAX_SLEEP_MS 100        // Longest sleep of loop() between scheduler passes
 
 // Battery Configuration
 #define BATTERY_COUNT 2
-#define SCAN_INTERVAL_MS 30000  // 30 seconds between scans
+#define SCAN_INTERVAL_MS 30000  // 30 seconds between scans (base interval of the poll scheduler)
 #define CONNECTION_TIMEOUT_MS 10000  // 10 seconds connection timeout
 
+// Adaptive Poll Scheduler Configuration
+#define POLL_INTERVAL_MIN_MS 10000       // Interval while charging, under load or on transients
+#define POLL_INTERVAL_MAX_MS 300000      // Idle batteries back off up to 5 minutes
+#define POLL_ACTIVE_POWER_W 50.0         // Power above this counts as charging/heavy load
+#define POLL_CURRENT_DELTA_A 1.0         // Current step between samples that counts as transient
+#define POLL_SOC_RATE_PER_MIN 0.2        // SOC change in % per minute that counts as active
+#define POLL_RADIO_DUTY_PERCENT 20       // Max share of time spent on BLE polls
+#define POLL_DUTY_WINDOW_MS 600000       // Burst window of the radio duty budget (10 minutes)
+
+// BLE Link Configuration
+#define BLE_PERSISTENT_CONNECTIONS true  // Keep links to all batteries open between polls (max 3 links on ESP32)
+#define BLE_MAX_POLL_FAILURES 2          // Drop a persistent link after this many failed polls in a row
+#define BLE_PIPELINE_COMMANDS true       // Write all read commands back to back, BMS answers in FIFO order
+#define BLE_COMMAND_TIMEOUT_MS 5000      // Timeout per outstanding command
+#define BLE_GATT_CACHE_NVS true          // Persist discovered GATT handles per battery across reboots
+
+// BLE Presence Scan Configuration
+#define BLE_PRESENCE_SCAN_ENABLED true       // Only dial batteries seen advertising recently
+#define BLE_PRESENCE_SCAN_WINDOW_S 3         // Length of one passive scan window
+#define BLE_PRESENCE_SCAN_INTERVAL_MS 15000  // Start a new scan window this often
+#define BLE_PRESENCE_TIMEOUT_MS 120000       // Battery counts as absent when not seen for this long
+
+// BLE Acquisition Task Configuration
+#define ACQ_TASK_CORE 0                  // Core for BLE acquisition, loop() and the network stack run on core 1
+#define ACQ_TASK_STACK_SIZE 8192         // Stack size of the acquisition task in bytes
+#define ACQ_TASK_PRIORITY 1              // Same priority as loop()
+#define ACQ_QUEUE_LENGTH 8               // Presence reports and samples buffered for the network side
+
 // Battery MAC Addresses
 // Replace with your actual battery MAC addresses
 const String BATTERY_MAC_ADDRESSES[BATTERY_COUNT] = {
@@ -0,0 +1,67 @@
+"""Embed the dashboard as a gzipped byte array.
+
+Runs as a PlatformIO pre-build script (see extra_scripts in platformio.ini)
+and can also be started by hand: python scripts/embed_web.py
+
+Reads web/index.html and writes include/index_html_gz.h. The ETag is derived
+from the compressed page, so it changes exactly when a firmware build ships a
+different page. The header is only rewritten when its content changes, so
+unchanged pages do not trigger a rebuild.
+"""
+
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+SOURCE = os.path.join(PROJECT_DIR, "web", "index.html")
+TARGET = os.path.join(PROJECT_DIR, "include", "index_html_gz.h")
+
+
+def render_header(html):
+    # mtime=0 keeps the output identical for identical input
+    compressed = gzip.compress(html, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(compressed).hexdigest()[:16]
+
+    lines = [
+        "// Generated by scripts/embed_web.py from web/index.html - do not edit",
+        "#ifndef INDEX_HTML_GZ_H",
+        "#define INDEX_HTML_GZ_H",
+        "",
+        "#include <Arduino.h>",
+        "",
+        '#define INDEX_HTML_ETAG "\\"%s\\""' % etag,
+        "",
+        "const size_t index_html_gz_len = %d;  // %d bytes uncompressed" % (len(compressed), len(html)),
+        "const uint8_t index_html_gz[] PROGMEM = {",
+    ]
+    for offset in range(0, len(compressed), 16):
+        chunk = compressed[offset:offset + 16]
+        lines.append("    " + ", ".join("0x%02x" % b for b in chunk) + ",")
+    lines += ["};", "", "#endif // INDEX_HTML_GZ_H", ""]
+    return "\n".join(lines), len(compressed)
+
+
+def main():
+    with open(SOURCE, "rb") as f:
+        html = f.read()
+
+    header, compressed_size = render_header(html)
+
+    existing = None
+    if os.path.exists(TARGET):
+        with open(TARGET, "r") as f:
+            existing = f.read()
+
+    if header != existing:
+        with open(TARGET, "w") as f:
+            f.write(header)
+        print("embed_web: index.html %d -> %d bytes gzipped" % (len(html), compressed_size))
+
+
+main()
@@ -0,0 +1,183 @@
+#include "AcquisitionTask.h"
+#include <esp_task_wdt.h>
+#include "Logger.h"
+
+AcquisitionTask::AcquisitionTask(BluetoothManager& bluetoothManager, PollScheduler& pollScheduler)
+    : bluetoothManager(bluetoothManager)
+    , pollScheduler(pollScheduler)
+    , taskHandle(nullptr)
+    , eventQueue(nullptr)
+    , immediateRequested(false)
+    , polling(false)
+    , droppedEvents(0)
+{
+}
+
+AcquisitionTask::~AcquisitionTask() {
+    if (taskHandle) {
+        vTaskDelete(taskHandle);
+        taskHandle = nullptr;
+    }
+    if (eventQueue) {
+        vQueueDelete(eventQueue);
+        eventQueue = nullptr;
+    }
+}
+
+bool AcquisitionTask::begin() {
+    eventQueue = xQueueCreate(ACQ_QUEUE_LENGTH, sizeof(AcquisitionEvent));
+    if (eventQueue == nullptr) {
+        LOG_E("Acquisition", "Failed to create event queue");
+        return false;
+    }
+    
+    BaseType_t created = xTaskCreatePinnedToCore(taskEntry, "ble-acquisition", ACQ_TASK_STACK_SIZE, this,
+                                                 ACQ_TASK_PRIORITY, &taskHandle, ACQ_TASK_CORE);
+    if (created != pdPASS) {
+        LOG_E("Acquisition", "Failed to start task");
+        taskHandle = nullptr;
+        return false;
+    }
+    
+    LOG_I("Acquisition", "Task started on core %d", ACQ_TASK_CORE);
+    return true;
+}
+
+bool AcquisitionTask::receive(AcquisitionEvent& event) {
+    return eventQueue != nullptr && xQueueReceive(eventQueue, &event, 0) == pdTRUE;
+}
+
+bool AcquisitionTask::waitForEvent(uint32_t timeoutMs) {
+    AcquisitionEvent event;
+    if (eventQueue == nullptr) {
+        delay(timeoutMs);
+        return false;
+    }
+    return xQueuePeek(eventQueue, &event, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+void AcquisitionTask::requestImmediate() {
+    immediateRequested = true;
+}
+
+bool AcquisitionTask::isPolling() const {
+    return polling;
+}
+
+uint32_t AcquisitionTask::getDroppedEvents() const {
+    return droppedEvents;
+}
+
+void AcquisitionTask::taskEntry(void* param) {
+    static_cast<AcquisitionTask*>(param)->run();
+}
+
+void AcquisitionTask::run() {
+    if (WATCHDOG_ENABLED) {
+        esp_task_wdt_add(NULL);
+    }
+    
+    while (true) {
+        feedWatchdog();
+        
+        if (immediateRequested.exchange(false)) {
+            pollScheduler.requestImmediate();
+        }
+        
+        try {
+            // Run presence scan windows between battery polls
+            bluetoothManager.loop();
+            pollDueBatteries();
+        } catch (...) {
+            LOG_E("Acquisition", "Exception during battery polling");
+            polling = false;
+        }
+        
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+}
+
+void AcquisitionTask::pollDueBatteries() {
+    // Poll every battery the scheduler considers due in one parallel round
+    int dueIndices[BATTERY_COUNT];
+    int dueCount = pollScheduler.collectDueBatteries(dueIndices, BATTERY_COUNT);
+    if (dueCount == 0) {
+        return;
+    }
+    
+    int pollIndices[BATTERY_COUNT];
+    int pollCount = 0;
+    
+    for (int k = 0; k < dueCount; k++) {
+        int batteryIndex = dueIndices[k];
+        const String& macAddress = BATTERY_MAC_ADDRESSES[batteryIndex];
+        
+        // Report presence and skip batteries that were not seen advertising recently
+        bool present = bluetoothManager.isBatteryPresent(macAddress);
+        postPresence(batteryIndex, present, bluetoothManager.getBatteryRssi(macAddress));
+        
+        if (!present) {
+            LOG_I("Acquisition", "Skipping battery %d: %s (not advertising)", batteryIndex + 1, macAddress.c_str());
+            pollScheduler.recordSkipped(batteryIndex);
+        } else {
+            LOG_I("Acquisition", "Scanning battery %d: %s", batteryIndex + 1, macAddress.c_str());
+            pollIndices[pollCount++] = batteryIndex;
+        }
+    }
+    
+    if (pollCount == 0) {
+        return;
+    }
+    
+    // Battery reads block this task only, their duration counts against the radio budget
+    BatteryData batteryData[BATTERY_COUNT];
+    bool success[BATTERY_COUNT] = {false};
+    polling = true;
+    feedWatchdog();
+    unsigned long pollStart = millis();
+    bluetoothManager.readBatteries(pollIndices, pollCount, batteryData, success);
+    
+    // The batteries shared the radio time, charge each its part
+    unsigned long airtimeMs = (millis() - pollStart) / pollCount;
+    for (int k = 0; k < pollCount; k++) {
+        int batteryIndex = pollIndices[k];
+        bool valid = success[k] && batteryData[k].dataValid;
+        pollScheduler.recordPoll(batteryIndex, valid, batteryData[k], airtimeMs);
+        postSample(batteryIndex, valid, batteryData[k]);
+        LOG_I("Acquisition", "Battery %d next poll in %lus", batteryIndex + 1, pollScheduler.getInterval(batteryIndex) / 1000);
+    }
+    polling = false;
+}
+
+void AcquisitionTask::postPresence(int batteryIndex, bool present, int rssi) {
+    AcquisitionEvent event = {};
+    event.type = AcquisitionEvent::PRESENCE;
+    event.batteryIndex = batteryIndex;
+    event.present = present;
+    event.rssi = rssi;
+    
+    // Never block acquisition on a slow consumer
+    if (xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+        droppedEvents++;
+    }
+}
+
+void AcquisitionTask::postSample(int batteryIndex, bool success, const BatteryData& batteryData) {
+    AcquisitionEvent event = {};
+    event.type = AcquisitionEvent::SAMPLE;
+    event.batteryIndex = batteryIndex;
+    event.success = success;
+    event.batteryData = batteryData;
+    
+    // Without room the sample is dropped, the next poll brings a fresh one
+    if (xQueueSend(eventQueue, &event, 0) != pdTRUE) {
+        droppedEvents++;
+        LOG_W("Acquisition", "Event queue full, dropping sample of battery %d", batteryIndex + 1);
+    }
+}
+
+void AcquisitionTask::feedWatchdog() {
+    if (WATCHDOG_ENABLED) {
+        esp_task_wdt_reset();
+    }
+}
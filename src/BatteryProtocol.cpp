@@ -1,7 +1,8 @@
 #include "BatteryProtocol.h"
 #include "config.h"
 
-BatteryProtocol::BatteryProtocol() {
+BatteryProtocol::BatteryProtocol() : lastFrameCommand(0) {
+    resetParser();
 }
 
 void BatteryProtocol::createCommand(uint8_t cmd, uint8_t* buffer, uint8_t& length) {
@@ -37,149 +38,198 @@ void BatteryProtocol::createHardwareVersionCommand(uint8_t* buffer, uint8_t& len
     createCommand(CMD_READ_HARDWARE_VERSION, buffer, length);
 }
 
-bool BatteryProtocol::parseBasicInfoResponse(const uint8_t* data, uint8_t length, BatteryData& batteryData) {
-    printHex(data, length);
-    
-    // Check minimum length for error response
-    if (length < 7) {
-        return false;
-    }
-    
-    // ECO-WORTHY BMS response format (from ewbatlog.py):
-    // DD 03 [length_high] [length_low] [data...] [checksum_high] [checksum_low] 77
-    
-    // Check frame start and end
-    if (data[0] != FRAME_START) {
-        return false;
-    }
-    
-    if (data[length-1] != FRAME_END) {
-        return false;
-    }
-    
-    // Check command echo
-    if (data[1] != CMD_READ_BASIC_INFO) {
-        return false;
+void BatteryProtocol::resetParser() {
+    parserState = ParserState::WAIT_START;
+    frameCommand = 0;
+    frameStatus = 0;
+    payloadLength = 0;
+    payloadIndex = 0;
+    previousByte = 0;
+    runningSum = 0;
+    receivedChecksum = 0;
+    memset(&staged, 0, sizeof(staged));
+}
+
+FrameResult BatteryProtocol::feed(const uint8_t* data, size_t length, size_t& consumed, BatteryData& batteryData) {
+    consumed = 0;
+    if (data == nullptr) {
+        return FrameResult::NEED_MORE;
     }
     
-    // Get data length from bytes 2-3 (big endian)
-    uint16_t dataLength = (data[2] << 8) | data[3];
-    
-    // Check if we have enough data
-    if (length < (dataLength + 7)) {
-        return false;
+    while (consumed < length) {
+        FrameResult result = consumeByte(data[consumed++], batteryData);
+        if (result != FrameResult::NEED_MORE) {
+            return result;
+        }
     }
     
-    // Parse data starting from byte 4 (based on ewbatlog.py decodeParams1)
-    uint8_t offset = 4;
-    
-    // Total voltage (2 bytes, unit: 10mV) - bytes 4-5
-    uint16_t voltage_raw = (data[offset] << 8) | data[offset+1];
-    batteryData.voltage = voltage_raw / 100.0;
-    offset += 2;
-    
-    // Current (2 bytes, unit: 10mA, signed) - bytes 6-7
-    int16_t current_raw = (data[offset] << 8) | data[offset+1];
-    if (current_raw > 0x7fff) {
-        current_raw = current_raw - 0x10000;
+    return FrameResult::NEED_MORE;
+}
+
+uint8_t BatteryProtocol::getLastFrameCommand() const {
+    return lastFrameCommand;
+}
+
+FrameResult BatteryProtocol::consumeByte(uint8_t byte, BatteryData& batteryData) {
+    // ECO-WORTHY BMS response format (from ewbatlog.py):
+    // DD [cmd] [status] [length] [data...] [checksum_high] [checksum_low] 77
+    // Checksum is 0x10000 minus the sum of status, length and data bytes.
+    switch (parserState) {
+        case ParserState::WAIT_START:
+            if (byte == FRAME_START) {
+                resetParser();
+                parserState = ParserState::COMMAND;
+            }
+            return FrameResult::NEED_MORE;
+            
+        case ParserState::COMMAND:
+            if (byte != CMD_READ_BASIC_INFO && byte != CMD_READ_CELL_VOLTAGES &&
+                byte != CMD_READ_HARDWARE_VERSION) {
+                // Not a response we understand, resynchronize on the next start byte
+                parserState = (byte == FRAME_START) ? ParserState::COMMAND : ParserState::WAIT_START;
+                return FrameResult::NEED_MORE;
+            }
+            frameCommand = byte;
+            parserState = ParserState::STATUS;
+            return FrameResult::NEED_MORE;
+            
+        case ParserState::STATUS:
+            frameStatus = byte;
+            runningSum += byte;
+            parserState = ParserState::LENGTH;
+            return FrameResult::NEED_MORE;
+            
+        case ParserState::LENGTH:
+            payloadLength = byte;
+            runningSum += byte;
+            parserState = (payloadLength > 0) ? ParserState::PAYLOAD : ParserState::CHECKSUM_HIGH;
+            return FrameResult::NEED_MORE;
+            
+        case ParserState::PAYLOAD:
+            runningSum += byte;
+            decodePayloadByte(byte);
+            previousByte = byte;
+            payloadIndex++;
+            if (payloadIndex >= payloadLength) {
+                parserState = ParserState::CHECKSUM_HIGH;
+            }
+            return FrameResult::NEED_MORE;
+            
+        case ParserState::CHECKSUM_HIGH:
+            receivedChecksum = byte << 8;
+            parserState = ParserState::CHECKSUM_LOW;
+            return FrameResult::NEED_MORE;
+            
+        case ParserState::CHECKSUM_LOW:
+            receivedChecksum |= byte;
+            parserState = ParserState::END;
+            return FrameResult::NEED_MORE;
+            
+        case ParserState::END:
+            parserState = ParserState::WAIT_START;
+            lastFrameCommand = frameCommand;
+            
+            // The end byte is checked by position only, so a 0x77 inside the payload is harmless
+            if (byte != FRAME_END) {
+                return FrameResult::FORMAT_ERROR;
+            }
+            if ((uint16_t)(0x10000 - runningSum) != receivedChecksum) {
+                return FrameResult::CHECKSUM_ERROR;
+            }
+            if (frameStatus != 0x00) {
+                return FrameResult::DEVICE_ERROR;
+            }
+            
+            applyStagedFields(batteryData);
+            return FrameResult::COMPLETE;
     }
-    batteryData.current = current_raw / 100.0;
-    offset += 2;
-    
-    // Remaining capacity (2 bytes, unit: 10mAh) - bytes 8-9
-    uint16_t remaining_raw = (data[offset] << 8) | data[offset+1];
-    batteryData.remainingAh = remaining_raw / 100.0;
-    offset += 2;
     
-    // Nominal capacity (2 bytes, unit: 10mAh) - bytes 10-11
-    uint16_t max_raw = (data[offset] << 8) | data[offset+1];
-    batteryData.maxAh = max_raw / 100.0;
-    offset += 2;
-    
-    // Calculate watts and SOC
-    batteryData.watts = batteryData.voltage * batteryData.current;
-    if (batteryData.maxAh > 0) {
-        batteryData.soc = 100.0 * (batteryData.remainingAh / batteryData.maxAh);
-    } else {
-        batteryData.soc = 0.0;
-    }
+    return FrameResult::NEED_MORE;
+}
+
+void BatteryProtocol::decodePayloadByte(uint8_t byte) {
+    // Fields are decoded from the byte stream directly; 16-bit values complete on their low byte
+    uint16_t word = (previousByte << 8) | byte;
     
-    // Skip to switches at byte 24 (offset 20 from start of data)
-    offset = 24;
-    if (offset < length - 3) {
-        // FET control status (1 byte) - byte 24
-        uint8_t switches = data[offset];
-        batteryData.switches = "";
-        if (switches & 0x01) {
-            batteryData.switches += "C+";
-        } else {
-            batteryData.switches += "C-";
+    if (frameCommand == CMD_READ_BASIC_INFO) {
+        // Offsets relative to the start of the data (based on ewbatlog.py decodeParams1)
+        switch (payloadIndex) {
+            case 1:  staged.voltageRaw = word; break;           // Total voltage, 10mV
+            case 3:  staged.currentRaw = (int16_t)word; break;  // Current, 10mA, signed
+            case 5:  staged.remainingRaw = word; break;         // Remaining capacity, 10mAh
+            case 7:  staged.nominalRaw = word; break;           // Nominal capacity, 10mAh
+            case 20:                                            // FET control status
+                staged.switches = byte;
+                staged.hasSwitches = true;
+                break;
+            case 24:                                            // First NTC, 0.1K
+                staged.temperatureRaw = word;
+                staged.hasTemperature = true;
+                break;
+            default:
+                break;
         }
-        if (switches & 0x02) {
-            batteryData.switches += "D+";
-        } else {
-            batteryData.switches += "D-";
+    } else if (frameCommand == CMD_READ_CELL_VOLTAGES) {
+        // Cell voltages, 2 bytes each in mV
+        if (payloadIndex & 0x01) {
+            uint8_t cell = payloadIndex / 2;
+            if (cell < 32) {
+                staged.cellMillivolts[cell] = word;
+                staged.numCells = cell + 1;
+            }
         }
     }
-    
-    // Temperature at bytes 27-28 (offset 23-24 from start of data)
-    offset = 27;
-    if (offset + 1 < length - 3) {
-        uint16_t temp_raw = (data[offset] << 8) | data[offset+1];
-        batteryData.temperature = (temp_raw - 2731) * 0.1;
+}
+
+void BatteryProtocol::applyStagedFields(BatteryData& batteryData) {
+    if (frameCommand == CMD_READ_BASIC_INFO) {
+        batteryData.voltage10mV = staged.voltageRaw;
+        batteryData.current10mA = staged.currentRaw;
+        batteryData.remaining10mAh = staged.remainingRaw;
+        batteryData.nominal10mAh = staged.nominalRaw;
+        
+        if (staged.hasSwitches) {
+            batteryData.switches = staged.switches & 0x03;
+        }
+        
+        batteryData.temperature01K = staged.hasTemperature ? staged.temperatureRaw : 0;
+    } else if (frameCommand == CMD_READ_CELL_VOLTAGES) {
+        batteryData.numCells = staged.numCells;
+        memcpy(batteryData.cellMillivolts, staged.cellMillivolts, staged.numCells * sizeof(uint16_t));
     } else {
-        batteryData.temperature = 0.0;
+        // Hardware version and other frames carry nothing we store
+        return;
     }
     
     batteryData.dataValid = true;
-    batteryData.timestamp = millis();
-    
-    return true;
 }
 
-bool BatteryProtocol::parseCellVoltageResponse(const uint8_t* data, uint8_t length, BatteryData& batteryData) {
-    if (length < 7) return false;
-    
-    // Check frame structure
-    if (data[0] != FRAME_START || data[length-1] != FRAME_END) {
-        return false;
-    }
-    
-    // Check command code
-    if (data[1] != CMD_READ_CELL_VOLTAGES) {
-        return false;
-    }
-    
-    // ECO-WORTHY format: DD 04 [length_high] [length_low] [data...] [checksum] 77
-    // Get data length from bytes 2-3 (big endian)
-    uint16_t dataLength = (data[2] << 8) | data[3];
+bool BatteryProtocol::parseSingleFrame(const uint8_t* data, uint8_t length, uint8_t expectedCmd, BatteryData& batteryData) {
+    printHex(data, length);
     
-    if (length < (dataLength + 7)) {
+    if (data == nullptr || length < 7 || data[0] != FRAME_START || data[1] != expectedCmd) {
         return false;
     }
     
-    // Calculate number of cells from ewbatlog.py: n_cells = int(data[3] / 2)
-    // But data[3] is low byte of length, so we use dataLength / 2
-    batteryData.numCells = dataLength / 2;
-    
-    // Parse cell voltages starting from byte 4
-    uint8_t offset = 4;
-    for (int i = 0; i < batteryData.numCells && i < 32; i++) {
-        uint16_t cellVoltage = (data[offset] << 8) | data[offset+1];
-        batteryData.cellVoltages[i] = cellVoltage / 1000.0; // Convert mV to V
-        offset += 2;
-    }
-    
-    batteryData.dataValid = true;
-    batteryData.timestamp = millis();
-    
-    return true;
+    resetParser();
+    size_t consumed = 0;
+    FrameResult result = feed(data, length, consumed, batteryData);
+    return result == FrameResult::COMPLETE;
+}
+
+bool BatteryProtocol::parseBasicInfoResponse(const uint8_t* data, uint8_t length, BatteryData& batteryData) {
+    return parseSingleFrame(data, length, CMD_READ_BASIC_INFO, batteryData);
+}
+
+bool BatteryProtocol::parseCellVoltageResponse(const uint8_t* data, uint8_t length, BatteryData& batteryData) {
+    return parseSingleFrame(data, length, CMD_READ_CELL_VOLTAGES, batteryData);
 }
 
 uint16_t BatteryProtocol::calculateChecksum(const uint8_t* data, uint8_t length) {
     uint16_t sum = 0;
-    // ECO-WORTHY checksum includes all bytes except checksum and end byte
-    for (int i = 0; i < length - 3; i++) {
+    // ECO-WORTHY checksum covers status/length and data, i.e. everything
+    // between the command byte and the checksum
+    for (int i = 2; i < length - 3; i++) {
         sum += data[i];
     }
     return (~sum) + 1; // Invert and add 1
@@ -198,3 +248,32 @@ void BatteryProtocol::printHex(const uint8_t* data, uint8_t length) {
     for (int i = 0; i < length; i++) {
     }
 }
+
+const char* BatteryData::getSwitches() const {
+    static const char* const SWITCH_NAMES[] = {"C-D-", "C-D+", "C+D-", "C+D+"};
+    return SWITCH_NAMES[(isChargeEnabled() ? 2 : 0) | (isDischargeEnabled() ? 1 : 0)];
+}
+
+String BatteryData::getMacAddress() const {
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02X:%02X:%02X:%02X:%02X:%02X",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return String(buffer);
+}
+
+bool BatteryData::setMacAddress(const String& macAddress) {
+    unsigned int bytes[6];
+    if (sscanf(macAddress.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x",
+               &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) {
+        memset(mac, 0, sizeof(mac));
+        return false;
+    }
+    for (int i = 0; i < 6; i++) {
+        mac[i] = bytes[i];
+    }
+    return true;
+}
+
+void BatteryData::clear() {
+    memset(this, 0, sizeof(*this));
+}
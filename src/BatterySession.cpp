@@ -0,0 +1,670 @@
+#include "BatterySession.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+// Sessions known to the GATT event hook, filled once during begin()
+BatterySession* BatterySession::registry[BATTERY_COUNT] = {nullptr};
+uint8_t BatterySession::registryCount = 0;
+
+BatterySession::BatterySession()
+    : client(nullptr)
+    , handlesFromCache(false)
+    , connected(false)
+    , notificationsEnabled(false)
+    , consecutiveFailures(0)
+    , descriptorWriteDone(false)
+    , descriptorWriteOk(false)
+    , wakeSemaphore(nullptr)
+    , requestData(nullptr)
+    , pendingCount(0)
+    , clientCallback(nullptr)
+{
+    memset(&handles, 0, sizeof(handles));
+    memset(pendingCommands, 0, sizeof(pendingCommands));
+    memset(lastRoundTripMicros, 0, sizeof(lastRoundTripMicros));
+}
+
+BatterySession::~BatterySession() {
+    // Safely disconnect and cleanup
+    try {
+        disconnect();
+        
+        for (uint8_t i = 0; i < registryCount; i++) {
+            if (registry[i] == this) {
+                registry[i] = registry[registryCount - 1];
+                registry[registryCount - 1] = nullptr;
+                registryCount--;
+                break;
+            }
+        }
+        
+        if (clientCallback) {
+            delete clientCallback;
+            clientCallback = nullptr;
+        }
+        client = nullptr;
+        
+    } catch (...) {
+        // Ignore exceptions during cleanup
+    }
+}
+
+bool BatterySession::begin(const String& macAddress, SemaphoreHandle_t wakeSemaphore) {
+    this->macAddress = macAddress;
+    this->wakeSemaphore = wakeSemaphore;
+    
+    if (registryCount >= BATTERY_COUNT) {
+        LOG_E("BLE", "Too many battery sessions");
+        return false;
+    }
+    
+    loadCachedHandles();
+    
+    // One client per battery so the links can be open at the same time
+    client = BLEDevice::createClient();
+    if (client == nullptr) {
+        LOG_E("BLE", "Failed to create BLE client for %s", macAddress.c_str());
+        return false;
+    }
+    
+    clientCallback = new ClientCallback(this);
+    client->setClientCallbacks(clientCallback);
+    
+    registry[registryCount++] = this;
+    return true;
+}
+
+const String& BatterySession::getMacAddress() const {
+    return macAddress;
+}
+
+bool BatterySession::connect() {
+    const unsigned long CONNECT_TIMEOUT_MS = 10000; // 10 seconds timeout
+    
+    if (client == nullptr) {
+        return false;
+    }
+    
+    try {
+        // Close a stale link before dialing again
+        if (connected || client->isConnected()) {
+            LOG_I("BLE", "Closing stale link to %s", macAddress.c_str());
+            client->disconnect();
+            delay(500);
+            connected = false;
+        }
+        
+        notificationsEnabled = false;
+        handlesFromCache = false;
+        consecutiveFailures = 0;
+        
+        BLEAddress bleAddress(macAddress.c_str());
+        LOG_I("BLE", "Attempting to connect to: %s", macAddress.c_str());
+        
+        // Connect with explicit timeout protection
+        unsigned long connectStartTime = millis();
+        bool connectSuccess = false;
+        
+        // Non-blocking connect attempt with timeout
+        while ((millis() - connectStartTime) < CONNECT_TIMEOUT_MS) {
+            if (client->connect(bleAddress)) {
+                connectSuccess = true;
+                break;
+            }
+            
+            // Check every 500ms and allow other tasks to run
+            delay(500);
+            yield();
+            
+            // Early exit if connection is established
+            if (client->isConnected()) {
+                connectSuccess = true;
+                break;
+            }
+        }
+        
+        if (!connectSuccess) {
+            LOG_W("BLE", "Connection timeout after %lums", millis() - connectStartTime);
+            return false;
+        }
+        metricBleConnectDuration.observe((millis() - connectStartTime) * 1000);
+        
+        // Go straight to enabling notifications when the handles are known
+        if (handles.valid) {
+            LOG_I("BLE", "Connected successfully, using cached GATT handles");
+            if (enableNotifications()) {
+                handlesFromCache = true;
+                LOG_I("BLE", "Successfully connected and configured");
+                return true;
+            }
+            
+            LOG_W("BLE", "Cached GATT handles rejected, rediscovering");
+            invalidateHandles();
+            if (!client->isConnected()) {
+                return false;
+            }
+        } else {
+            LOG_I("BLE", "Connected successfully, discovering services...");
+        }
+        
+        if (!discoverHandles()) {
+            invalidateHandles();
+            disconnect();
+            return false;
+        }
+        
+        if (!enableNotifications()) {
+            LOG_E("BLE", "Failed to enable notifications");
+            invalidateHandles();
+            disconnect();
+            return false;
+        }
+        
+        storeHandles();
+        LOG_I("BLE", "Successfully connected and configured");
+        return true;
+        
+    } catch (const std::exception& e) {
+        LOG_E("BLE", "Connect error: %s", e.what());
+        disconnect();
+        return false;
+    } catch (...) {
+        LOG_E("BLE", "Connect failed with unknown error");
+        disconnect();
+        return false;
+    }
+}
+
+bool BatterySession::discoverHandles() {
+    const unsigned long SERVICE_TIMEOUT_MS = 5000;  // 5 seconds for service discovery
+    MetricTimer timer(metricBleDiscoveryDuration);
+    
+    // Get the service with timeout protection
+    unsigned long serviceStartTime = millis();
+    BLERemoteService* pRemoteService = nullptr;
+    
+    while ((millis() - serviceStartTime) < SERVICE_TIMEOUT_MS) {
+        pRemoteService = client->getService(SERVICE_UUID);
+        if (pRemoteService != nullptr) {
+            break;
+        }
+        
+        delay(200);
+        yield();
+        
+        // Check if connection is still valid
+        if (!client->isConnected()) {
+            LOG_W("BLE", "Connection lost during service discovery");
+            return false;
+        }
+    }
+    
+    if (pRemoteService == nullptr) {
+        LOG_E("BLE", "Service discovery timeout or service not found");
+        return false;
+    }
+    
+    // Get the characteristics with safety checks and timeout
+    BLERemoteCharacteristic* pWriteCharacteristic = nullptr;
+    BLERemoteCharacteristic* pReadCharacteristic = nullptr;
+    unsigned long charStartTime = millis();
+    while ((millis() - charStartTime) < 3000) { // 3 second timeout for characteristics
+        pWriteCharacteristic = pRemoteService->getCharacteristic(CHARACTERISTIC_WRITE_UUID);
+        pReadCharacteristic = pRemoteService->getCharacteristic(CHARACTERISTIC_READ_UUID);
+        
+        if (pWriteCharacteristic != nullptr && pReadCharacteristic != nullptr) {
+            break;
+        }
+        
+        delay(100);
+        yield();
+    }
+    
+    if (pWriteCharacteristic == nullptr || pReadCharacteristic == nullptr) {
+        LOG_E("BLE", "Required characteristics not found");
+        return false;
+    }
+    
+    if (!pReadCharacteristic->canNotify()) {
+        LOG_E("BLE", "Read characteristic does not support notifications");
+        return false;
+    }
+    
+    BLERemoteDescriptor* pCCCD = pReadCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
+    if (pCCCD == nullptr) {
+        LOG_E("BLE", "Notification descriptor not found");
+        return false;
+    }
+    
+    handles.writeHandle = pWriteCharacteristic->getHandle();
+    handles.readHandle = pReadCharacteristic->getHandle();
+    handles.cccdHandle = pCCCD->getHandle();
+    handles.valid = true;
+    return true;
+}
+
+bool BatterySession::enableNotifications() {
+    const unsigned long DESCRIPTOR_TIMEOUT_MS = 1000;
+    
+    BLEAddress peerAddress = client->getPeerAddress();
+    esp_gatt_if_t gattcIf = client->getGattcIf();
+    uint16_t connId = client->getConnId();
+    
+    LOG_D("BLE", "Setting up notifications...");
+    
+    if (esp_ble_gattc_register_for_notify(gattcIf, *peerAddress.getNative(), handles.readHandle) != ESP_OK) {
+        return false;
+    }
+    
+    // Enable notifications by writing to CCCD and wait for the write response
+    uint8_t notificationOn[] = {0x01, 0x00};
+    descriptorWriteDone = false;
+    descriptorWriteOk = false;
+    
+    if (esp_ble_gattc_write_char_descr(gattcIf, connId, handles.cccdHandle, sizeof(notificationOn), notificationOn,
+                                       ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE) != ESP_OK) {
+        return false;
+    }
+    
+    unsigned long startTime = millis();
+    while (!descriptorWriteDone && (millis() - startTime) < DESCRIPTOR_TIMEOUT_MS) {
+        xSemaphoreTake(wakeSemaphore, pdMS_TO_TICKS(50));
+        if (!client->isConnected()) {
+            return false;
+        }
+    }
+    
+    notificationsEnabled = descriptorWriteDone && descriptorWriteOk;
+    return notificationsEnabled;
+}
+
+void BatterySession::loadCachedHandles() {
+    Preferences gattCache;
+    if (!BLE_GATT_CACHE_NVS || !gattCache.begin("ble-gatt", true)) {
+        return;
+    }
+    
+    String key = cacheKey();
+    uint16_t stored[3];
+    if (gattCache.getBytesLength(key.c_str()) == sizeof(stored) &&
+        gattCache.getBytes(key.c_str(), stored, sizeof(stored)) == sizeof(stored)) {
+        handles.writeHandle = stored[0];
+        handles.readHandle = stored[1];
+        handles.cccdHandle = stored[2];
+        handles.valid = true;
+        LOG_I("BLE", "Loaded cached GATT handles for %s", macAddress.c_str());
+    }
+    
+    gattCache.end();
+}
+
+void BatterySession::storeHandles() {
+    Preferences gattCache;
+    if (!BLE_GATT_CACHE_NVS || !handles.valid || !gattCache.begin("ble-gatt", false)) {
+        return;
+    }
+    
+    String key = cacheKey();
+    uint16_t stored[3] = {handles.writeHandle, handles.readHandle, handles.cccdHandle};
+    uint16_t existing[3];
+    
+    // Only touch flash when the handles actually changed
+    if (gattCache.getBytesLength(key.c_str()) != sizeof(existing) ||
+        gattCache.getBytes(key.c_str(), existing, sizeof(existing)) != sizeof(existing) ||
+        memcmp(existing, stored, sizeof(stored)) != 0) {
+        gattCache.putBytes(key.c_str(), stored, sizeof(stored));
+    }
+    
+    gattCache.end();
+}
+
+void BatterySession::invalidateHandles() {
+    bool wasValid = handles.valid;
+    memset(&handles, 0, sizeof(handles));
+    handlesFromCache = false;
+    notificationsEnabled = false;
+    
+    Preferences gattCache;
+    if (BLE_GATT_CACHE_NVS && wasValid && gattCache.begin("ble-gatt", false)) {
+        gattCache.remove(cacheKey().c_str());
+        gattCache.end();
+    }
+}
+
+String BatterySession::cacheKey() const {
+    // NVS keys are limited to 15 characters, the bare MAC fits
+    String key = macAddress;
+    key.replace(":", "");
+    key.toLowerCase();
+    return key;
+}
+
+void BatterySession::disconnect() {
+    try {
+        if (client && client->isConnected()) {
+            client->disconnect();
+            delay(300);
+        }
+    } catch (...) {
+        // Ignore exceptions during disconnect
+    }
+    connected = false;
+    notificationsEnabled = false;
+    consecutiveFailures = 0;
+}
+
+bool BatterySession::isConnected() const {
+    return connected;
+}
+
+bool BatterySession::isReady() const {
+    return connected && notificationsEnabled && client != nullptr && client->isConnected();
+}
+
+bool BatterySession::startRequest(const uint8_t* cmds, uint8_t count, BatteryData& batteryData, unsigned long timeoutMs) {
+    // Safety checks
+    if (cmds == nullptr || count == 0 || count > MAX_PENDING_COMMANDS) {
+        LOG_E("BLE", "Invalid command parameters");
+        return false;
+    }
+    
+    if (!isReady()) {
+        LOG_W("BLE", "Not connected or characteristic not available");
+        return false;
+    }
+    
+    // Reset response state and drop stale fragments from earlier late frames
+    pendingCount = 0;
+    notificationRing.clear();
+    protocol.resetParser();
+    requestData = &batteryData;
+    
+    for (uint8_t i = 0; i < count; i++) {
+        pendingCommands[i].cmd = cmds[i];
+        pendingCommands[i].sentMicros = 0;
+        pendingCommands[i].deadlineMs = 0;
+        pendingCommands[i].done = false;
+        pendingCommands[i].result = FrameResult::NEED_MORE;
+    }
+    
+    // Entries of a longer earlier request must not answer commandSucceeded()
+    for (uint8_t i = count; i < MAX_PENDING_COMMANDS; i++) {
+        pendingCommands[i].cmd = 0;
+        pendingCommands[i].done = false;
+        pendingCommands[i].result = FrameResult::NEED_MORE;
+    }
+    pendingCount = count;
+    
+    try {
+        // Write all commands back to back, each gets its own deadline
+        for (uint8_t i = 0; i < count; i++) {
+            uint8_t command[10];
+            uint8_t commandLength;
+            protocol.createCommand(cmds[i], command, commandLength);
+            
+            pendingCommands[i].sentMicros = micros();
+            pendingCommands[i].deadlineMs = millis() + timeoutMs;
+            esp_err_t err = esp_ble_gattc_write_char(client->getGattcIf(), client->getConnId(), handles.writeHandle,
+                                                     commandLength, command, ESP_GATT_WRITE_TYPE_NO_RSP,
+                                                     ESP_GATT_AUTH_REQ_NONE);
+            if (err != ESP_OK) {
+                LOG_E("BLE", "Command write failed: %d", (int)err);
+                pendingCommands[i].done = true;
+            }
+            protocol.printHex(command, commandLength);
+        }
+        return true;
+        
+    } catch (const std::exception& e) {
+        endRequest();
+        LOG_E("BLE", "Send command error: %s", e.what());
+        return false;
+    } catch (...) {
+        endRequest();
+        LOG_E("BLE", "Send command failed with unknown error");
+        return false;
+    }
+}
+
+bool BatterySession::serviceRequest() {
+    if (pendingCount == 0) {
+        return true;
+    }
+    
+    drainNotifications();
+    
+    // A dropped link will not answer anymore, give up on everything still open
+    bool linkLost = client == nullptr || !client->isConnected();
+    if (linkLost) {
+        LOG_W("BLE", "Connection to %s lost during command wait", macAddress.c_str());
+    }
+    
+    unsigned long now = millis();
+    bool waiting = false;
+    for (uint8_t i = 0; i < pendingCount; i++) {
+        PendingCommand& pending = pendingCommands[i];
+        if (pending.done) {
+            continue;
+        }
+        if (linkLost) {
+            pending.done = true;
+        } else if ((long)(pending.deadlineMs - now) <= 0) {
+            LOG_W("BLE", "Command 0x%02x to %s timed out", pending.cmd, macAddress.c_str());
+            pending.done = true;
+        } else {
+            waiting = true;
+        }
+    }
+    
+    return !waiting;
+}
+
+long BatterySession::msUntilNextDeadline() const {
+    unsigned long now = millis();
+    long nearest = -1;
+    for (uint8_t i = 0; i < pendingCount; i++) {
+        if (pendingCommands[i].done) {
+            continue;
+        }
+        long remaining = (long)(pendingCommands[i].deadlineMs - now);
+        if (remaining < 0) {
+            remaining = 0;
+        }
+        if (nearest < 0 || remaining < nearest) {
+            nearest = remaining;
+        }
+    }
+    return nearest;
+}
+
+void BatterySession::endRequest() {
+    // Stop routing late frames into this request, results stay readable
+    pendingCount = 0;
+    requestData = nullptr;
+}
+
+bool BatterySession::commandSucceeded(uint8_t cmd) const {
+    for (uint8_t i = 0; i < MAX_PENDING_COMMANDS; i++) {
+        if (pendingCommands[i].cmd == cmd) {
+            return pendingCommands[i].done && pendingCommands[i].result == FrameResult::COMPLETE;
+        }
+    }
+    return false;
+}
+
+bool BatterySession::finishPoll(bool success) {
+    // Handles that were never confirmed by a response on this connection may be stale
+    if (!success && handlesFromCache) {
+        LOG_W("BLE", "No response on cached GATT handles, invalidating cache for %s", macAddress.c_str());
+        invalidateHandles();
+        disconnect();
+        return false;
+    }
+    if (success) {
+        handlesFromCache = false;
+    }
+    
+    if (!BLE_PERSISTENT_CONNECTIONS) {
+        // Always disconnect properly
+        disconnect();
+        return false;
+    }
+    
+    // A link that stays up but stops answering is dropped so the next poll redials it
+    consecutiveFailures = success ? 0 : consecutiveFailures + 1;
+    if (consecutiveFailures >= BLE_MAX_POLL_FAILURES) {
+        LOG_W("BLE", "Link to %s stopped answering, dropping it", macAddress.c_str());
+        disconnect();
+        return false;
+    }
+    return connected;
+}
+
+unsigned long BatterySession::getLastRoundTripMicros(uint8_t cmd) const {
+    if (cmd < CMD_READ_BASIC_INFO || cmd > CMD_READ_HARDWARE_VERSION) {
+        return 0;
+    }
+    return lastRoundTripMicros[cmd - CMD_READ_BASIC_INFO];
+}
+
+uint32_t BatterySession::getDroppedNotifications() const {
+    return notificationRing.getDroppedFragments();
+}
+
+int BatterySession::readRssi() {
+    if (client == nullptr || !client->isConnected()) {
+        return 0;
+    }
+    return client->getRssi();
+}
+
+void BatterySession::setOnConnect(std::function<void()> callback) {
+    onConnectCallback = callback;
+}
+
+void BatterySession::setOnDisconnect(std::function<void()> callback) {
+    onDisconnectCallback = callback;
+}
+
+// Static GATT client event hook, called from the BLE task for every client event.
+// Each session has its own client and therefore its own GATT interface.
+void BatterySession::gattcEventHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t* param) {
+    if (param == nullptr) {
+        return;
+    }
+    
+    for (uint8_t i = 0; i < registryCount; i++) {
+        BatterySession* session = registry[i];
+        if (session && session->client && session->client->getGattcIf() == gattcIf) {
+            session->handleGattcEvent(event, param);
+            return;
+        }
+    }
+}
+
+void BatterySession::handleGattcEvent(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t* param) {
+    if (event == ESP_GATTC_NOTIFY_EVT) {
+        if (client->getConnId() == param->notify.conn_id && handles.readHandle == param->notify.handle) {
+            handleNotification(param->notify.value, param->notify.value_len);
+        }
+    } else if (event == ESP_GATTC_WRITE_DESCR_EVT) {
+        if (handles.cccdHandle == param->write.handle) {
+            descriptorWriteOk = (param->write.status == ESP_GATT_OK);
+            descriptorWriteDone = true;
+            xSemaphoreGive(wakeSemaphore);
+        }
+    }
+}
+
+void BatterySession::handleNotification(const uint8_t* pData, size_t length) {
+    // Runs on the BLE task: queue the fragment and wake the waiter, nothing else
+    if (!pData || length == 0) {
+        return;
+    }
+    
+    notificationRing.push(pData, length, micros());
+    xSemaphoreGive(wakeSemaphore);
+}
+
+void BatterySession::drainNotifications() {
+    NotificationRing::RecordView record;
+    while (notificationRing.peek(record)) {
+        // A record wrapping around the ring end arrives as two segments, the parser does not care
+        feedFragment(record.first, record.firstLength, record.timestampMicros);
+        if (record.secondLength > 0) {
+            feedFragment(record.second, record.secondLength, record.timestampMicros);
+        }
+        notificationRing.consume();
+    }
+}
+
+void BatterySession::feedFragment(const uint8_t* data, size_t length, uint32_t timestampMicros) {
+    if (requestData == nullptr || pendingCount == 0) {
+        return;
+    }
+    
+    protocol.printHex(data, min(length, (size_t)20)); // Limit debug output
+    
+    // Feed the fragment straight into the parser, no reassembly buffer needed.
+    // One fragment may end one frame and start the next when commands are pipelined.
+    size_t offset = 0;
+    while (offset < length) {
+        size_t consumed = 0;
+        FrameResult result = protocol.feed(data + offset, length - offset, consumed, *requestData);
+        offset += consumed;
+        
+        if (result == FrameResult::NEED_MORE) {
+            continue;
+        }
+        
+        // Route the frame to its outstanding request by the echoed command byte
+        uint8_t cmd = protocol.getLastFrameCommand();
+        for (uint8_t i = 0; i < pendingCount; i++) {
+            PendingCommand& pending = pendingCommands[i];
+            if (pending.cmd != cmd || pending.done) {
+                continue;
+            }
+            
+            pending.result = result;
+            pending.done = true;
+            if (result == FrameResult::COMPLETE) {
+                // Arrival time of the final fragment, not the time it was drained
+                lastRoundTripMicros[cmd - CMD_READ_BASIC_INFO] = timestampMicros - pending.sentMicros;
+                metricBleCommandRoundTrip.observe(timestampMicros - pending.sentMicros);
+            }
+            break;
+        }
+    }
+}
+
+void BatterySession::handleConnect() {
+    connected = true;
+    if (onConnectCallback) {
+        onConnectCallback();
+    }
+}
+
+void BatterySession::handleDisconnect() {
+    connected = false;
+    
+    // Wake a request waiting on this link instead of letting it run into the timeout
+    if (wakeSemaphore) {
+        xSemaphoreGive(wakeSemaphore);
+    }
+    if (onDisconnectCallback) {
+        onDisconnectCallback();
+    }
+}
+
+// BLE client callback implementations
+void BatterySession::ClientCallback::onConnect(BLEClient* pclient) {
+    if (session) {
+        session->handleConnect();
+    }
+}
+
+void BatterySession::ClientCallback::onDisconnect(BLEClient* pclient) {
+    if (session) {
+        session->handleDisconnect();
+    }
+}
@@ -1,468 +1,330 @@
 #include "BluetoothManager.h"
-
-// Static instance pointer for callbacks
-BluetoothManager* BluetoothManager::instance = nullptr;
+#include <esp_task_wdt.h>
+#include "Logger.h"
+#include "Metrics.h"
 
 BluetoothManager::BluetoothManager() 
-    : pClient(nullptr)
-    , pWriteCharacteristic(nullptr)
-    , pReadCharacteristic(nullptr)
-    , bleConnected(false)
-    , currentBatteryMac("")
-    , responseLength(0)
-    , responseReceived(false)
-    , expectingMoreData(false)
-    , expectedTotalLength(0)
-    , clientCallback(nullptr)
+    : wakeSemaphore(nullptr)
 {
-    instance = this;
-    // Initialize response buffer
-    memset(responseBuffer, 0, sizeof(responseBuffer));
 }
 
 BluetoothManager::~BluetoothManager() {
     // Safely disconnect and cleanup
     try {
-        if (pClient && bleConnected) {
-            pClient->disconnect();
-            delay(100); // Give time for disconnect
-        }
+        disconnectAll();
         
-        if (clientCallback) {
-            delete clientCallback;
-            clientCallback = nullptr;
+        if (wakeSemaphore) {
+            vSemaphoreDelete(wakeSemaphore);
+            wakeSemaphore = nullptr;
         }
         
-        // Clear characteristics
-        pWriteCharacteristic = nullptr;
-        pReadCharacteristic = nullptr;
-        pClient = nullptr;
-        
     } catch (...) {
         // Ignore exceptions during cleanup
     }
-    
-    instance = nullptr;
 }
 
 void BluetoothManager::begin() {
     try {
         BLEDevice::init("ECO-WORTHY-Logger");
         
-        pClient = BLEDevice::createClient();
-        if (pClient == nullptr) {
-            Serial.println("Failed to create BLE client");
+        wakeSemaphore = xSemaphoreCreateBinary();
+        if (wakeSemaphore == nullptr) {
+            LOG_E("BLE", "Failed to create BLE response semaphore");
             return;
         }
         
-        clientCallback = new MyClientCallback(this);
-        pClient->setClientCallbacks(clientCallback);
-        
-        Serial.println("BluetoothManager initialized successfully");
-    } catch (const std::exception& e) {
-        Serial.print("BluetoothManager init failed: ");
-        Serial.println(e.what());
-    } catch (...) {
-        Serial.println("BluetoothManager init failed with unknown error");
-    }
-}
-
-bool BluetoothManager::connectToBattery(const String& macAddress) {
-    const unsigned long CONNECT_TIMEOUT_MS = 10000; // 10 seconds timeout
-    const unsigned long SERVICE_TIMEOUT_MS = 5000;  // 5 seconds for service discovery
-    
-    try {
-        // Safety check
-        if (pClient == nullptr) {
-            Serial.println("[BLE] BLE client not initialized");
-            return false;
-        }
-        
-        // Disconnect if already connected
-        if (bleConnected) {
-            Serial.println("[BLE] Disconnecting from previous connection");
-            pClient->disconnect();
-            delay(500);
-            bleConnected = false;
-        }
-        
-        // Clear previous characteristics
-        pWriteCharacteristic = nullptr;
-        pReadCharacteristic = nullptr;
-        
-        BLEAddress bleAddress(macAddress.c_str());
-        Serial.println("[BLE] Attempting to connect to: " + macAddress);
-        
-        // Connect with explicit timeout protection
-        unsigned long connectStartTime = millis();
-        bool connectSuccess = false;
-        
-        // Non-blocking connect attempt with timeout
-        while ((millis() - connectStartTime) < CONNECT_TIMEOUT_MS) {
-            if (pClient->connect(bleAddress)) {
-                connectSuccess = true;
-                break;
-            }
-            
-            // Check every 500ms and allow other tasks to run
-            delay(500);
-            yield();
-            
-            // Early exit if connection is established
-            if (pClient->isConnected()) {
-                connectSuccess = true;
-                break;
-            }
-        }
-        
-        if (!connectSuccess) {
-            Serial.println("[BLE] Connection timeout after " + String(millis() - connectStartTime) + "ms");
-            return false;
-        }
-        
-        Serial.println("[BLE] Connected successfully, discovering services...");
-        
-        // Get the service with timeout protection
-        unsigned long serviceStartTime = millis();
-        BLERemoteService* pRemoteService = nullptr;
+        // Notifications and descriptor writes are handled on raw GATT handles
+        // and routed to the session owning the GATT interface
+        BLEDevice::setCustomGattcHandler(BatterySession::gattcEventHandler);
         
-        while ((millis() - serviceStartTime) < SERVICE_TIMEOUT_MS) {
-            pRemoteService = pClient->getService(SERVICE_UUID);
-            if (pRemoteService != nullptr) {
-                break;
-            }
-            
-            delay(200);
-            yield();
-            
-            // Check if connection is still valid
-            if (!pClient->isConnected()) {
-                Serial.println("[BLE] Connection lost during service discovery");
-                return false;
-            }
+        if (BLE_PRESENCE_SCAN_ENABLED) {
+            presenceScanner.begin();
         }
         
-        if (pRemoteService == nullptr) {
-            Serial.println("[BLE] Service discovery timeout or service not found");
-            pClient->disconnect();
-            return false;
-        }
-        
-        // Get the characteristics with safety checks and timeout
-        unsigned long charStartTime = millis();
-        while ((millis() - charStartTime) < 3000) { // 3 second timeout for characteristics
-            pWriteCharacteristic = pRemoteService->getCharacteristic(CHARACTERISTIC_WRITE_UUID);
-            pReadCharacteristic = pRemoteService->getCharacteristic(CHARACTERISTIC_READ_UUID);
-            
-            if (pWriteCharacteristic != nullptr && pReadCharacteristic != nullptr) {
-                break;
+        for (int i = 0; i < BATTERY_COUNT; i++) {
+            if (!sessions[i].begin(BATTERY_MAC_ADDRESSES[i], wakeSemaphore)) {
+                LOG_E("BLE", "Failed to set up BLE session for battery %d", i + 1);
+                return;
             }
-            
-            delay(100);
-            yield();
         }
         
-        if (pWriteCharacteristic == nullptr || pReadCharacteristic == nullptr) {
-            Serial.println("[BLE] Required characteristics not found");
-            pClient->disconnect();
-            return false;
-        }
-        
-        // Register for notifications with safety checks and timeout
-        if (pReadCharacteristic->canNotify()) {
-            Serial.println("[BLE] Setting up notifications...");
-            
-            try {
-                pReadCharacteristic->registerForNotify(notifyCallback);
-                
-                // Enable notifications by writing to CCCD with timeout protection
-                uint8_t notificationOn[] = {0x01, 0x00};
-                BLERemoteDescriptor* pCCCD = pReadCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
-                if (pCCCD != nullptr) {
-                    pCCCD->writeValue(notificationOn, 2, true);
-                }
-                
-                // Give time for notification setup with watchdog feeding
-                unsigned long notifyStartTime = millis();
-                while (millis() - notifyStartTime < 500) {
-                    delay(50);
-                    yield();
-                }
-                
-            } catch (...) {
-                Serial.println("[BLE] Failed to setup notifications, continuing anyway");
-            }
-        }
-        
-        currentBatteryMac = macAddress;
-        Serial.println("[BLE] Successfully connected and configured");
-        return true;
-        
+        LOG_I("BLE", "BluetoothManager initialized successfully");
     } catch (const std::exception& e) {
-        Serial.print("[BLE] Connect error: ");
-        Serial.println(e.what());
-        if (pClient && pClient->isConnected()) {
-            pClient->disconnect();
-        }
-        return false;
+        LOG_E("BLE", "BluetoothManager init failed: %s", e.what());
     } catch (...) {
-        Serial.println("[BLE] Connect failed with unknown error");
-        if (pClient && pClient->isConnected()) {
-            pClient->disconnect();
-        }
-        return false;
+        LOG_E("BLE", "BluetoothManager init failed with unknown error");
     }
 }
 
-void BluetoothManager::disconnect() {
-    try {
-        if (bleConnected && pClient && pClient->isConnected()) {
-            pClient->disconnect();
-            delay(300);
-        }
-        bleConnected = false;
-        pWriteCharacteristic = nullptr;
-        pReadCharacteristic = nullptr;
-    } catch (...) {
-        // Ignore exceptions during disconnect
-        bleConnected = false;
+void BluetoothManager::loop() {
+    if (BLE_PRESENCE_SCAN_ENABLED) {
+        presenceScanner.loop();
     }
 }
 
-bool BluetoothManager::isConnected() const {
-    return bleConnected;
+bool BluetoothManager::connectToBattery(const String& macAddress) {
+    BatterySession* session = findSession(macAddress);
+    if (session == nullptr) {
+        LOG_W("BLE", "No link configured for %s", macAddress.c_str());
+        return false;
+    }
+    return ensureLink(*session);
 }
 
-bool BluetoothManager::readBatteryData(const String& macAddress, BatteryData& batteryData) {
-    if (!connectToBattery(macAddress)) {
-        return false;
+bool BluetoothManager::ensureLink(BatterySession& session) {
+    // Reuse an open link, it only gets re-established after a real drop
+    if (BLE_PERSISTENT_CONNECTIONS && session.isReady()) {
+        return true;
     }
     
-    batteryData.macAddress = macAddress;
-    batteryData.dataValid = false;
-    
-    bool foundWorkingCommand = false;
+    // Connection setup and scanning do not share the radio well
+    presenceScanner.pause();
+    metricBleConnectAttempts.increment();
+    bool established = session.connect();
+    presenceScanner.resume();
     
-    try {
-        // Try to get basic battery info first
-        if (tryCommand(macAddress, CMD_READ_BASIC_INFO, "basic_info", batteryData)) {
-            foundWorkingCommand = true;
-            
-            // If basic info successful, also try to get cell voltages
-            tryCommand(macAddress, CMD_READ_CELL_VOLTAGES, "cell_voltages", batteryData);
+    if (!established) {
+        metricBleConnectFailures.increment();
+    }
+    return established;
+}
+
+void BluetoothManager::disconnect(const String& macAddress) {
+    BatterySession* session = findSession(macAddress);
+    if (session != nullptr) {
+        session->disconnect();
+    }
+}
+
+void BluetoothManager::disconnectAll() {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (sessions[i].isConnected()) {
+            sessions[i].disconnect();
         }
-    } catch (...) {
-        Serial.println("Error during battery data reading");
-        foundWorkingCommand = false;
     }
-    
-    // Always disconnect properly
-    disconnect();
-    
-    return foundWorkingCommand && batteryData.dataValid;
 }
 
-void BluetoothManager::setOnConnect(std::function<void()> callback) {
-    onConnectCallback = callback;
+bool BluetoothManager::isConnected() const {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (sessions[i].isConnected()) {
+            return true;
+        }
+    }
+    return false;
 }
 
-void BluetoothManager::setOnDisconnect(std::function<void()> callback) {
-    onDisconnectCallback = callback;
+bool BluetoothManager::isBatteryConnected(const String& macAddress) const {
+    const BatterySession* session = findSession(macAddress);
+    return session != nullptr && session->isConnected();
 }
 
-bool BluetoothManager::sendCommandAndWaitResponse(uint8_t* command, uint8_t commandLength, unsigned long timeoutMs) {
-    // Safety checks
-    if (command == nullptr || commandLength == 0 || commandLength > 20) {
-        Serial.println("[BLE] Invalid command parameters");
-        return false;
+bool BluetoothManager::isBatteryPresent(const String& macAddress) const {
+    if (!BLE_PRESENCE_SCAN_ENABLED || isBatteryConnected(macAddress)) {
+        return true;
     }
     
-    if (pWriteCharacteristic == nullptr || !bleConnected) {
-        Serial.println("[BLE] Not connected or characteristic not available");
-        return false;
+    // Until the first scan window finished nothing is known, so dial everyone
+    return !presenceScanner.hasCompletedWindow() || presenceScanner.isPresent(macAddress);
+}
+
+int BluetoothManager::getBatteryRssi(const String& macAddress) const {
+    return presenceScanner.getRssi(macAddress);
+}
+
+bool BluetoothManager::readBatteryData(const String& macAddress, BatteryData& batteryData) {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (BATTERY_MAC_ADDRESSES[i] == macAddress) {
+            bool success = false;
+            readBatteries(&i, 1, &batteryData, &success);
+            return success;
+        }
     }
     
-    // Reset response state
-    responseReceived = false;
-    responseLength = 0;
-    expectingMoreData = false;
-    expectedTotalLength = 0;
-    memset(responseBuffer, 0, sizeof(responseBuffer));
+    LOG_W("BLE", "No link configured for %s", macAddress.c_str());
+    return false;
+}
+
+int BluetoothManager::readBatteries(const int* batteryIndices, int count, BatteryData* results, bool* success) {
+    BatterySession* active[BATTERY_COUNT];
+    BatteryData* activeData[BATTERY_COUNT];
+    int activeIndex[BATTERY_COUNT];
+    bool basicOk[BATTERY_COUNT];
+    int activeCount = 0;
+    int polled = 0;
     
-    try {
-        // Send command with safety check
-        pWriteCharacteristic->writeValue(command, commandLength, false);
-        protocol.printHex(command, commandLength);
+    if (batteryIndices == nullptr || results == nullptr || success == nullptr || count <= 0) {
+        return 0;
+    }
+    
+    // Links are set up one at a time, connection setup is not worth overlapping
+    for (int k = 0; k < count && k < BATTERY_COUNT; k++) {
+        int index = batteryIndices[k];
+        success[k] = false;
+        if (index < 0 || index >= BATTERY_COUNT) {
+            continue;
+        }
         
-        // Wait for response with robust timeout handling
-        unsigned long startTime = millis();
-        unsigned long lastWatchdogFeed = millis();
-        int retryCount = 0;
-        const int maxRetries = 3;
+        results[k].clear();
+        results[k].setMacAddress(BATTERY_MAC_ADDRESSES[index]);
+        metricBlePolls.increment();
+        polled++;
         
-        while (!responseReceived && (millis() - startTime) < timeoutMs) {
-            // Feed watchdog every 500ms to prevent system reset
-            if (millis() - lastWatchdogFeed >= 500) {
-                yield(); // Allow other tasks to run
-                lastWatchdogFeed = millis();
-            }
-            
-            // Check if BLE connection is still valid
-            if (!pClient || !pClient->isConnected()) {
-                Serial.println("[BLE] Connection lost during command wait");
-                return false;
-            }
-            
-            // Progressive delay with timeout protection
-            delay(25); // Shorter delay for better responsiveness
-            
-            // Retry mechanism for stuck notifications
-            if ((millis() - startTime) > (timeoutMs / 2) && retryCount < maxRetries) {
-                Serial.println("[BLE] Timeout halfway reached, checking notification state");
-                retryCount++;
-                
-                // Force a small delay to allow late notifications
-                delay(100);
-                
-                if (responseReceived) {
-                    break;
-                }
-            }
-        }
+        bool linked = ensureLink(sessions[index]);
         
-        if (!responseReceived) {
-            Serial.println("[BLE] Command timeout after " + String(millis() - startTime) + "ms");
+        // A setup can take close to 20 s, several in a row would outlast the watchdog
+        if (WATCHDOG_ENABLED) {
+            esp_task_wdt_reset();
+        }
+        if (!linked) {
+            continue;
         }
         
-        return responseReceived;
-        
-    } catch (const std::exception& e) {
-        Serial.print("[BLE] Send command error: ");
-        Serial.println(e.what());
-        return false;
-    } catch (...) {
-        Serial.println("[BLE] Send command failed with unknown error");
-        return false;
+        active[activeCount] = &sessions[index];
+        activeData[activeCount] = &results[k];
+        activeIndex[activeCount] = k;
+        activeCount++;
     }
-}
-
-bool BluetoothManager::tryCommand(const String& macAddress, uint8_t cmd, const String& cmdName, BatteryData& batteryData) {
-    uint8_t command[10];
-    uint8_t commandLength;
     
-    // Create command
-    if (cmd == CMD_READ_BASIC_INFO) {
-        protocol.createBasicInfoCommand(command, commandLength);
-    } else if (cmd == CMD_READ_CELL_VOLTAGES) {
-        protocol.createCellVoltageCommand(command, commandLength);
-    } else if (cmd == CMD_READ_HARDWARE_VERSION) {
-        protocol.createHardwareVersionCommand(command, commandLength);
-    } else {
-        return false;
+    if (activeCount == 0) {
+        metricBlePollFailures.increment(polled);
+        return 0;
     }
     
-    if (!sendCommandAndWaitResponse(command, commandLength, 5000)) {
-        return false;
+    for (int a = 0; a < activeCount; a++) {
+        basicOk[a] = false;
     }
     
-    // Check if this is an error response
-    if (responseLength < 3 || responseBuffer[2] != 0x00) {
-        return false;
+    try {
+        const uint8_t commands[] = {CMD_READ_BASIC_INFO, CMD_READ_CELL_VOLTAGES};
+        
+        if (BLE_PIPELINE_COMMANDS) {
+            // Both requests go out back to back on every link, responses are routed by command byte
+            runRequests(active, activeData, activeCount, commands, 2);
+            for (int a = 0; a < activeCount; a++) {
+                basicOk[a] = active[a]->commandSucceeded(CMD_READ_BASIC_INFO);
+            }
+        } else {
+            runRequests(active, activeData, activeCount, &commands[0], 1);
+            
+            // The cell request replaces the pending state, so basic info is recorded first.
+            // Cell voltages only from batteries whose basic info came in.
+            BatterySession* answered[BATTERY_COUNT];
+            BatteryData* answeredData[BATTERY_COUNT];
+            int answeredCount = 0;
+            for (int a = 0; a < activeCount; a++) {
+                basicOk[a] = active[a]->commandSucceeded(CMD_READ_BASIC_INFO);
+                if (basicOk[a]) {
+                    answered[answeredCount] = active[a];
+                    answeredData[answeredCount] = activeData[a];
+                    answeredCount++;
+                }
+            }
+            runRequests(answered, answeredData, answeredCount, &commands[1], 1);
+        }
+    } catch (...) {
+        LOG_E("BLE", "Error during battery data reading");
     }
     
-    // Try to parse the response
-    bool parseSuccess = false;
-    if (cmd == CMD_READ_BASIC_INFO) {
-        parseSuccess = protocol.parseBasicInfoResponse(responseBuffer, responseLength, batteryData);
-    } else if (cmd == CMD_READ_CELL_VOLTAGES) {
-        parseSuccess = protocol.parseCellVoltageResponse(responseBuffer, responseLength, batteryData);
+    int successCount = 0;
+    for (int a = 0; a < activeCount; a++) {
+        BatterySession& session = *active[a];
+        bool ok = basicOk[a] && activeData[a]->dataValid;
+        
+        if (ok) {
+            presenceScanner.updateRssi(session.getMacAddress(), session.readRssi());
+            LOG_D("BLE", "%s round trip basic_info %.1fms, cell_voltages %.1fms", session.getMacAddress().c_str(),
+                  session.getLastRoundTripMicros(CMD_READ_BASIC_INFO) / 1000.0,
+                  session.getLastRoundTripMicros(CMD_READ_CELL_VOLTAGES) / 1000.0);
+            successCount++;
+        }
+        
+        session.finishPoll(ok);
+        success[activeIndex[a]] = ok;
     }
     
-    return parseSuccess;
-}
-
-// Static callback function for BLE notifications
-void BluetoothManager::notifyCallback(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
-    if (instance) {
-        instance->handleNotification(pData, length);
-    }
+    // Includes the batteries that did not get a link
+    metricBlePollFailures.increment(polled - successCount);
+    
+    return successCount;
 }
 
-void BluetoothManager::handleNotification(uint8_t* pData, size_t length) {
-    // Safety check for null pointer and length
-    if (!pData || length == 0 || length > 256) {
-        return;
+void BluetoothManager::runRequests(BatterySession** active, BatteryData** data, int count, const uint8_t* cmds, uint8_t cmdCount) {
+    bool running[BATTERY_COUNT];
+    
+    // Drop stale signals from earlier late frames before the writes go out
+    xSemaphoreTake(wakeSemaphore, 0);
+    
+    for (int a = 0; a < count; a++) {
+        running[a] = active[a]->startRequest(cmds, cmdCount, *data[a], BLE_COMMAND_TIMEOUT_MS);
     }
     
-    // Prevent buffer overflow
-    if (length > 0 && (responseLength + length) <= sizeof(responseBuffer)) {
-        // Check if this is the first packet (starts with 0xDD)
-        if (length >= 4 && pData[0] == 0xDD && responseLength == 0) {
-            // First packet - get expected total length from bytes 2-3
-            expectedTotalLength = (pData[2] << 8) | pData[3];
-            expectedTotalLength += 7; // Add frame overhead (start + cmd + length + checksum + end)
-            
-            // Safety check for expected length
-            if (expectedTotalLength > sizeof(responseBuffer)) {
-                expectedTotalLength = sizeof(responseBuffer);
+    // One wait serves all links: any notification or drop wakes the loop,
+    // otherwise it sleeps until the nearest command deadline
+    while (true) {
+        long nextDeadline = -1;
+        
+        for (int a = 0; a < count; a++) {
+            if (!running[a]) {
+                continue;
+            }
+            if (active[a]->serviceRequest()) {
+                active[a]->endRequest();
+                running[a] = false;
+                continue;
+            }
+            long remaining = active[a]->msUntilNextDeadline();
+            if (remaining >= 0 && (nextDeadline < 0 || remaining < nextDeadline)) {
+                nextDeadline = remaining;
             }
-            
-            expectingMoreData = (expectedTotalLength > length);
-            
-            memcpy(responseBuffer, pData, length);
-            responseLength = length;
-            
-        } else if (expectingMoreData && responseLength > 0) {
-            // Continuation packet - append to existing data
-            size_t copyLength = min((size_t)(sizeof(responseBuffer) - responseLength), length);
-            memcpy(responseBuffer + responseLength, pData, copyLength);
-            responseLength += copyLength;
-            
-        } else {
-            // Single packet or unexpected packet
-            size_t copyLength = min(sizeof(responseBuffer), length);
-            memcpy(responseBuffer, pData, copyLength);
-            responseLength = copyLength;
-            expectingMoreData = false;
         }
         
-        // Check if we have received the complete response
-        if (!expectingMoreData || responseLength >= expectedTotalLength || 
-            (responseLength > 0 && responseBuffer[responseLength-1] == 0x77)) {
-            responseReceived = true;
-            expectingMoreData = false;
+        if (nextDeadline < 0) {
+            break;
         }
         
-        // Only print hex if protocol is valid
-        if (responseLength > 0) {
-            protocol.printHex(pData, min(length, (size_t)20)); // Limit debug output
-        }
+        xSemaphoreTake(wakeSemaphore, pdMS_TO_TICKS(nextDeadline > 0 ? nextDeadline : 1));
     }
 }
 
-void BluetoothManager::handleConnect() {
-    bleConnected = true;
-    if (onConnectCallback) {
-        onConnectCallback();
+unsigned long BluetoothManager::getLastRoundTripMicros(const String& macAddress, uint8_t cmd) const {
+    const BatterySession* session = findSession(macAddress);
+    return session != nullptr ? session->getLastRoundTripMicros(cmd) : 0;
+}
+
+uint32_t BluetoothManager::getDroppedNotifications() const {
+    uint32_t dropped = 0;
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        dropped += sessions[i].getDroppedNotifications();
     }
+    return dropped;
 }
 
-void BluetoothManager::handleDisconnect() {
-    bleConnected = false;
-    if (onDisconnectCallback) {
-        onDisconnectCallback();
+void BluetoothManager::setOnConnect(std::function<void()> callback) {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        sessions[i].setOnConnect(callback);
     }
 }
 
-// BLE client callback implementations
-void BluetoothManager::MyClientCallback::onConnect(BLEClient* pclient) {
-    if (manager) {
-        manager->handleConnect();
+void BluetoothManager::setOnDisconnect(std::function<void()> callback) {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        sessions[i].setOnDisconnect(callback);
     }
 }
 
-void BluetoothManager::MyClientCallback::onDisconnect(BLEClient* pclient) {
-    if (manager) {
-        manager->handleDisconnect();
+BatterySession* BluetoothManager::findSession(const String& macAddress) {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (sessions[i].getMacAddress() == macAddress) {
+            return &sessions[i];
+        }
+    }
+    return nullptr;
+}
+
+const BatterySession* BluetoothManager::findSession(const String& macAddress) const {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (sessions[i].getMacAddress() == macAddress) {
+            return &sessions[i];
+        }
     }
+    return nullptr;
 }
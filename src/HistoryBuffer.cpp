@@ -0,0 +1,107 @@
+#include "HistoryBuffer.h"
+
+HistoryBuffer::HistoryBuffer()
+    : lock(xSemaphoreCreateMutexStatic(&lockBuffer))
+{
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        head[i] = 0;
+        count[i] = 0;
+    }
+}
+
+void HistoryBuffer::add(int batteryIndex, const BatteryData& data, uint32_t time) {
+    if (batteryIndex < 0 || batteryIndex >= BATTERY_COUNT) {
+        return;
+    }
+    
+    HistorySample sample;
+    sample.time = time;
+    sample.voltage10mV = data.voltage10mV;
+    sample.current10mA = data.current10mA;
+    sample.soc01 = (uint16_t)(data.getSoc() * 10.0f + 0.5f);
+    sample.temperature01K = data.temperature01K;
+    
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (count[batteryIndex] == HISTORY_SAMPLES) {
+        // Full, the newest sample replaces the oldest
+        samples[batteryIndex][head[batteryIndex]] = sample;
+        head[batteryIndex] = (head[batteryIndex] + 1) % HISTORY_SAMPLES;
+    } else {
+        samples[batteryIndex][(head[batteryIndex] + count[batteryIndex]) % HISTORY_SAMPLES] = sample;
+        count[batteryIndex]++;
+    }
+    xSemaphoreGive(lock);
+}
+
+bool HistoryBuffer::summarize(int batteryIndex, uint32_t from, uint32_t to, HistoryBucket& bucket) const {
+    memset(&bucket, 0, sizeof(bucket));
+    if (batteryIndex < 0 || batteryIndex >= BATTERY_COUNT || from >= to) {
+        return false;
+    }
+    
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (uint16_t position = lowerBound(batteryIndex, from); position < count[batteryIndex]; position++) {
+        const HistorySample& sample = at(batteryIndex, position);
+        if (sample.time >= to) {
+            break;
+        }
+        
+        if (bucket.count == 0 || sample.voltage10mV < bucket.minVoltage10mV) {
+            bucket.minVoltage10mV = sample.voltage10mV;
+        }
+        if (bucket.count == 0 || sample.voltage10mV > bucket.maxVoltage10mV) {
+            bucket.maxVoltage10mV = sample.voltage10mV;
+        }
+        if (bucket.count == 0 || sample.current10mA < bucket.minCurrent10mA) {
+            bucket.minCurrent10mA = sample.current10mA;
+        }
+        if (bucket.count == 0 || sample.current10mA > bucket.maxCurrent10mA) {
+            bucket.maxCurrent10mA = sample.current10mA;
+        }
+        bucket.sumVoltage10mV += sample.voltage10mV;
+        bucket.sumCurrent10mA += sample.current10mA;
+        bucket.sumSoc01 += sample.soc01;
+        if (sample.temperature01K > 0) {
+            bucket.sumTemperature01K += sample.temperature01K;
+            bucket.temperatureCount++;
+        }
+        bucket.count++;
+    }
+    xSemaphoreGive(lock);
+    
+    return bucket.count > 0;
+}
+
+uint32_t HistoryBuffer::getOldestTime(int batteryIndex) const {
+    if (batteryIndex < 0 || batteryIndex >= BATTERY_COUNT) {
+        return 0;
+    }
+    
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t time = count[batteryIndex] > 0 ? at(batteryIndex, 0).time : 0;
+    xSemaphoreGive(lock);
+    return time;
+}
+
+uint16_t HistoryBuffer::size(int batteryIndex) const {
+    return batteryIndex >= 0 && batteryIndex < BATTERY_COUNT ? count[batteryIndex] : 0;
+}
+
+const HistorySample& HistoryBuffer::at(int batteryIndex, uint16_t position) const {
+    return samples[batteryIndex][(head[batteryIndex] + position) % HISTORY_SAMPLES];
+}
+
+uint16_t HistoryBuffer::lowerBound(int batteryIndex, uint32_t time) const {
+    // First position with a sample at or after time, count if there is none
+    uint16_t low = 0;
+    uint16_t high = count[batteryIndex];
+    while (low < high) {
+        uint16_t middle = low + (high - low) / 2;
+        if (at(batteryIndex, middle).time < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
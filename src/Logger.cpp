@@ -0,0 +1,131 @@
+#include "Logger.h"
+#include <stdarg.h>
+
+Logger logger;
+
+Logger::Logger()
+    : head(0)
+    , drainPosition(0)
+    , droppedBytes(0)
+    , lock(portMUX_INITIALIZER_UNLOCKED)
+    , drainTask(nullptr)
+{
+}
+
+void Logger::begin() {
+    if (drainTask != nullptr) {
+        return;
+    }
+    
+    if (xTaskCreatePinnedToCore(drainTaskEntry, "log-drain", 2048, this, 1, &drainTask, 1) != pdPASS) {
+        drainTask = nullptr;
+        Serial.println("[Log] Failed to start drain task");
+    }
+}
+
+void Logger::write(uint8_t level, const char* tag, const char* format, ...) {
+    static const char LEVEL_CHARS[] = "-EWID";
+    char line[LINE_MAX];
+    
+    unsigned long now = millis();
+    int prefix = snprintf(line, sizeof(line), "%lu.%03lu %c [%s] ", now / 1000, now % 1000,
+                          LEVEL_CHARS[level <= LOG_LEVEL_DEBUG ? level : 0], tag);
+    if (prefix < 0) {
+        return;
+    }
+    
+    size_t length = min((size_t)prefix, sizeof(line) - 2);
+    va_list args;
+    va_start(args, format);
+    int body = vsnprintf(line + length, sizeof(line) - 1 - length, format, args);
+    va_end(args);
+    if (body > 0) {
+        length = min(length + body, sizeof(line) - 2);
+    }
+    line[length++] = '\n';
+    
+    append(line, length);
+}
+
+void Logger::append(const char* text, size_t length) {
+    portENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < length; i++) {
+        buffer[(head + i) % LOG_BUFFER_SIZE] = text[i];
+    }
+    head += length;
+    
+    // The drain fell a full ring behind, skip what was overwritten
+    if (head - drainPosition > LOG_BUFFER_SIZE) {
+        droppedBytes += head - drainPosition - LOG_BUFFER_SIZE;
+        drainPosition = head - LOG_BUFFER_SIZE;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+size_t Logger::read(uint32_t& position, char* out, size_t maxLength) const {
+    portENTER_CRITICAL(&lock);
+    uint32_t oldest = head > LOG_BUFFER_SIZE ? head - LOG_BUFFER_SIZE : 0;
+    if ((int32_t)(position - oldest) < 0) {
+        position = oldest;
+    }
+    size_t copied = copyOut(position, out, maxLength);
+    portEXIT_CRITICAL(&lock);
+    
+    position += copied;
+    return copied;
+}
+
+uint32_t Logger::getOldestPosition() const {
+    portENTER_CRITICAL(&lock);
+    uint32_t oldest = head > LOG_BUFFER_SIZE ? head - LOG_BUFFER_SIZE : 0;
+    portEXIT_CRITICAL(&lock);
+    return oldest;
+}
+
+uint32_t Logger::getDroppedBytes() const {
+    return droppedBytes;
+}
+
+size_t Logger::copyOut(uint32_t position, char* out, size_t maxLength) const {
+    // Caller holds the lock
+    size_t available = head - position;
+    size_t count = min(available, maxLength);
+    for (size_t i = 0; i < count; i++) {
+        out[i] = buffer[(position + i) % LOG_BUFFER_SIZE];
+    }
+    return count;
+}
+
+void Logger::flush() {
+    drainPending();
+    Serial.flush();
+}
+
+void Logger::drainTaskEntry(void* param) {
+    static_cast<Logger*>(param)->drain();
+}
+
+void Logger::drain() {
+    while (true) {
+        drainPending();
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+    }
+}
+
+void Logger::drainPending() {
+    char chunk[128];
+    
+    while (true) {
+        portENTER_CRITICAL(&lock);
+        size_t count = copyOut(drainPosition, chunk, sizeof(chunk));
+        drainPosition += count;
+        portEXIT_CRITICAL(&lock);
+        
+        if (count == 0) {
+            break;
+        }
+        
+        // Only the drain task waits on the UART during normal operation
+        Serial.write((const uint8_t*)chunk, count);
+    }
+}
@@ -0,0 +1,172 @@
+#include "LoopScheduler.h"
+#include "Logger.h"
+
+LoopScheduler::LoopScheduler()
+    : jobCount(0)
+    , heapSize(0)
+{
+    memset(jobs, 0, sizeof(jobs));
+    memset(heap, 0, sizeof(heap));
+}
+
+int LoopScheduler::addJob(const char* name, JobFunction function, uint32_t periodMs, uint32_t budgetMs, uint32_t firstDelayMs) {
+    if (jobCount >= MAX_JOBS || function == nullptr || periodMs == 0) {
+        LOG_E("Scheduler", "Cannot add job %s", name);
+        return -1;
+    }
+    
+    uint8_t jobId = jobCount++;
+    Job& job = jobs[jobId];
+    job.function = function;
+    job.nextRun = millis() + firstDelayMs;
+    job.stats.name = name;
+    job.stats.periodMs = periodMs;
+    job.stats.budgetMs = budgetMs;
+    
+    push(jobId);
+    return jobId;
+}
+
+int LoopScheduler::runDue() {
+    unsigned long passStart = millis();
+    int ran = 0;
+    
+    while (heapSize > 0) {
+        unsigned long now = millis();
+        Job& next = jobs[heap[0]];
+        if ((long)(next.nextRun - now) > 0) {
+            break;
+        }
+        
+        // Jobs left over are now overdue and sort first on the next pass
+        if (ran > 0 && (now - passStart) >= LOOP_PASS_BUDGET_MS) {
+            break;
+        }
+        
+        uint8_t jobId = pop();
+        Job& job = jobs[jobId];
+        
+        uint32_t lateness = now - job.nextRun;
+        if (lateness > job.stats.maxLatenessMs) {
+            job.stats.maxLatenessMs = lateness;
+        }
+        
+        unsigned long startMicros = micros();
+        job.function();
+        uint32_t durationUs = micros() - startMicros;
+        
+        job.stats.runs++;
+        job.stats.lastDurationUs = durationUs;
+        if (durationUs > job.stats.maxDurationUs) {
+            job.stats.maxDurationUs = durationUs;
+        }
+        
+        // Keep the grid of the period, but never schedule into the past
+        now = millis();
+        job.nextRun += job.stats.periodMs;
+        if ((long)(job.nextRun - now) < 0) {
+            job.nextRun = now + job.stats.periodMs;
+        }
+        
+        // Charge the excess of an overrun to the job itself
+        uint32_t budgetUs = job.stats.budgetMs * 1000;
+        if (durationUs > budgetUs) {
+            job.stats.overruns++;
+            job.nextRun += (durationUs - budgetUs) / 1000;
+            if (job.stats.overruns == 1 || job.stats.overruns % 100 == 0) {
+                LOG_W("Scheduler", "Job %s overran its budget: %lums > %lums (%lu overruns)", job.stats.name,
+                      (unsigned long)(durationUs / 1000), (unsigned long)job.stats.budgetMs,
+                      (unsigned long)job.stats.overruns);
+            }
+        }
+        
+        push(jobId);
+        ran++;
+    }
+    
+    return ran;
+}
+
+uint32_t LoopScheduler::getMsUntilNextJob() const {
+    if (heapSize == 0) {
+        return LOOP_MAX_SLEEP_MS;
+    }
+    
+    long remaining = (long)(jobs[heap[0]].nextRun - millis());
+    if (remaining <= 0) {
+        return 0;
+    }
+    return min((uint32_t)remaining, (uint32_t)LOOP_MAX_SLEEP_MS);
+}
+
+uint8_t LoopScheduler::getJobCount() const {
+    return jobCount;
+}
+
+const LoopScheduler::JobStats& LoopScheduler::getJobStats(uint8_t jobId) const {
+    return jobs[jobId < jobCount ? jobId : 0].stats;
+}
+
+uint32_t LoopScheduler::getTotalOverruns() const {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < jobCount; i++) {
+        total += jobs[i].stats.overruns;
+    }
+    return total;
+}
+
+bool LoopScheduler::runsBefore(uint8_t a, uint8_t b) const {
+    return (long)(jobs[a].nextRun - jobs[b].nextRun) < 0;
+}
+
+void LoopScheduler::siftUp(uint8_t position) {
+    while (position > 0) {
+        uint8_t parent = (position - 1) / 2;
+        if (!runsBefore(heap[position], heap[parent])) {
+            break;
+        }
+        uint8_t swap = heap[parent];
+        heap[parent] = heap[position];
+        heap[position] = swap;
+        position = parent;
+    }
+}
+
+void LoopScheduler::siftDown(uint8_t position) {
+    while (true) {
+        uint8_t left = position * 2 + 1;
+        uint8_t right = left + 1;
+        uint8_t smallest = position;
+        
+        if (left < heapSize && runsBefore(heap[left], heap[smallest])) {
+            smallest = left;
+        }
+        if (right < heapSize && runsBefore(heap[right], heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == position) {
+            break;
+        }
+        
+        uint8_t swap = heap[smallest];
+        heap[smallest] = heap[position];
+        heap[position] = swap;
+        position = smallest;
+    }
+}
+
+void LoopScheduler::push(uint8_t jobId) {
+    heap[heapSize] = jobId;
+    siftUp(heapSize);
+    heapSize++;
+}
+
+uint8_t LoopScheduler::pop() {
+    uint8_t top = heap[0];
+    heapSize--;
+    if (heapSize > 0) {
+        heap[0] = heap[heapSize];
+        siftDown(0);
+    }
+    return top;
+}
@@ -0,0 +1,154 @@
+#include "Metrics.h"
+#include <stdarg.h>
+
+Metric* Metric::head = nullptr;
+Metric* Metric::tail = nullptr;
+
+// snprintf that keeps counting past the end, so callers can detect a cut-off render
+static void appendText(char* buffer, size_t capacity, size_t& length, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(length < capacity ? buffer + length : nullptr,
+                            length < capacity ? capacity - length : 0, format, args);
+    va_end(args);
+    if (written > 0) {
+        length += written;
+    }
+}
+
+Metric::Metric(const char* name, const char* help, const char* labels)
+    : name(name)
+    , help(help)
+    , labels(labels)
+    , next(nullptr)
+{
+    // Metrics are statics, constructed one after another before setup()
+    if (tail) {
+        tail->next = this;
+    } else {
+        head = this;
+    }
+    tail = this;
+}
+
+MetricCounter::MetricCounter(const char* name, const char* help, const char* labels)
+    : Metric(name, help, labels)
+    , value(0)
+{
+}
+
+size_t MetricCounter::render(char* buffer, size_t capacity, bool header) const {
+    size_t length = 0;
+    if (header) {
+        appendText(buffer, capacity, length, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    }
+    if (labels[0]) {
+        appendText(buffer, capacity, length, "%s{%s} %lu\n", name, labels, (unsigned long)get());
+    } else {
+        appendText(buffer, capacity, length, "%s %lu\n", name, (unsigned long)get());
+    }
+    return length;
+}
+
+MetricHistogram::MetricHistogram(const char* name, const char* help, const uint32_t* bounds, int boundCount, const char* labels)
+    : Metric(name, help, labels)
+    , bounds(bounds)
+    , boundCount(boundCount < MAX_BOUNDS ? boundCount : MAX_BOUNDS)
+    , sumMicros(0)
+{
+    for (int i = 0; i <= MAX_BOUNDS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void MetricHistogram::observe(uint32_t micros) {
+    int bucket = 0;
+    while (bucket < boundCount && micros > bounds[bucket]) {
+        bucket++;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    sumMicros.fetch_add(micros, std::memory_order_relaxed);
+}
+
+uint32_t MetricHistogram::getCount() const {
+    uint32_t count = 0;
+    for (int i = 0; i <= boundCount; i++) {
+        count += buckets[i].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+size_t MetricHistogram::render(char* buffer, size_t capacity, bool header) const {
+    const char* separator = labels[0] ? "," : "";
+    size_t length = 0;
+    
+    if (header) {
+        appendText(buffer, capacity, length, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    }
+    
+    // Buckets are read once each, so the cumulative counts and _count always agree
+    uint32_t cumulative = 0;
+    for (int i = 0; i < boundCount; i++) {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        appendText(buffer, capacity, length, "%s_bucket{%s%sle=\"%g\"} %lu\n",
+                   name, labels, separator, bounds[i] / 1000000.0, (unsigned long)cumulative);
+    }
+    cumulative += buckets[boundCount].load(std::memory_order_relaxed);
+    appendText(buffer, capacity, length, "%s_bucket{%s%sle=\"+Inf\"} %lu\n",
+               name, labels, separator, (unsigned long)cumulative);
+    
+    uint32_t sum = sumMicros.load(std::memory_order_relaxed);
+    const char* open = labels[0] ? "{" : "";
+    const char* close = labels[0] ? "}" : "";
+    appendText(buffer, capacity, length, "%s_sum%s%s%s %lu.%06lu\n", name, open, labels, close,
+               (unsigned long)(sum / 1000000), (unsigned long)(sum % 1000000));
+    appendText(buffer, capacity, length, "%s_count%s%s%s %lu\n", name, open, labels, close,
+               (unsigned long)cumulative);
+    return length;
+}
+
+// Bucket limits in microseconds
+static const uint32_t FAST_BOUNDS[] = {
+    250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000
+};
+static const uint32_t SLOW_BOUNDS[] = {
+    10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 30000000
+};
+static const int FAST_COUNT = sizeof(FAST_BOUNDS) / sizeof(FAST_BOUNDS[0]);
+static const int SLOW_COUNT = sizeof(SLOW_BOUNDS) / sizeof(SLOW_BOUNDS[0]);
+
+// Definition order is the order on /metrics, series of one name must stay together
+
+MetricCounter metricBleConnectAttempts("ble_connect_attempts_total", "BLE connection attempts");
+MetricCounter metricBleConnectFailures("ble_connect_failures_total", "BLE connection attempts that did not end in a usable link");
+MetricHistogram metricBleConnectDuration("ble_connect_duration_seconds", "Time until the BLE link is up",
+                                         SLOW_BOUNDS, SLOW_COUNT);
+MetricHistogram metricBleDiscoveryDuration("ble_discovery_duration_seconds", "GATT service discovery, skipped with cached handles",
+                                           SLOW_BOUNDS, SLOW_COUNT);
+MetricHistogram metricBleCommandRoundTrip("ble_command_round_trip_seconds", "BMS command write to final response fragment",
+                                          SLOW_BOUNDS, SLOW_COUNT);
+MetricCounter metricBlePolls("ble_polls_total", "Battery polls");
+MetricCounter metricBlePollFailures("ble_poll_failures_total", "Battery polls without valid data");
+
+MetricCounter metricMqttConnectAttempts("mqtt_connect_attempts_total", "MQTT broker connection attempts");
+MetricCounter metricMqttConnectFailures("mqtt_connect_failures_total", "MQTT broker connection attempts that failed");
+MetricHistogram metricMqttConnectDuration("mqtt_connect_duration_seconds", "DNS, TCP connect and MQTT handshake",
+                                          SLOW_BOUNDS, SLOW_COUNT);
+MetricCounter metricMqttPublishes("mqtt_publishes_total", "MQTT messages handed to the client");
+MetricCounter metricMqttPublishFailures("mqtt_publish_failures_total", "MQTT messages the client could not send");
+MetricHistogram metricMqttPublishDuration("mqtt_publish_duration_seconds", "Time to write one MQTT message to the socket",
+                                          FAST_BOUNDS, FAST_COUNT);
+
+MetricCounter metricWifiDisconnects("wifi_disconnects_total", "WiFi connection losses");
+MetricCounter metricWifiReconnectAttempts("wifi_reconnect_attempts_total", "WiFi reconnect attempts");
+MetricHistogram metricWifiConnectDuration("wifi_connect_duration_seconds", "Time from connect or reconnect start to association",
+                                          SLOW_BOUNDS, SLOW_COUNT);
+
+MetricHistogram metricHttpRoot("http_request_duration_seconds", "HTTP handler run time",
+                               FAST_BOUNDS, FAST_COUNT, "handler=\"root\"");
+MetricHistogram metricHttpData("http_request_duration_seconds", "", FAST_BOUNDS, FAST_COUNT, "handler=\"data\"");
+MetricHistogram metricHttpEvents("http_request_duration_seconds", "", FAST_BOUNDS, FAST_COUNT, "handler=\"events\"");
+MetricHistogram metricHttpHistory("http_request_duration_seconds", "", FAST_BOUNDS, FAST_COUNT, "handler=\"history\"");
+MetricHistogram metricHttpExport("http_request_duration_seconds", "", FAST_BOUNDS, FAST_COUNT, "handler=\"export\"");
+MetricHistogram metricHttpLog("http_request_duration_seconds", "", FAST_BOUNDS, FAST_COUNT, "handler=\"log\"");
+MetricHistogram metricHttpMetrics("http_request_duration_seconds", "", FAST_BOUNDS, FAST_COUNT, "handler=\"metrics\"");
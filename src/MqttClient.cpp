@@ -1,8 +1,19 @@
 #include "MqttClient.h"
+#include <lwip/sockets.h>
 #include "config.h"
+#include "Logger.h"
+#include "Metrics.h"
 
-MqttClient::MqttClient() : mqttClient(wifiClient), lastReconnectAttempt(0) {
-    topicPrefix = MQTT_TOPIC_PREFIX;
+MqttClient::MqttClient()
+    : mqttClient(wifiClient), connectState(ConnectState::BACKOFF), stateSince(0), attemptStart(0),
+      backoffDelay(0), consecutiveFailures(0), socketFd(-1), dnsStatus(DNS_PENDING), resolvedAddress(0),
+      connectAttempts(0), connectFailures(0), lastConnectLatency(0), lastReplayBatch(0), suppressedSamples(0) {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        lastAcceptedTime[i] = 0;
+        hasAccepted[i] = false;
+        lastSentTime[i] = 0;
+        hasSent[i] = false;
+    }
 }
 
 bool MqttClient::begin(const char* server, int port, const char* user, const char* password, const char* clientId) {
@@ -13,102 +24,507 @@ bool MqttClient::begin(const char* server, int port, const char* user, const cha
     this->clientId = clientId;
     
     mqttClient.setServer(server, port);
-    mqttClient.setBufferSize(1024); // Increase buffer size for JSON messages
+    mqttClient.setSocketTimeout(MQTT_HANDSHAKE_TIMEOUT_S);
+    // Header and topic go into the PubSubClient buffer together with the payload
+    mqttClient.setBufferSize(MQTT_PAYLOAD_BUFFER_SIZE + TOPIC_MAX + 8);
+    
+    buildTopics();
+    
+    publishQueue.begin();
+    
+    // First attempt as soon as WiFi is up
+    backoffDelay = 0;
+    enterState(ConnectState::BACKOFF);
     
     return true;
 }
 
 void MqttClient::loop() {
-    if (!mqttClient.connected()) {
-        unsigned long now = millis();
-        if (now - lastReconnectAttempt > RECONNECT_INTERVAL) {
-            lastReconnectAttempt = now;
-            reconnect();
-        }
-    } else {
+    serviceConnection();
+    
+    if (connectState == ConnectState::CONNECTED) {
         mqttClient.loop();
+        replayQueued();
     }
 }
 
 bool MqttClient::isConnected() {
-    return mqttClient.connected();
+    return connectState == ConnectState::CONNECTED && mqttClient.connected();
 }
 
-void MqttClient::reconnect() {
-    
-    if (mqttClient.connect(clientId.c_str(), user.c_str(), password.c_str())) {
+void MqttClient::serviceConnection() {
+    switch (connectState) {
+        case ConnectState::CONNECTED:
+            if (!mqttClient.connected()) {
+                LOG_W("MQTT", "Broker connection lost (state %d)", mqttClient.state());
+                consecutiveFailures = 0;
+                scheduleRetry();
+            }
+            break;
+        
+        case ConnectState::BACKOFF:
+            if (WiFi.status() == WL_CONNECTED && millis() - stateSince >= backoffDelay) {
+                startAttempt();
+            }
+            break;
         
-        // Publish connection status
-        publishStatus("Connected");
+        case ConnectState::RESOLVING:
+            pollResolve();
+            break;
         
+        case ConnectState::CONNECTING:
+            pollSocket();
+            break;
+    }
+}
+
+void MqttClient::startAttempt() {
+    connectAttempts++;
+    metricMqttConnectAttempts.increment();
+    attemptStart = millis();
+    
+    // Literal addresses and cached names resolve right away, otherwise the
+    // answer arrives through dnsFound() while loop() keeps running
+    ip_addr_t address;
+    dnsStatus = DNS_PENDING;
+    err_t result = dns_gethostbyname(server.c_str(), &address, dnsFound, this);
+    if (result == ERR_OK) {
+        openSocket(ip4_addr_get_u32(ip_2_ip4(&address)));
+    } else if (result == ERR_INPROGRESS) {
+        enterState(ConnectState::RESOLVING);
     } else {
+        failAttempt("name lookup could not be started");
     }
 }
 
-bool MqttClient::publishBatteryData(const BatteryData& data) {
-    if (!mqttClient.connected()) {
-        return false;
+void MqttClient::dnsFound(const char* name, const ip_addr_t* address, void* arg) {
+    // Runs in the lwIP task, only hand the result over
+    MqttClient* client = static_cast<MqttClient*>(arg);
+    if (address != nullptr) {
+        client->resolvedAddress = ip4_addr_get_u32(ip_2_ip4(address));
+        client->dnsStatus = DNS_RESOLVED;
+    } else {
+        client->dnsStatus = DNS_FAILED;
     }
+}
+
+void MqttClient::pollResolve() {
+    if (dnsStatus == DNS_RESOLVED) {
+        openSocket(resolvedAddress);
+    } else if (dnsStatus == DNS_FAILED) {
+        failAttempt("name lookup failed");
+    } else if (millis() - attemptStart >= MQTT_CONNECT_TIMEOUT_MS) {
+        failAttempt("name lookup timed out");
+    }
+}
+
+void MqttClient::openSocket(uint32_t address) {
+    socketFd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (socketFd < 0) {
+        failAttempt("no socket available");
+        return;
+    }
+    fcntl(socketFd, F_SETFL, fcntl(socketFd, F_GETFL, 0) | O_NONBLOCK);
     
-    // Create JSON document
-    DynamicJsonDocument doc(1024);
+    struct sockaddr_in brokerAddress;
+    memset(&brokerAddress, 0, sizeof(brokerAddress));
+    brokerAddress.sin_family = AF_INET;
+    brokerAddress.sin_port = htons(port);
+    brokerAddress.sin_addr.s_addr = address;
     
-    doc["timestamp"] = data.timestamp;
-    doc["macAddress"] = data.macAddress;
-    doc["voltage"] = data.voltage;
-    doc["current"] = data.current;
-    doc["remainingAh"] = data.remainingAh;
-    doc["maxAh"] = data.maxAh;
-    doc["watts"] = data.watts;
-    doc["soc"] = data.soc;
-    doc["temperature"] = data.temperature;
-    doc["switches"] = data.switches;
-    doc["numCells"] = data.numCells;
-    doc["dataValid"] = data.dataValid;
+    if (connect(socketFd, (struct sockaddr*)&brokerAddress, sizeof(brokerAddress)) == 0) {
+        completeHandshake();
+    } else if (errno == EINPROGRESS) {
+        enterState(ConnectState::CONNECTING);
+    } else {
+        failAttempt("TCP connect refused");
+    }
+}
+
+void MqttClient::pollSocket() {
+    // Zero timeout, the socket only gets checked once per loop pass
+    fd_set writeSet;
+    FD_ZERO(&writeSet);
+    FD_SET(socketFd, &writeSet);
+    struct timeval noWait = {0, 0};
     
-    // Add cell voltages array
-    JsonArray cellVoltages = doc.createNestedArray("cellVoltages");
-    for (int i = 0; i < data.numCells && i < 32; i++) {
-        cellVoltages.add(data.cellVoltages[i]);
+    int ready = select(socketFd + 1, nullptr, &writeSet, nullptr, &noWait);
+    if (ready < 0) {
+        failAttempt("select failed");
+        return;
+    }
+    if (ready == 0) {
+        if (millis() - attemptStart >= MQTT_CONNECT_TIMEOUT_MS) {
+            failAttempt("TCP connect timed out");
+        }
+        return;
+    }
+    
+    int socketError = 0;
+    socklen_t length = sizeof(socketError);
+    if (getsockopt(socketFd, SOL_SOCKET, SO_ERROR, &socketError, &length) < 0 || socketError != 0) {
+        failAttempt("TCP connect failed");
+        return;
+    }
+    
+    completeHandshake();
+}
+
+void MqttClient::completeHandshake() {
+    // WiFiClient expects a blocking socket and takes ownership of it
+    fcntl(socketFd, F_SETFL, fcntl(socketFd, F_GETFL, 0) & ~O_NONBLOCK);
+    int noDelay = 1;
+    setsockopt(socketFd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    wifiClient = WiFiClient(socketFd);
+    socketFd = -1;
+    
+    // The broker is reachable at this point, PubSubClient skips its own TCP
+    // connect for a connected client. Waiting for CONNACK is the one blocking
+    // step left: PubSubClient cannot send CONNECT and pick up the reply later,
+    // and a second CONNECT on the same socket is a protocol error. A broker
+    // that accepts TCP but answers late holds loop() (MQTT, OTA and the
+    // acquisition events) for up to MQTT_HANDSHAKE_TIMEOUT_S; the web server
+    // runs in its own task and BLE in the acquisition task, neither waits.
+    if (!mqttClient.connect(clientId.c_str(), user.c_str(), password.c_str())) {
+        wifiClient.stop();
+        failAttempt("MQTT handshake rejected");
+        return;
     }
     
-    // Serialize JSON to string
-    String jsonString;
-    serializeJson(doc, jsonString);
+    lastConnectLatency = millis() - attemptStart;
+    metricMqttConnectDuration.observe(lastConnectLatency * 1000);
+    consecutiveFailures = 0;
+    enterState(ConnectState::CONNECTED);
+    LOG_I("MQTT", "Connected to broker in %lums", lastConnectLatency);
     
-    // Create topic
-    String topic = createBatteryTopic(data.macAddress, "data");
+    // Publish connection status
+    publishStatus("Connected");
+}
+
+void MqttClient::failAttempt(const char* reason) {
+    closeSocket();
+    connectFailures++;
+    metricMqttConnectFailures.increment();
+    if (consecutiveFailures < 16) {
+        consecutiveFailures++;
+    }
+    scheduleRetry();
+    LOG_W("MQTT", "Broker connect failed: %s (state %d), retry in %lums", reason, mqttClient.state(), backoffDelay);
+}
+
+void MqttClient::scheduleRetry() {
+    // Exponential backoff, randomized within the upper half so several
+    // loggers do not hit a restarting broker in lockstep
+    unsigned long ceiling = MQTT_BACKOFF_MIN_MS;
+    if (consecutiveFailures > 0) {
+        ceiling = (unsigned long)MQTT_BACKOFF_MIN_MS << (consecutiveFailures - 1);
+    }
+    if (ceiling > MQTT_BACKOFF_MAX_MS) {
+        ceiling = MQTT_BACKOFF_MAX_MS;
+    }
+    backoffDelay = ceiling / 2 + esp_random() % (ceiling / 2 + 1);
+    enterState(ConnectState::BACKOFF);
+}
+
+void MqttClient::closeSocket() {
+    if (socketFd >= 0) {
+        close(socketFd);
+        socketFd = -1;
+    }
+}
+
+void MqttClient::enterState(ConnectState state) {
+    connectState = state;
+    stateSince = millis();
+}
+
+uint32_t MqttClient::getConnectAttempts() const {
+    return connectAttempts;
+}
+
+uint32_t MqttClient::getConnectFailures() const {
+    return connectFailures;
+}
+
+unsigned long MqttClient::getLastConnectLatencyMs() const {
+    return lastConnectLatency;
+}
+
+bool MqttClient::publishBatteryData(const BatteryData& data, uint32_t time) {
+    int batteryIndex = findBattery(data);
+    if (batteryIndex < 0) {
+        LOG_W("MQTT", "Sample from unconfigured battery dropped");
+        return false;
+    }
+    
+    // Nothing moved and the heartbeat is not due yet, the retained payload is still current
+    unsigned long now = millis();
+    if (MQTT_DEADBAND_ENABLED && hasAccepted[batteryIndex] &&
+        now - lastAcceptedTime[batteryIndex] < MQTT_HEARTBEAT_MS &&
+        changedFields(lastAccepted[batteryIndex], data) == 0) {
+        suppressedSamples++;
+        return true;
+    }
+    lastAccepted[batteryIndex] = data;
+    lastAcceptedTime[batteryIndex] = now;
+    hasAccepted[batteryIndex] = true;
     
-    // Publish data
-    bool result = mqttClient.publish(topic.c_str(), jsonString.c_str(), true); // retained message
+    // The acquisition time travels with the sample, a replay publishes when it was measured
+    BatteryData sample = data;
+    sample.timestamp = time >= NTP_VALID_AFTER ? time : 0;
+    
+    // Queued samples go first so the broker sees them in timestamp order
+    if (mqttClient.connected() && publishQueue.isEmpty() && publishSample(sample)) {
+        return true;
+    }
+    
+    publishQueue.push(sample);
+    return false;
+}
+
+void MqttClient::replayQueued() {
+    if (publishQueue.isEmpty() || millis() - lastReplayBatch < MQTT_REPLAY_INTERVAL_MS) {
+        return;
+    }
+    lastReplayBatch = millis();
+    
+    // The read position is stored once per batch, not per sample
+    BatteryData sample;
+    for (int i = 0; i < MQTT_REPLAY_BATCH && publishQueue.peek(sample); i++) {
+        if (!publishSample(sample)) {
+            break;
+        }
+        publishQueue.pop();
+    }
+    publishQueue.savePosition();
     
-    return result;
+    if (publishQueue.isEmpty()) {
+        LOG_I("MQTT", "Publish queue replayed");
+    }
 }
 
-bool MqttClient::publishStatus(const String& message) {
+uint32_t MqttClient::getQueuedSamples() const {
+    return publishQueue.size();
+}
+
+uint32_t MqttClient::getDroppedSamples() const {
+    return publishQueue.getDroppedSamples();
+}
+
+uint32_t MqttClient::getSuppressedSamples() const {
+    return suppressedSamples;
+}
+
+bool MqttClient::publishSample(const BatteryData& data) {
     if (!mqttClient.connected()) {
         return false;
     }
     
-    String topic = createStatusTopic();
-    bool result = mqttClient.publish(topic.c_str(), message.c_str(), true); // retained message
+    int batteryIndex = findBattery(data);
+    if (batteryIndex < 0) {
+        LOG_W("MQTT", "Sample from unconfigured battery dropped");
+        return true;
+    }
+    
+    // Same document layout as before, but no heap: the document is reused
+    // and only holds pointers to static strings and the precomputed MAC
+    jsonDocument.clear();
+    if (data.timestamp > 0) {
+        jsonDocument["timestamp"] = data.timestamp;
+    }
+    jsonDocument["macAddress"] = (const char*)macStrings[batteryIndex];
+    jsonDocument["voltage"] = data.getVoltage();
+    jsonDocument["current"] = data.getCurrent();
+    jsonDocument["remainingAh"] = data.getRemainingAh();
+    jsonDocument["maxAh"] = data.getMaxAh();
+    jsonDocument["watts"] = data.getWatts();
+    jsonDocument["soc"] = data.getSoc();
+    jsonDocument["temperature"] = data.getTemperature();
+    jsonDocument["switches"] = data.getSwitches();
+    jsonDocument["numCells"] = data.numCells;
+    jsonDocument["dataValid"] = data.dataValid;
+    
+    // Add cell voltages array
+    JsonArray cellVoltages = jsonDocument.createNestedArray("cellVoltages");
+    for (int i = 0; i < data.numCells && i < BATTERY_MAX_CELLS; i++) {
+        cellVoltages.add(data.getCellVoltage(i));
+    }
     
-    if (result) {
+    if (jsonDocument.overflowed()) {
+        LOG_E("MQTT", "Battery payload exceeds JSON capacity");
+        return true;
+    }
+    
+    size_t length = serializeJson(jsonDocument, payloadBuffer, sizeof(payloadBuffer));
+    if (!publishPayload(dataTopics[batteryIndex], length, true)) { // retained message
+        return false;
+    }
+    
+    if (MQTT_FIELD_TOPICS_ENABLED) {
+        // Only moved fields, everything again once the heartbeat is due
+        unsigned long now = millis();
+        uint8_t fields = FIELD_ALL;
+        if (hasSent[batteryIndex] && now - lastSentTime[batteryIndex] < MQTT_HEARTBEAT_MS) {
+            fields = changedFields(lastSent[batteryIndex], data);
+        }
+        publishFieldTopics(batteryIndex, data, fields);
+        
+        lastSent[batteryIndex] = data;
+        lastSentTime[batteryIndex] = now;
+        hasSent[batteryIndex] = true;
+    }
+    return true;
+}
+
+uint8_t MqttClient::changedFields(const BatteryData& previous, const BatteryData& current) {
+    uint8_t fields = 0;
+    
+    // Raw units: 10 mV, 10 mA, 0.1 K, 1 mV per cell
+    if (abs((int)current.voltage10mV - (int)previous.voltage10mV) * 10 >= MQTT_DEADBAND_VOLTAGE_MV) {
+        fields |= FIELD_VOLTAGE;
+    }
+    if (abs((int)current.current10mA - (int)previous.current10mA) * 10 >= MQTT_DEADBAND_CURRENT_MA) {
+        fields |= FIELD_CURRENT;
+    }
+    if (fabsf(current.getSoc() - previous.getSoc()) >= MQTT_DEADBAND_SOC_PERCENT ||
+        current.nominal10mAh != previous.nominal10mAh) {
+        fields |= FIELD_SOC;
+    }
+    if (abs((int)current.temperature01K - (int)previous.temperature01K) >= MQTT_DEADBAND_TEMPERATURE_C * 10) {
+        fields |= FIELD_TEMPERATURE;
+    }
+    if (current.switches != previous.switches || current.dataValid != previous.dataValid) {
+        fields |= FIELD_SWITCHES;
+    }
+    
+    if (current.numCells != previous.numCells) {
+        fields |= FIELD_CELLS;
     } else {
+        for (int i = 0; i < current.numCells && i < BATTERY_MAX_CELLS; i++) {
+            if (cellMoved(previous, current, i)) {
+                fields |= FIELD_CELLS;
+                break;
+            }
+        }
+    }
+    
+    return fields;
+}
+
+bool MqttClient::cellMoved(const BatteryData& previous, const BatteryData& current, int cell) {
+    return abs((int)current.cellMillivolts[cell] - (int)previous.cellMillivolts[cell]) >= MQTT_DEADBAND_CELL_MV;
+}
+
+void MqttClient::publishFieldTopics(int batteryIndex, const BatteryData& data, uint8_t fields) {
+    char value[16];
+    
+    if (fields & FIELD_VOLTAGE) {
+        snprintf(value, sizeof(value), "%.2f", data.getVoltage());
+        publishField(batteryIndex, "voltage", value);
+    }
+    if (fields & (FIELD_VOLTAGE | FIELD_CURRENT)) {
+        snprintf(value, sizeof(value), "%.1f", data.getWatts());
+        publishField(batteryIndex, "power", value);
+    }
+    if (fields & FIELD_CURRENT) {
+        snprintf(value, sizeof(value), "%.2f", data.getCurrent());
+        publishField(batteryIndex, "current", value);
+    }
+    if (fields & FIELD_SOC) {
+        snprintf(value, sizeof(value), "%.1f", data.getSoc());
+        publishField(batteryIndex, "soc", value);
+        snprintf(value, sizeof(value), "%.2f", data.getRemainingAh());
+        publishField(batteryIndex, "capacity", value);
+    }
+    if (fields & FIELD_TEMPERATURE) {
+        snprintf(value, sizeof(value), "%.1f", data.getTemperature());
+        publishField(batteryIndex, "temperature", value);
+    }
+    if (fields & FIELD_SWITCHES) {
+        publishField(batteryIndex, "status", data.getSwitches());
     }
     
-    return result;
+    if (fields & FIELD_CELLS) {
+        // Cells one by one, after a cell count change or heartbeat all of them
+        bool allCells = fields == FIELD_ALL || !hasSent[batteryIndex] ||
+                        lastSent[batteryIndex].numCells != data.numCells;
+        char field[12];
+        for (int i = 0; i < data.numCells && i < BATTERY_MAX_CELLS; i++) {
+            if (allCells || cellMoved(lastSent[batteryIndex], data, i)) {
+                snprintf(field, sizeof(field), "cell/%d", i + 1);
+                snprintf(value, sizeof(value), "%.3f", data.getCellVoltage(i));
+                publishField(batteryIndex, field, value);
+            }
+        }
+    }
 }
 
-String MqttClient::createBatteryTopic(const String& macAddress, const String& subtopic) {
-    String cleanMac = macAddress;
-    cleanMac.replace(":", "");
-    cleanMac.toLowerCase();
+bool MqttClient::publishField(int batteryIndex, const char* field, const char* value) {
+    char topic[TOPIC_MAX + 16];
+    snprintf(topic, sizeof(topic), "%s%s", fieldTopicBases[batteryIndex], field);
+    return mqttClient.publish(topic, value, true); // retained message
+}
+
+bool MqttClient::publishPresence(int batteryIndex, bool present, int rssi) {
+    if (!mqttClient.connected() || batteryIndex < 0 || batteryIndex >= BATTERY_COUNT) {
+        return false;
+    }
     
-    return topicPrefix + "/battery/" + cleanMac + "/" + subtopic;
+    int length = snprintf(payloadBuffer, sizeof(payloadBuffer), "{\"present\":%s,\"rssi\":%d}",
+                          present ? "true" : "false", rssi);
+    return publishPayload(presenceTopics[batteryIndex], length, true); // retained message
 }
 
-String MqttClient::createStatusTopic() {
-    return topicPrefix + "/logger/status";
+bool MqttClient::publishStatus(const char* message) {
+    if (!mqttClient.connected()) {
+        return false;
+    }
+    
+    return mqttClient.publish(statusTopic, message, true); // retained message
 }
 
+bool MqttClient::publishPayload(const char* topic, size_t length, bool retained) {
+    // A full buffer means the payload was cut off, never send truncated JSON
+    if (length == 0 || length >= sizeof(payloadBuffer) - 1) {
+        LOG_E("MQTT", "Payload for %s does not fit into %u bytes", topic, (unsigned)sizeof(payloadBuffer));
+        return true;
+    }
+    
+    MetricTimer timer(metricMqttPublishDuration);
+    bool sent = mqttClient.publish(topic, (const uint8_t*)payloadBuffer, length, retained);
+    metricMqttPublishes.increment();
+    if (!sent) {
+        metricMqttPublishFailures.increment();
+    }
+    return sent;
+}
+
+void MqttClient::buildTopics() {
+    // Topic layout: <prefix>/battery/<mac without colons, lower case>/<subtopic>
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        macLookup[i].clear();
+        macLookup[i].setMacAddress(BATTERY_MAC_ADDRESSES[i]);
+        const uint8_t* mac = macLookup[i].mac;
+        
+        snprintf(macStrings[i], sizeof(macStrings[i]), "%02X:%02X:%02X:%02X:%02X:%02X",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        
+        char cleanMac[13];
+        snprintf(cleanMac, sizeof(cleanMac), "%02x%02x%02x%02x%02x%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        snprintf(dataTopics[i], TOPIC_MAX, "%s/battery/%s/data", MQTT_TOPIC_PREFIX, cleanMac);
+        snprintf(fieldTopicBases[i], TOPIC_MAX, "%s/battery/%s/", MQTT_TOPIC_PREFIX, cleanMac);
+        snprintf(presenceTopics[i], TOPIC_MAX, "%s/battery/%s/presence", MQTT_TOPIC_PREFIX, cleanMac);
+    }
+    
+    snprintf(statusTopic, TOPIC_MAX, "%s/logger/status", MQTT_TOPIC_PREFIX);
+}
+
+int MqttClient::findBattery(const BatteryData& data) const {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (memcmp(macLookup[i].mac, data.mac, sizeof(data.mac)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,92 @@
+#include "NotificationRing.h"
+
+NotificationRing::NotificationRing()
+    : head(0)
+    , tail(0)
+    , droppedFragments(0)
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "NotificationRing capacity must be a power of two");
+}
+
+bool NotificationRing::push(const uint8_t* data, size_t length, uint32_t timestampMicros) {
+    if (data == nullptr || length == 0 || length > 0xFFFF) {
+        return false;
+    }
+    
+    uint32_t currentHead = head.load(std::memory_order_relaxed);
+    uint32_t currentTail = tail.load(std::memory_order_acquire);
+    size_t freeSpace = CAPACITY - (currentHead - currentTail);
+    
+    // A burst that does not fit is dropped whole, the parser resynchronizes on the next frame
+    if (HEADER_SIZE + length > freeSpace) {
+        droppedFragments.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    writeByte(currentHead, length >> 8);
+    writeByte(currentHead + 1, length & 0xFF);
+    for (int i = 0; i < 4; i++) {
+        writeByte(currentHead + 2 + i, (timestampMicros >> (24 - 8 * i)) & 0xFF);
+    }
+    
+    // Payload in at most two chunks
+    uint32_t start = (currentHead + HEADER_SIZE) & MASK;
+    size_t firstChunk = min(length, CAPACITY - start);
+    memcpy(buffer + start, data, firstChunk);
+    if (firstChunk < length) {
+        memcpy(buffer, data + firstChunk, length - firstChunk);
+    }
+    
+    // Publish the record only after its bytes are in place
+    head.store(currentHead + HEADER_SIZE + length, std::memory_order_release);
+    return true;
+}
+
+bool NotificationRing::peek(RecordView& record) const {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    uint32_t currentHead = head.load(std::memory_order_acquire);
+    if (currentHead == currentTail) {
+        return false;
+    }
+    
+    size_t length = (readByte(currentTail) << 8) | readByte(currentTail + 1);
+    record.timestampMicros = 0;
+    for (int i = 0; i < 4; i++) {
+        record.timestampMicros = (record.timestampMicros << 8) | readByte(currentTail + 2 + i);
+    }
+    
+    uint32_t start = (currentTail + HEADER_SIZE) & MASK;
+    record.first = buffer + start;
+    record.firstLength = min(length, CAPACITY - start);
+    record.second = buffer;
+    record.secondLength = length - record.firstLength;
+    return true;
+}
+
+void NotificationRing::consume() {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    uint32_t currentHead = head.load(std::memory_order_acquire);
+    if (currentHead == currentTail) {
+        return;
+    }
+    
+    size_t length = (readByte(currentTail) << 8) | readByte(currentTail + 1);
+    tail.store(currentTail + HEADER_SIZE + length, std::memory_order_release);
+}
+
+void NotificationRing::clear() {
+    // Consumer-side reset: skip everything published so far
+    tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+uint32_t NotificationRing::getDroppedFragments() const {
+    return droppedFragments.load(std::memory_order_relaxed);
+}
+
+void NotificationRing::writeByte(uint32_t position, uint8_t value) {
+    buffer[position & MASK] = value;
+}
+
+uint8_t NotificationRing::readByte(uint32_t position) const {
+    return buffer[position & MASK];
+}
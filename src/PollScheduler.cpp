@@ -0,0 +1,183 @@
+#include "PollScheduler.h"
+
+PollScheduler::PollScheduler()
+    : budgetMs(0)
+    , lastRefill(0)
+{
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        schedules[i].nextDue = 0;
+        schedules[i].interval = SCAN_INTERVAL_MS;
+        schedules[i].hasSample = false;
+        schedules[i].lastCurrent = 0.0;
+        schedules[i].lastSoc = 0.0;
+        schedules[i].lastSampleTime = 0;
+    }
+}
+
+void PollScheduler::begin(unsigned long firstDelayMs) {
+    unsigned long now = millis();
+    
+    // Start with a full bucket so the first round is not throttled
+    budgetMs = (long)(POLL_DUTY_WINDOW_MS * POLL_RADIO_DUTY_PERCENT / 100);
+    lastRefill = now;
+    
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        schedules[i].interval = SCAN_INTERVAL_MS;
+        schedules[i].nextDue = now + firstDelayMs + i * 1000;
+    }
+}
+
+int PollScheduler::nextDueBattery() {
+    refillBudget();
+    if (budgetMs <= 0) {
+        return -1;
+    }
+    
+    unsigned long now = millis();
+    int dueIndex = -1;
+    long mostOverdue = -1;
+    
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        long overdue = (long)(now - schedules[i].nextDue);
+        if (overdue >= 0 && overdue > mostOverdue) {
+            mostOverdue = overdue;
+            dueIndex = i;
+        }
+    }
+    
+    return dueIndex;
+}
+
+int PollScheduler::collectDueBatteries(int* indices, int maxCount) {
+    refillBudget();
+    if (budgetMs <= 0 || indices == nullptr) {
+        return 0;
+    }
+    
+    unsigned long now = millis();
+    int count = 0;
+    
+    for (int i = 0; i < BATTERY_COUNT && count < maxCount; i++) {
+        long overdue = (long)(now - schedules[i].nextDue);
+        if (overdue < 0) {
+            continue;
+        }
+        
+        // Insertion sort by lateness, BATTERY_COUNT is tiny
+        int pos = count++;
+        while (pos > 0 && (long)(now - schedules[indices[pos - 1]].nextDue) < overdue) {
+            indices[pos] = indices[pos - 1];
+            pos--;
+        }
+        indices[pos] = i;
+    }
+    
+    return count;
+}
+
+void PollScheduler::recordPoll(int batteryIndex, bool success, const BatteryData& batteryData, unsigned long airtimeMs) {
+    if (batteryIndex < 0 || batteryIndex >= BATTERY_COUNT) {
+        return;
+    }
+    
+    refillBudget();
+    budgetMs -= (long)airtimeMs;
+    
+    BatterySchedule& schedule = schedules[batteryIndex];
+    unsigned long now = millis();
+    
+    if (!success) {
+        // Back off on failures, presence scanning catches the battery coming back
+        schedule.interval = min(schedule.interval * 2, (unsigned long)POLL_INTERVAL_MAX_MS);
+    } else if (isActive(schedule, batteryData, now)) {
+        schedule.interval = POLL_INTERVAL_MIN_MS;
+    } else {
+        // Idle: stretch the interval step by step from the base interval up to the maximum
+        schedule.interval = max(schedule.interval * 2, (unsigned long)SCAN_INTERVAL_MS);
+        schedule.interval = min(schedule.interval, (unsigned long)POLL_INTERVAL_MAX_MS);
+    }
+    
+    if (success) {
+        schedule.hasSample = true;
+        schedule.lastCurrent = batteryData.getCurrent();
+        schedule.lastSoc = batteryData.getSoc();
+        schedule.lastSampleTime = now;
+    }
+    
+    schedule.nextDue = now + schedule.interval;
+}
+
+void PollScheduler::recordSkipped(int batteryIndex) {
+    if (batteryIndex < 0 || batteryIndex >= BATTERY_COUNT) {
+        return;
+    }
+    
+    // Check again after the next presence scan window
+    schedules[batteryIndex].nextDue = millis() + BLE_PRESENCE_SCAN_INTERVAL_MS;
+}
+
+void PollScheduler::requestImmediate() {
+    unsigned long now = millis();
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        schedules[i].nextDue = now;
+    }
+}
+
+unsigned long PollScheduler::getInterval(int batteryIndex) const {
+    if (batteryIndex < 0 || batteryIndex >= BATTERY_COUNT) {
+        return 0;
+    }
+    return schedules[batteryIndex].interval;
+}
+
+unsigned long PollScheduler::getNextDue(int batteryIndex) const {
+    if (batteryIndex < 0 || batteryIndex >= BATTERY_COUNT) {
+        return 0;
+    }
+    return schedules[batteryIndex].nextDue;
+}
+
+long PollScheduler::getBudgetMs() const {
+    return budgetMs;
+}
+
+void PollScheduler::refillBudget() {
+    unsigned long now = millis();
+    unsigned long earned = (unsigned long)((unsigned long long)(now - lastRefill) * POLL_RADIO_DUTY_PERCENT / 100);
+    
+    // Advance only by the time that earned whole milliseconds, the remainder
+    // carries over so frequent calls do not round the refill away
+    lastRefill += (earned * 100 + POLL_RADIO_DUTY_PERCENT - 1) / POLL_RADIO_DUTY_PERCENT;
+    
+    // Bucket capacity is one window's worth of airtime, so bursts stay bounded
+    long capacity = (long)(POLL_DUTY_WINDOW_MS * POLL_RADIO_DUTY_PERCENT / 100);
+    budgetMs = min(budgetMs + (long)earned, capacity);
+    if (budgetMs == capacity) {
+        // A full bucket does not bank time
+        lastRefill = now;
+    }
+}
+
+bool PollScheduler::isActive(const BatterySchedule& schedule, const BatteryData& batteryData, unsigned long now) const {
+    // Charging or heavy load
+    if (fabs(batteryData.getWatts()) >= POLL_ACTIVE_POWER_W) {
+        return true;
+    }
+    
+    if (!schedule.hasSample) {
+        return false;
+    }
+    
+    // Current steps since the last sample
+    if (fabs(batteryData.getCurrent() - schedule.lastCurrent) >= POLL_CURRENT_DELTA_A) {
+        return true;
+    }
+    
+    // SOC moving quickly
+    float minutes = (now - schedule.lastSampleTime) / 60000.0;
+    if (minutes > 0 && fabs(batteryData.getSoc() - schedule.lastSoc) / minutes >= POLL_SOC_RATE_PER_MIN) {
+        return true;
+    }
+    
+    return false;
+}
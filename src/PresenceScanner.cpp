@@ -0,0 +1,169 @@
+#include "PresenceScanner.h"
+#include "Logger.h"
+
+// Static instance pointer for the scan completion callback
+PresenceScanner* PresenceScanner::instance = nullptr;
+
+PresenceScanner::PresenceScanner()
+    : pScan(nullptr)
+    , scanning(false)
+    , paused(false)
+    , windowCompleted(false)
+    , lastWindowStart(0)
+    , advertisedCallback(nullptr)
+{
+    instance = this;
+    
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (!parseMac(BATTERY_MAC_ADDRESSES[i], entries[i].address)) {
+            memset(entries[i].address, 0, sizeof(entries[i].address));
+        }
+        entries[i].rssi = 0;
+        entries[i].lastSeen = 0;
+        entries[i].seen = false;
+    }
+}
+
+void PresenceScanner::begin() {
+    pScan = BLEDevice::getScan();
+    if (pScan == nullptr) {
+        LOG_E("Presence", "BLE scan not available");
+        return;
+    }
+    
+    // Passive scan: listen to advertisements without sending scan requests.
+    // Duplicates are wanted so RSSI and last-seen stay current within a window.
+    advertisedCallback = new AdvertisedCallback(this);
+    pScan->setAdvertisedDeviceCallbacks(advertisedCallback, true);
+    pScan->setActiveScan(false);
+    pScan->setInterval(160);  // 100 ms
+    pScan->setWindow(80);     // 50 ms, leaves airtime for connections
+    
+    // First window right away so absent batteries are known before the first poll
+    lastWindowStart = millis() - BLE_PRESENCE_SCAN_INTERVAL_MS;
+    LOG_I("Presence", "Passive scanner initialized");
+}
+
+void PresenceScanner::loop() {
+    if (pScan == nullptr || paused || scanning) {
+        return;
+    }
+    
+    if (millis() - lastWindowStart < BLE_PRESENCE_SCAN_INTERVAL_MS) {
+        return;
+    }
+    
+    lastWindowStart = millis();
+    scanning = true;
+    if (!pScan->start(BLE_PRESENCE_SCAN_WINDOW_S, scanComplete, false)) {
+        scanning = false;
+    }
+}
+
+void PresenceScanner::pause() {
+    paused = true;
+    if (pScan && scanning) {
+        pScan->stop();
+        pScan->clearResults();
+        scanning = false;
+    }
+}
+
+void PresenceScanner::resume() {
+    paused = false;
+}
+
+bool PresenceScanner::isScanning() const {
+    return scanning;
+}
+
+bool PresenceScanner::isPresent(const String& macAddress) const {
+    int index = findEntry(macAddress);
+    if (index < 0 || !entries[index].seen) {
+        return false;
+    }
+    return (millis() - entries[index].lastSeen) < BLE_PRESENCE_TIMEOUT_MS;
+}
+
+int PresenceScanner::getRssi(const String& macAddress) const {
+    int index = findEntry(macAddress);
+    return (index >= 0 && entries[index].seen) ? entries[index].rssi : 0;
+}
+
+unsigned long PresenceScanner::getLastSeen(const String& macAddress) const {
+    int index = findEntry(macAddress);
+    return (index >= 0) ? entries[index].lastSeen : 0;
+}
+
+bool PresenceScanner::hasCompletedWindow() const {
+    return windowCompleted;
+}
+
+void PresenceScanner::updateRssi(const String& macAddress, int rssi) {
+    // Connected batteries usually stop advertising, polls keep their entry fresh
+    int index = findEntry(macAddress);
+    if (index >= 0) {
+        entries[index].rssi = rssi;
+        entries[index].lastSeen = millis();
+        entries[index].seen = true;
+    }
+}
+
+int PresenceScanner::findEntry(const String& macAddress) const {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (BATTERY_MAC_ADDRESSES[i] == macAddress) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int PresenceScanner::findEntry(const uint8_t* address) const {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (memcmp(entries[i].address, address, 6) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool PresenceScanner::parseMac(const String& macAddress, uint8_t* address) {
+    unsigned int bytes[6];
+    if (sscanf(macAddress.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x",
+               &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6) {
+        return false;
+    }
+    for (int i = 0; i < 6; i++) {
+        address[i] = bytes[i];
+    }
+    return true;
+}
+
+// Static scan completion callback, called from the BLE task
+void PresenceScanner::scanComplete(BLEScanResults results) {
+    if (instance) {
+        instance->windowCompleted = true;
+        instance->scanning = false;
+        if (instance->pScan) {
+            instance->pScan->clearResults();
+        }
+    }
+}
+
+void PresenceScanner::AdvertisedCallback::onResult(BLEAdvertisedDevice advertisedDevice) {
+    if (!scanner) {
+        return;
+    }
+    
+    int index = scanner->findEntry(*advertisedDevice.getAddress().getNative());
+    if (index < 0) {
+        return;
+    }
+    
+    PresenceEntry& entry = scanner->entries[index];
+    if (advertisedDevice.haveRSSI()) {
+        entry.rssi = advertisedDevice.getRSSI();
+    }
+    entry.lastSeen = millis();
+    entry.seen = true;
+}
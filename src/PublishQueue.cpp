@@ -0,0 +1,308 @@
+#include "PublishQueue.h"
+#include <LittleFS.h>
+#include "Logger.h"
+
+static const char* SPILL_DIRECTORY = "/mq";
+static const char* SPILL_POSITION_PATH = "/mq/read.bin";
+static const char* LEGACY_SPILL_PATH = "/mqtt-spill.bin";
+static const uint32_t SPILL_MAGIC = 0x32534D51;     // "QMS2"
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint32_t recordSize;
+};
+
+struct ReadPosition {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t index;
+};
+
+PublishQueue::PublishQueue()
+    : ramHead(0)
+    , ramCount(0)
+    , spillReady(false)
+    , readSequence(1)
+    , readIndex(0)
+    , positionDirty(false)
+    , writeSequence(1)
+    , writeCount(0)
+    , spillCount(0)
+    , droppedSamples(0)
+{
+}
+
+bool PublishQueue::begin() {
+    if (!MQTT_QUEUE_SPILL_ENABLED) {
+        return true;
+    }
+    
+    if (!LittleFS.begin(true)) {
+        LOG_E("MQTT", "LittleFS mount failed, publish queue stays in RAM");
+        return false;
+    }
+    LittleFS.mkdir(SPILL_DIRECTORY);
+    spillReady = true;
+    
+    // Single circular file of earlier versions, its samples are not carried over
+    if (LittleFS.exists(LEGACY_SPILL_PATH)) {
+        LittleFS.remove(LEGACY_SPILL_PATH);
+    }
+    
+    File file = LittleFS.open(SPILL_POSITION_PATH, "r");
+    ReadPosition position;
+    if (file && file.read((uint8_t*)&position, sizeof(position)) == sizeof(position) && position.magic == SPILL_MAGIC) {
+        readSequence = position.sequence;
+        readIndex = position.index;
+    }
+    if (file) {
+        file.close();
+    }
+    
+    // Segments are numbered without gaps from the one being replayed
+    uint32_t sequence = readSequence;
+    int32_t records;
+    while ((records = countRecords(sequence)) >= 0) {
+        if (sequence == readSequence) {
+            readIndex = min(readIndex, (uint32_t)records);
+            records -= readIndex;
+        }
+        spillCount += records;
+        sequence++;
+    }
+    
+    // The last segment may end in a record cut off by a power loss, so appending continues in a new one
+    writeSequence = sequence;
+    writeCount = 0;
+    
+    if (spillCount == 0) {
+        resetSpill();
+    } else {
+        LOG_I("MQTT", "Resuming %lu spilled samples", (unsigned long)spillCount);
+    }
+    return true;
+}
+
+void PublishQueue::push(const BatteryData& sample) {
+    if (ramCount == MQTT_QUEUE_RAM_SAMPLES) {
+        if (spillReady) {
+            spillOldest();
+        }
+        
+        // Nothing could be moved, the oldest RAM sample makes room
+        if (ramCount == MQTT_QUEUE_RAM_SAMPLES) {
+            ramHead = (ramHead + 1) % MQTT_QUEUE_RAM_SAMPLES;
+            ramCount--;
+            droppedSamples++;
+        }
+    }
+    
+    ram[(ramHead + ramCount) % MQTT_QUEUE_RAM_SAMPLES] = sample;
+    ramCount++;
+}
+
+bool PublishQueue::peek(BatteryData& sample) {
+    while (spillCount > 0) {
+        if (readSpilled(sample)) {
+            return true;
+        }
+        
+        // Segments written before a reboot can be short, the next one continues
+        if (readSequence != writeSequence) {
+            finishReadSegment();
+            continue;
+        }
+        
+        // An unreadable segment is given up rather than blocking the queue forever
+        LOG_E("MQTT", "Spill segment unreadable, dropping %lu samples", (unsigned long)spillCount);
+        droppedSamples += spillCount;
+        resetSpill();
+    }
+    
+    if (ramCount == 0) {
+        return false;
+    }
+    sample = ram[ramHead];
+    return true;
+}
+
+void PublishQueue::pop() {
+    if (spillCount > 0) {
+        spillCount--;
+        readIndex++;
+        if (spillCount == 0) {
+            resetSpill();
+        } else if (readIndex == MQTT_QUEUE_SPILL_SEGMENT_SAMPLES && readSequence != writeSequence) {
+            finishReadSegment();
+        } else {
+            positionDirty = true;
+        }
+        return;
+    }
+    
+    if (ramCount > 0) {
+        ramHead = (ramHead + 1) % MQTT_QUEUE_RAM_SAMPLES;
+        ramCount--;
+    }
+}
+
+void PublishQueue::savePosition() {
+    if (positionDirty) {
+        writeReadPosition();
+    }
+}
+
+bool PublishQueue::isEmpty() const {
+    return ramCount == 0 && spillCount == 0;
+}
+
+uint32_t PublishQueue::size() const {
+    return ramCount + spillCount;
+}
+
+uint32_t PublishQueue::getDroppedSamples() const {
+    return droppedSamples;
+}
+
+void PublishQueue::spillOldest() {
+    if (writeCount == MQTT_QUEUE_SPILL_SEGMENT_SAMPLES) {
+        writeSequence++;
+        writeCount = 0;
+    }
+    uint32_t batch = min((uint32_t)MQTT_QUEUE_SPILL_BATCH, (uint32_t)ramCount);
+    batch = min(batch, (uint32_t)MQTT_QUEUE_SPILL_SEGMENT_SAMPLES - writeCount);
+    
+    // Capacity is kept by dropping whole segments, never by rewriting one
+    while (spillCount + batch > MQTT_QUEUE_SPILL_SAMPLES && readSequence != writeSequence) {
+        dropReadSegment();
+    }
+    
+    char path[24];
+    getSegmentPath(writeSequence, path, sizeof(path));
+    File file = LittleFS.open(path, writeCount == 0 ? "w" : "a");
+    bool ok = file;
+    if (ok && writeCount == 0) {
+        SegmentHeader header = {SPILL_MAGIC, sizeof(BatteryData)};
+        ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header);
+    }
+    
+    // One append per batch, the file is closed once
+    uint32_t written = 0;
+    while (ok && written < batch) {
+        ok = file.write((const uint8_t*)&ram[ramHead], sizeof(BatteryData)) == sizeof(BatteryData);
+        if (ok) {
+            ramHead = (ramHead + 1) % MQTT_QUEUE_RAM_SAMPLES;
+            ramCount--;
+            written++;
+        }
+    }
+    if (file) {
+        file.close();
+    }
+    
+    writeCount += written;
+    spillCount += written;
+    if (!ok) {
+        // The segment may end in a partial record, later ones must not follow it
+        LOG_W("MQTT", "Writing %s failed", path);
+        writeSequence++;
+        writeCount = 0;
+    }
+}
+
+bool PublishQueue::readSpilled(BatteryData& sample) {
+    char path[24];
+    getSegmentPath(readSequence, path, sizeof(path));
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return false;
+    }
+    
+    bool ok = file.seek(sizeof(SegmentHeader) + readIndex * sizeof(BatteryData)) &&
+              file.read((uint8_t*)&sample, sizeof(sample)) == sizeof(sample);
+    file.close();
+    return ok;
+}
+
+void PublishQueue::finishReadSegment() {
+    char path[24];
+    getSegmentPath(readSequence, path, sizeof(path));
+    LittleFS.remove(path);
+    readSequence++;
+    readIndex = 0;
+    writeReadPosition();
+}
+
+void PublishQueue::dropReadSegment() {
+    int32_t records = countRecords(readSequence);
+    uint32_t remaining = records > (int32_t)readIndex ? records - readIndex : 0;
+    remaining = min(remaining, spillCount);
+    
+    LOG_W("MQTT", "Spill full, dropping %lu samples", (unsigned long)remaining);
+    droppedSamples += remaining;
+    spillCount -= remaining;
+    finishReadSegment();
+}
+
+bool PublishQueue::writeReadPosition() {
+    // A few bytes, LittleFS keeps such a file inline in its directory block
+    File file = LittleFS.open(SPILL_POSITION_PATH, "w");
+    if (!file) {
+        return false;
+    }
+    
+    ReadPosition position = {SPILL_MAGIC, readSequence, readIndex};
+    bool ok = file.write((const uint8_t*)&position, sizeof(position)) == sizeof(position);
+    file.close();
+    positionDirty = !ok;
+    return ok;
+}
+
+void PublishQueue::resetSpill() {
+    // Everything from the read segment to the write segment is consumed or given up
+    char path[24];
+    for (uint32_t sequence = readSequence; sequence <= writeSequence; sequence++) {
+        getSegmentPath(sequence, path, sizeof(path));
+        if (LittleFS.exists(path)) {
+            LittleFS.remove(path);
+        }
+    }
+    
+    readSequence = writeSequence + 1;
+    readIndex = 0;
+    writeSequence = readSequence;
+    writeCount = 0;
+    spillCount = 0;
+    
+    if (!writeReadPosition()) {
+        LOG_E("MQTT", "Cannot write spill position, publish queue stays in RAM");
+        spillReady = false;
+    }
+}
+
+void PublishQueue::getSegmentPath(uint32_t sequence, char* path, size_t size) {
+    snprintf(path, size, "%s/%08lx.seg", SPILL_DIRECTORY, (unsigned long)sequence);
+}
+
+int32_t PublishQueue::countRecords(uint32_t sequence) {
+    // -1 if the segment does not exist, records after a foreign header are not counted
+    char path[24];
+    getSegmentPath(sequence, path, sizeof(path));
+    if (!LittleFS.exists(path)) {
+        return -1;
+    }
+    
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return -1;
+    }
+    
+    SegmentHeader header;
+    int32_t records = 0;
+    if (file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) && header.magic == SPILL_MAGIC &&
+        header.recordSize == sizeof(BatteryData)) {
+        records = (file.size() - sizeof(header)) / sizeof(BatteryData);
+    }
+    file.close();
+    return records;
+}
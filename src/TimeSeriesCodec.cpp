@@ -0,0 +1,251 @@
+#include "TimeSeriesCodec.h"
+
+TimeSeriesCodec::TimeSeriesCodec() {
+    reset();
+}
+
+void TimeSeriesCodec::reset() {
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        tracks[i].seen = false;
+        tracks[i].lastTime = 0;
+        tracks[i].lastInterval = 0;
+        memset(&tracks[i].previous, 0, sizeof(tracks[i].previous));
+    }
+}
+
+size_t TimeSeriesCodec::encode(int batteryIndex, const BatteryData& data, uint32_t time, uint8_t* out) {
+    Track& track = tracks[batteryIndex];
+    const BatteryData& previous = track.previous;
+    size_t length = 0;
+    
+    out[length++] = (uint8_t)batteryIndex;
+    
+    if (!track.seen) {
+        length += putVarint(out + length, time);
+        track.lastInterval = 0;
+    } else {
+        int32_t interval = (int32_t)(time - track.lastTime);
+        length += putVarint(out + length, zigzag(interval - track.lastInterval));
+        track.lastInterval = interval;
+    }
+    track.lastTime = time;
+    
+    size_t maskPosition = length++;
+    uint8_t mask = 0;
+    
+    if (data.voltage10mV != previous.voltage10mV) {
+        mask |= FIELD_VOLTAGE;
+        length += putVarint(out + length, zigzag((int32_t)data.voltage10mV - previous.voltage10mV));
+    }
+    if (data.current10mA != previous.current10mA) {
+        mask |= FIELD_CURRENT;
+        length += putVarint(out + length, zigzag((int32_t)data.current10mA - previous.current10mA));
+    }
+    if (data.remaining10mAh != previous.remaining10mAh) {
+        mask |= FIELD_REMAINING;
+        length += putVarint(out + length, zigzag((int32_t)data.remaining10mAh - previous.remaining10mAh));
+    }
+    if (data.nominal10mAh != previous.nominal10mAh) {
+        mask |= FIELD_NOMINAL;
+        length += putVarint(out + length, zigzag((int32_t)data.nominal10mAh - previous.nominal10mAh));
+    }
+    if (data.temperature01K != previous.temperature01K) {
+        mask |= FIELD_TEMPERATURE;
+        length += putVarint(out + length, zigzag((int32_t)data.temperature01K - previous.temperature01K));
+    }
+    
+    uint8_t flags = (data.switches & 0x7F) | (data.dataValid ? 0x80 : 0);
+    uint8_t previousFlags = (previous.switches & 0x7F) | (previous.dataValid ? 0x80 : 0);
+    if (flags != previousFlags) {
+        mask |= FIELD_FLAGS;
+        out[length++] = flags;
+    }
+    
+    uint8_t numCells = data.numCells < BATTERY_MAX_CELLS ? data.numCells : BATTERY_MAX_CELLS;
+    if (numCells != previous.numCells) {
+        mask |= FIELD_NUM_CELLS;
+        out[length++] = numCells;
+    }
+    
+    // Cells beyond the previous count are stored as 0, so new cells become plain deltas
+    uint32_t cellMask = 0;
+    for (int i = 0; i < numCells; i++) {
+        if (data.cellMillivolts[i] != previous.cellMillivolts[i]) {
+            cellMask |= 1UL << i;
+        }
+    }
+    if (cellMask != 0) {
+        mask |= FIELD_CELLS;
+        length += putVarint(out + length, cellMask);
+        for (int i = 0; i < numCells; i++) {
+            if (cellMask & (1UL << i)) {
+                length += putVarint(out + length, zigzag((int32_t)data.cellMillivolts[i] - previous.cellMillivolts[i]));
+            }
+        }
+    }
+    
+    out[maskPosition] = mask;
+    
+    // Keep exactly what the decoder will reconstruct
+    track.previous = data;
+    track.previous.numCells = numCells;
+    track.previous.switches &= 0x7F;
+    for (int i = numCells; i < BATTERY_MAX_CELLS; i++) {
+        track.previous.cellMillivolts[i] = 0;
+    }
+    track.seen = true;
+    
+    return length;
+}
+
+size_t TimeSeriesCodec::decode(const uint8_t* in, size_t length, int& batteryIndex, uint32_t& time, BatteryData& data) {
+    size_t position = 0;
+    uint32_t value;
+    size_t used;
+    
+    if (length < 3 || in[0] >= BATTERY_COUNT) {
+        return 0;
+    }
+    batteryIndex = in[position++];
+    Track& track = tracks[batteryIndex];
+    
+    if ((used = getVarint(in + position, length - position, value)) == 0) {
+        return 0;
+    }
+    position += used;
+    
+    uint32_t decodedTime;
+    int32_t interval = 0;
+    if (!track.seen) {
+        decodedTime = value;
+    } else {
+        interval = track.lastInterval + unzigzag(value);
+        decodedTime = track.lastTime + interval;
+    }
+    
+    if (position >= length) {
+        return 0;
+    }
+    uint8_t mask = in[position++];
+    
+    // Work on a copy, the track only advances once the whole record was read
+    BatteryData decoded = track.previous;
+    int32_t delta;
+    if (mask & FIELD_VOLTAGE) {
+        if (!readDelta(in, length, position, delta)) {
+            return 0;
+        }
+        decoded.voltage10mV = (uint16_t)(decoded.voltage10mV + delta);
+    }
+    if (mask & FIELD_CURRENT) {
+        if (!readDelta(in, length, position, delta)) {
+            return 0;
+        }
+        decoded.current10mA = (int16_t)(decoded.current10mA + delta);
+    }
+    if (mask & FIELD_REMAINING) {
+        if (!readDelta(in, length, position, delta)) {
+            return 0;
+        }
+        decoded.remaining10mAh = (uint16_t)(decoded.remaining10mAh + delta);
+    }
+    if (mask & FIELD_NOMINAL) {
+        if (!readDelta(in, length, position, delta)) {
+            return 0;
+        }
+        decoded.nominal10mAh = (uint16_t)(decoded.nominal10mAh + delta);
+    }
+    if (mask & FIELD_TEMPERATURE) {
+        if (!readDelta(in, length, position, delta)) {
+            return 0;
+        }
+        decoded.temperature01K = (uint16_t)(decoded.temperature01K + delta);
+    }
+    
+    if (mask & FIELD_FLAGS) {
+        if (position >= length) {
+            return 0;
+        }
+        decoded.switches = in[position] & 0x7F;
+        decoded.dataValid = (in[position] & 0x80) != 0;
+        position++;
+    }
+    
+    if (mask & FIELD_NUM_CELLS) {
+        if (position >= length || in[position] > BATTERY_MAX_CELLS) {
+            return 0;
+        }
+        uint8_t numCells = in[position++];
+        for (int i = numCells; i < BATTERY_MAX_CELLS; i++) {
+            decoded.cellMillivolts[i] = 0;
+        }
+        decoded.numCells = numCells;
+    }
+    
+    if (mask & FIELD_CELLS) {
+        uint32_t cellMask;
+        if ((used = getVarint(in + position, length - position, cellMask)) == 0) {
+            return 0;
+        }
+        position += used;
+        for (int i = 0; i < decoded.numCells; i++) {
+            if (cellMask & (1UL << i)) {
+                if (!readDelta(in, length, position, delta)) {
+                    return 0;
+                }
+                decoded.cellMillivolts[i] = (uint16_t)(decoded.cellMillivolts[i] + delta);
+            }
+        }
+    }
+    
+    track.previous = decoded;
+    track.lastTime = decodedTime;
+    track.lastInterval = interval;
+    track.seen = true;
+    
+    data = decoded;
+    memset(data.mac, 0, sizeof(data.mac));
+    data.timestamp = 0;
+    time = decodedTime;
+    return position;
+}
+
+bool TimeSeriesCodec::readDelta(const uint8_t* in, size_t length, size_t& position, int32_t& delta) {
+    uint32_t value;
+    size_t used = getVarint(in + position, length - position, value);
+    if (used == 0) {
+        return false;
+    }
+    position += used;
+    delta = unzigzag(value);
+    return true;
+}
+
+size_t TimeSeriesCodec::putVarint(uint8_t* out, uint32_t value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (uint8_t)value;
+    return length;
+}
+
+size_t TimeSeriesCodec::getVarint(const uint8_t* in, size_t length, uint32_t& value) {
+    value = 0;
+    for (size_t i = 0; i < length && i < 5; i++) {
+        value |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+uint32_t TimeSeriesCodec::zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+int32_t TimeSeriesCodec::unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
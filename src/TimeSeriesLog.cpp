@@ -0,0 +1,416 @@
+#include "TimeSeriesLog.h"
+#include <LittleFS.h>
+#include "Logger.h"
+
+static const char* TSLOG_DIRECTORY = "/ts";
+static const char* TSLOG_INDEX_PATH = "/ts/index.bin";
+static const uint32_t SEGMENT_MAGIC = 0x314C5354;       // "TSL1"
+
+TimeSeriesLog::TimeSeriesLog()
+    : ready(false)
+    , mutex(nullptr)
+    , segmentCount(0)
+    , pendingLength(0)
+    , pendingRecords(0)
+    , lastFlush(0)
+    , bytesWritten(0)
+    , flushCount(0)
+    , droppedRecords(0)
+{
+    memset(&current, 0, sizeof(current));
+}
+
+bool TimeSeriesLog::begin() {
+    if (!TSLOG_ENABLED) {
+        return true;
+    }
+    
+    mutex = xSemaphoreCreateMutex();
+    if (mutex == nullptr) {
+        LOG_E("TSLog", "Failed to create mutex");
+        return false;
+    }
+    
+    if (!LittleFS.begin(true)) {
+        LOG_E("TSLog", "LittleFS mount failed, samples are not persisted");
+        return false;
+    }
+    LittleFS.mkdir(TSLOG_DIRECTORY);
+    
+    loadIndex();
+    uint32_t next = segmentCount > 0 ? segments[segmentCount - 1].sequence + 1 : 1;
+    
+    // The segment written before the reboot was never closed
+    SegmentInfo recovered;
+    if (recoverSegment(next, recovered)) {
+        current = recovered;
+        closeSegment();
+        next++;
+    }
+    
+    startSegment(next);
+    lastFlush = millis();
+    ready = true;
+    
+    LOG_I("TSLog", "%d segments, %lu bytes stored", segmentCount, (unsigned long)getStoredBytes());
+    return true;
+}
+
+bool TimeSeriesLog::append(int batteryIndex, const BatteryData& data, uint32_t time) {
+    if (!ready || batteryIndex < 0 || batteryIndex >= BATTERY_COUNT || time < NTP_VALID_AFTER) {
+        return false;
+    }
+    
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    
+    // Segments are decoded on their own, so a record never straddles two of them
+    if (current.bytes + pendingLength + TimeSeriesCodec::RECORD_MAX > TSLOG_SEGMENT_SIZE) {
+        flushLocked();
+        closeSegment();
+    }
+    if (pendingLength + TimeSeriesCodec::RECORD_MAX > sizeof(pending)) {
+        flushLocked();
+    }
+    
+    pendingLength += encoder.encode(batteryIndex, data, time, pending + pendingLength);
+    pendingRecords++;
+    
+    if (current.records == 0 || time < current.firstTime) {
+        current.firstTime = time;
+    }
+    if (time > current.lastTime) {
+        current.lastTime = time;
+    }
+    current.records++;
+    
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+void TimeSeriesLog::loop() {
+    if (!ready || pendingLength == 0 || millis() - lastFlush < TSLOG_FLUSH_INTERVAL_MS) {
+        return;
+    }
+    
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    flushLocked();
+    xSemaphoreGive(mutex);
+}
+
+void TimeSeriesLog::flush() {
+    if (!ready) {
+        return;
+    }
+    
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    flushLocked();
+    xSemaphoreGive(mutex);
+}
+
+int TimeSeriesLog::findSegments(uint32_t from, uint32_t to, SegmentInfo* found, int maxCount) {
+    if (!ready) {
+        return 0;
+    }
+    
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    flushLocked();
+    
+    int count = 0;
+    for (int i = 0; i < segmentCount && count < maxCount; i++) {
+        if (segments[i].lastTime >= from && segments[i].firstTime <= to) {
+            found[count++] = segments[i];
+        }
+    }
+    if (count < maxCount && current.records > 0 && current.bytes > 0 &&
+        current.lastTime >= from && current.firstTime <= to) {
+        found[count++] = current;
+    }
+    
+    xSemaphoreGive(mutex);
+    return count;
+}
+
+void TimeSeriesLog::getSegmentPath(uint32_t sequence, char* path, size_t size) {
+    snprintf(path, size, "%s/%08lx.seg", TSLOG_DIRECTORY, (unsigned long)sequence);
+}
+
+uint32_t TimeSeriesLog::getStoredBytes() const {
+    uint32_t bytes = current.bytes;
+    for (int i = 0; i < segmentCount; i++) {
+        bytes += segments[i].bytes;
+    }
+    return bytes;
+}
+
+uint32_t TimeSeriesLog::getSegmentCount() const {
+    return segmentCount + (current.bytes > 0 ? 1 : 0);
+}
+
+uint32_t TimeSeriesLog::getBytesWritten() const {
+    return bytesWritten;
+}
+
+uint32_t TimeSeriesLog::getFlushCount() const {
+    return flushCount;
+}
+
+uint32_t TimeSeriesLog::getDroppedRecords() const {
+    return droppedRecords;
+}
+
+void TimeSeriesLog::loadIndex() {
+    segmentCount = 0;
+    
+    File file = LittleFS.open(TSLOG_INDEX_PATH, "r");
+    if (!file) {
+        return;
+    }
+    
+    SegmentInfo info;
+    char path[24];
+    while (file.read((uint8_t*)&info, sizeof(info)) == sizeof(info)) {
+        // Entries of deleted segments can remain when a rewrite was interrupted
+        getSegmentPath(info.sequence, path, sizeof(path));
+        if (!LittleFS.exists(path)) {
+            continue;
+        }
+        if (segmentCount > 0 && info.sequence <= segments[segmentCount - 1].sequence) {
+            continue;
+        }
+        if (segmentCount == MAX_SEGMENTS) {
+            memmove(&segments[0], &segments[1], (MAX_SEGMENTS - 1) * sizeof(SegmentInfo));
+            segmentCount--;
+        }
+        segments[segmentCount++] = info;
+    }
+    file.close();
+}
+
+bool TimeSeriesLog::appendIndex(const SegmentInfo& info) {
+    File file = LittleFS.open(TSLOG_INDEX_PATH, "a");
+    if (!file) {
+        return false;
+    }
+    bool ok = file.write((const uint8_t*)&info, sizeof(info)) == sizeof(info);
+    file.close();
+    return ok;
+}
+
+bool TimeSeriesLog::rewriteIndex() {
+    File file = LittleFS.open(TSLOG_INDEX_PATH, "w");
+    if (!file) {
+        return false;
+    }
+    size_t size = segmentCount * sizeof(SegmentInfo);
+    bool ok = file.write((const uint8_t*)segments, size) == size;
+    file.close();
+    return ok;
+}
+
+bool TimeSeriesLog::recoverSegment(uint32_t sequence, SegmentInfo& info) {
+    char path[24];
+    getSegmentPath(sequence, path, sizeof(path));
+    if (!LittleFS.exists(path)) {
+        return false;
+    }
+    
+    memset(&info, 0, sizeof(info));
+    info.sequence = sequence;
+    
+    File file = LittleFS.open(path, "r");
+    info.bytes = file ? file.size() : 0;
+    file.close();
+    
+    // Decode up to a record cut off by a power loss
+    TimeSeriesReader reader;
+    int batteryIndex;
+    uint32_t time;
+    BatteryData data;
+    if (reader.open(sequence)) {
+        while (reader.next(batteryIndex, time, data)) {
+            if (info.records == 0 || time < info.firstTime) {
+                info.firstTime = time;
+            }
+            if (time > info.lastTime) {
+                info.lastTime = time;
+            }
+            info.records++;
+        }
+    }
+    return true;
+}
+
+void TimeSeriesLog::flushLocked() {
+    lastFlush = millis();
+    if (pendingLength == 0) {
+        return;
+    }
+    
+    char path[24];
+    getSegmentPath(current.sequence, path, sizeof(path));
+    File file = LittleFS.open(path, current.bytes == 0 ? "w" : "a");
+    bool ok = file;
+    if (ok && current.bytes == 0) {
+        ok = file.write((const uint8_t*)&SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) == sizeof(SEGMENT_MAGIC);
+        if (ok) {
+            current.bytes = sizeof(SEGMENT_MAGIC);
+        }
+    }
+    if (ok) {
+        ok = file.write(pending, pendingLength) == pendingLength;
+    }
+    if (file) {
+        file.close();
+    }
+    
+    if (ok) {
+        current.bytes += pendingLength;
+        bytesWritten += pendingLength;
+        flushCount++;
+        pendingLength = 0;
+        pendingRecords = 0;
+        return;
+    }
+    
+    // Later records would refer to the lost ones, so continue in a fresh segment
+    LOG_E("TSLog", "Writing %s failed, %lu records lost", path, (unsigned long)pendingRecords);
+    droppedRecords += pendingRecords;
+    current.records -= pendingRecords;
+    pendingLength = 0;
+    pendingRecords = 0;
+    closeSegment();
+}
+
+void TimeSeriesLog::closeSegment() {
+    char path[24];
+    getSegmentPath(current.sequence, path, sizeof(path));
+    
+    if (current.records == 0 || current.bytes == 0) {
+        if (current.bytes > 0) {
+            LittleFS.remove(path);
+        }
+        startSegment(current.sequence + 1);
+        return;
+    }
+    
+    bool dropped = false;
+    if (segmentCount == MAX_SEGMENTS) {
+        char oldestPath[24];
+        getSegmentPath(segments[0].sequence, oldestPath, sizeof(oldestPath));
+        LittleFS.remove(oldestPath);
+        memmove(&segments[0], &segments[1], (MAX_SEGMENTS - 1) * sizeof(SegmentInfo));
+        segmentCount--;
+        dropped = true;
+    }
+    segments[segmentCount++] = current;
+    
+    if (dropped) {
+        rewriteIndex();
+    } else {
+        appendIndex(current);
+    }
+    
+    startSegment(current.sequence + 1);
+    enforceRetention();
+}
+
+void TimeSeriesLog::enforceRetention() {
+    bool removed = false;
+    char path[24];
+    
+    while (segmentCount > 0 && getStoredBytes() > TSLOG_MAX_BYTES) {
+        getSegmentPath(segments[0].sequence, path, sizeof(path));
+        LittleFS.remove(path);
+        LOG_I("TSLog", "Retention: deleted %s", path);
+        memmove(&segments[0], &segments[1], (segmentCount - 1) * sizeof(SegmentInfo));
+        segmentCount--;
+        removed = true;
+    }
+    
+    if (removed) {
+        rewriteIndex();
+    }
+}
+
+void TimeSeriesLog::startSegment(uint32_t sequence) {
+    memset(&current, 0, sizeof(current));
+    current.sequence = sequence;
+    encoder.reset();
+}
+
+TimeSeriesReader::TimeSeriesReader()
+    : length(0)
+    , position(0)
+    , endOfFile(true)
+{
+}
+
+TimeSeriesReader::~TimeSeriesReader() {
+    close();
+}
+
+bool TimeSeriesReader::open(uint32_t sequence) {
+    close();
+    
+    char path[24];
+    TimeSeriesLog::getSegmentPath(sequence, path, sizeof(path));
+    file = LittleFS.open(path, "r");
+    if (!file) {
+        return false;
+    }
+    
+    uint32_t magic = 0;
+    if (file.read((uint8_t*)&magic, sizeof(magic)) != sizeof(magic) || magic != SEGMENT_MAGIC) {
+        close();
+        return false;
+    }
+    
+    decoder.reset();
+    length = 0;
+    position = 0;
+    endOfFile = false;
+    return true;
+}
+
+bool TimeSeriesReader::next(int& batteryIndex, uint32_t& time, BatteryData& data) {
+    if (!file) {
+        return false;
+    }
+    
+    // Keep at least one full record buffered until the file ends
+    if (length - position < TimeSeriesCodec::RECORD_MAX && !endOfFile) {
+        refill();
+    }
+    if (position >= length) {
+        return false;
+    }
+    
+    size_t used = decoder.decode(buffer + position, length - position, batteryIndex, time, data);
+    if (used == 0) {
+        return false;
+    }
+    position += used;
+    return true;
+}
+
+void TimeSeriesReader::close() {
+    if (file) {
+        file.close();
+    }
+    length = 0;
+    position = 0;
+    endOfFile = true;
+}
+
+void TimeSeriesReader::refill() {
+    memmove(buffer, buffer + position, length - position);
+    length -= position;
+    position = 0;
+    
+    size_t wanted = sizeof(buffer) - length;
+    size_t read = file.read(buffer + length, wanted);
+    length += read;
+    if (read < wanted) {
+        endOfFile = true;
+    }
+}
@@ -1,13 +1,36 @@
 #include "WebServerManager.h"
+#include <stdarg.h>
+#include "index_html_gz.h"
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <esp_system.h>
+#include <LittleFS.h>
+#include "Metrics.h"
 
 WebServerManager::WebServerManager() 
     : webServer(nullptr)
     , serverRunning(false)
+    , taskHandle(nullptr)
+    , dataMutex(nullptr)
+    , dataSnapshotLength(0)
+    , snapshotVersion(0)
+    , bootId(0)
+    , pendingEvents(0)
+    , lastEventKeepalive(0)
+    , timeSeriesLog(nullptr)
+    , loopScheduler(nullptr)
+    , acquisitionTask(nullptr)
+    , mqttClient(nullptr)
+    , bluetoothManager(nullptr)
 {
     initializeBatteryData();
 }
 
 WebServerManager::~WebServerManager() {
+    if (taskHandle) {
+        vTaskDelete(taskHandle);
+        taskHandle = nullptr;
+    }
     if (webServer) {
         delete webServer;
         webServer = nullptr;
@@ -15,184 +38,808 @@ WebServerManager::~WebServerManager() {
 }
 
 void WebServerManager::begin() {
+    if (taskHandle) {
+        return;
+    }
     if (webServer) {
         delete webServer;
     }
     
-    webServer = new WebServer(80);
+    dataMutex = xSemaphoreCreateMutex();
+    if (dataMutex == nullptr) {
+        LOG_E("Web", "Failed to create data mutex");
+        return;
+    }
+    
+    webServer = new DetachableWebServer(80);
+    
+    // Needed for conditional page and /api/data requests
+    static const char* collectedHeaders[] = {"If-None-Match"};
+    webServer->collectHeaders(collectedHeaders, 1);
+    
+    // ETags from before a reboot must not match the new snapshot versions
+    bootId = esp_random();
+    lock();
+    renderSnapshot();
+    unlock();
     
     // Set up routes
     webServer->on("/", [this]() { handleRoot(); });
     webServer->on("/api/data", [this]() { handleApiData(); });
+    webServer->on("/api/log", [this]() { handleApiLog(); });
+    webServer->on("/api/events", [this]() { handleApiEvents(); });
+    webServer->on("/api/history", [this]() { handleApiHistory(); });
+    webServer->on("/api/export", [this]() { handleApiExport(); });
+    webServer->on("/metrics", [this]() { handleMetrics(); });
     
     webServer->begin();
     serverRunning = true;
     
-    Serial.println("WebServerManager started successfully");
+    BaseType_t created = xTaskCreatePinnedToCore(taskEntry, "web-server", WEB_TASK_STACK_SIZE, this,
+                                                 WEB_TASK_PRIORITY, &taskHandle, WEB_TASK_CORE);
+    if (created != pdPASS) {
+        LOG_E("Web", "Failed to start HTTP task");
+        taskHandle = nullptr;
+        serverRunning = false;
+        return;
+    }
+    
+    LOG_I("Web", "WebServerManager started successfully on core %d", WEB_TASK_CORE);
 }
 
-void WebServerManager::handleClient() {
-    if (webServer && serverRunning) {
+void WebServerManager::taskEntry(void* param) {
+    static_cast<WebServerManager*>(param)->run();
+}
+
+void WebServerManager::run() {
+    if (WATCHDOG_ENABLED) {
+        esp_task_wdt_add(NULL);
+    }
+    
+    while (true) {
+        if (WATCHDOG_ENABLED) {
+            esp_task_wdt_reset();
+        }
+        
         webServer->handleClient();
+        pushEvents();
+        
+        vTaskDelay(pdMS_TO_TICKS(WEB_TASK_INTERVAL_MS));
+    }
+}
+
+void WebServerManager::lock() {
+    // Before begin() there is no HTTP task, so nothing to guard against
+    if (dataMutex) {
+        xSemaphoreTake(dataMutex, portMAX_DELAY);
+    }
+}
+
+void WebServerManager::unlock() {
+    if (dataMutex) {
+        xSemaphoreGive(dataMutex);
     }
 }
 
 void WebServerManager::updateBatteryData(int batteryIndex, const BatteryData& batteryData) {
     if (batteryIndex >= 0 && batteryIndex < BATTERY_COUNT) {
+        history.add(batteryIndex, batteryData, uptimeSeconds());
+        
+        lock();
         latestBatteryData[batteryIndex] = batteryData;
+        batteryChanged(batteryIndex);
+        unlock();
     }
 }
 
 void WebServerManager::setBatteryDataUpdateTime(int batteryIndex, unsigned long updateTime) {
     if (batteryIndex >= 0 && batteryIndex < BATTERY_COUNT) {
+        lock();
         lastDataUpdate[batteryIndex] = updateTime;
+        batteryChanged(batteryIndex);
+        unlock();
+    }
+}
+
+void WebServerManager::updateBatteryPresence(int batteryIndex, bool present, int rssi) {
+    if (batteryIndex >= 0 && batteryIndex < BATTERY_COUNT) {
+        lock();
+        if (batteryPresent[batteryIndex] != present || batteryRssi[batteryIndex] != rssi) {
+            batteryPresent[batteryIndex] = present;
+            batteryRssi[batteryIndex] = rssi;
+            batteryChanged(batteryIndex);
+        }
+        unlock();
     }
 }
 
+void WebServerManager::setTimeSeriesLog(TimeSeriesLog* log) {
+    timeSeriesLog = log;
+}
+
+void WebServerManager::setLoopScheduler(const LoopScheduler* scheduler) {
+    loopScheduler = scheduler;
+}
+
+void WebServerManager::setAcquisitionTask(const AcquisitionTask* task) {
+    acquisitionTask = task;
+}
+
+void WebServerManager::setMqttClient(const MqttClient* client) {
+    mqttClient = client;
+}
+
+void WebServerManager::setBluetoothManager(const BluetoothManager* manager) {
+    bluetoothManager = manager;
+}
+
 bool WebServerManager::isRunning() const {
     return serverRunning;
 }
 
 void WebServerManager::initializeBatteryData() {
     for (int i = 0; i < BATTERY_COUNT; i++) {
+        batteryPresent[i] = true;
+        batteryRssi[i] = 0;
+        
         // Only initialize if no valid data exists yet
         if (lastDataUpdate[i] == 0) {
-            latestBatteryData[i].dataValid = false;
-            latestBatteryData[i].soc = 0;
-            latestBatteryData[i].voltage = 0.0;
-            latestBatteryData[i].current = 0.0;
-            latestBatteryData[i].watts = 0.0;
-            latestBatteryData[i].temperature = 0.0;
-            latestBatteryData[i].remainingAh = 0.0;
-            latestBatteryData[i].numCells = 0;
+            latestBatteryData[i].clear();
         }
         // If data already exists, preserve it but don't reset lastDataUpdate
     }
 }
 
-// Memory-efficient HTML page (stored in PROGMEM)
-const char index_html[] PROGMEM = R"rawliteral(
-<!DOCTYPE html>
-<html>
-<head>
-<meta charset="UTF-8">
-<meta name="viewport" content="width=device-width,initial-scale=1">
-<title>ECO-WORTHY Batterien</title>
-<style>
-body{font-family:Arial;margin:10px;background:#f0f0f0}
-.container{max-width:800px;margin:0 auto}
-.battery{background:white;margin:10px 0;padding:15px;border-radius:8px;box-shadow:0 2px 4px rgba(0,0,0,0.1)}
-.header{color:#333;margin:0 0 10px 0;font-size:18px}
-.grid{display:grid;grid-template-columns:repeat(auto-fit,minmax(120px,1fr));gap:10px}
-.item{text-align:center}
-.label{font-size:12px;color:#666;margin-bottom:2px}
-.value{font-size:16px;font-weight:bold;color:#333}
-.soc{font-size:24px;color:#2196F3}
-.voltage{color:#4CAF50}
-.current{color:#FF9800}
-.temp{color:#9C27B0}
-.offline{opacity:0.5}
-.cells{margin-top:10px}
-.cell{display:inline-block;margin:2px;padding:4px 6px;background:#e0e0e0;border-radius:4px;font-size:11px}
-</style>
-</head>
-<body>
-<div class="container">
-<h1>ECO-WORTHY Batterie Monitor</h1>
-<div id="batteries"></div>
-</div>
-<script>
-function updateData(){
-fetch('/api/data').then(r=>r.json()).then(data=>{
-let html='';
-data.forEach((bat,i)=>{
-const offline=bat.ageSeconds>120;
-html+=`<div class="battery ${offline?'offline':''}">
-<h2 class="header">Batterie ${i+1} ${offline?'(Offline)':''}</h2>
-<div class="grid">
-<div class="item"><div class="label">SOC</div><div class="value soc">${bat.soc}%</div></div>
-<div class="item"><div class="label">Spannung</div><div class="value voltage">${bat.voltage}V</div></div>
-<div class="item"><div class="label">Strom</div><div class="value current">${bat.current}A</div></div>
-<div class="item"><div class="label">Leistung</div><div class="value">${bat.watts}W</div></div>
-<div class="item"><div class="label">Temperatur</div><div class="value temp">${bat.temperature}°C</div></div>
-<div class="item"><div class="label">Verbleibend</div><div class="value">${bat.remainingAh}Ah</div></div>
-</div>`;
-if(bat.numCells>0){
-html+='<div class="cells">';
-for(let j=0;j<bat.numCells;j++){
-html+=`<span class="cell">${bat.cellVoltages[j]}V</span>`;
-}
-html+='</div>';
-}
-html+='</div>';
-});
-document.getElementById('batteries').innerHTML=html;
-}).catch(e=>console.error('Fehler:',e));
-}
-updateData();
-setInterval(updateData,5000);
-</script>
-</body>
-</html>
-)rawliteral";
+// Called with dataMutex held
+void WebServerManager::batteryChanged(int batteryIndex) {
+    renderSnapshot();
+    pendingEvents |= 1u << batteryIndex;
+}
+
+uint32_t WebServerManager::uptimeSeconds() {
+    // esp_timer does not wrap like millis()
+    return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+void WebServerManager::renderSnapshot() {
+    size_t length = 0;
+    
+    appendJson(dataSnapshot, sizeof(dataSnapshot), length, "[");
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (i > 0) {
+            appendJson(dataSnapshot, sizeof(dataSnapshot), length, ",");
+        }
+        if (length < sizeof(dataSnapshot)) {
+            length += renderBattery(i, dataSnapshot + length, sizeof(dataSnapshot) - length);
+        }
+    }
+    appendJson(dataSnapshot, sizeof(dataSnapshot), length, "]");
+    
+    if (length >= sizeof(dataSnapshot)) {
+        LOG_E("Web", "API snapshot exceeds %u bytes", (unsigned)sizeof(dataSnapshot));
+        strcpy(dataSnapshot, "[]");
+        length = 2;
+    }
+    
+    dataSnapshotLength = length;
+    snapshotVersion++;
+    snprintf(snapshotEtag, sizeof(snapshotEtag), "\"%08x-%u\"", (unsigned)bootId, (unsigned)snapshotVersion);
+}
+
+size_t WebServerManager::renderBattery(int batteryIndex, char* buffer, size_t capacity) {
+    const BatteryData& data = latestBatteryData[batteryIndex];
+    size_t length = 0;
+    
+    appendJson(buffer, capacity, length, "{\"soc\":%.2f,\"voltage\":%.2f,\"current\":%.2f,\"watts\":%.1f,"
+               "\"temperature\":%.1f,\"remainingAh\":%.1f,\"numCells\":%u,\"cellVoltages\":[",
+               data.getSoc(), data.getVoltage(), data.getCurrent(), data.getWatts(),
+               data.getTemperature(), data.getRemainingAh(), (unsigned)data.numCells);
+    for (int j = 0; j < data.numCells && j < BATTERY_MAX_CELLS; j++) {
+        appendJson(buffer, capacity, length, j > 0 ? ",%.3f" : "%.3f", data.getCellVoltage(j));
+    }
+    appendJson(buffer, capacity, length, "],\"present\":%s,\"rssi\":%d,\"updatedMs\":%lu}",
+               batteryPresent[batteryIndex] ? "true" : "false", batteryRssi[batteryIndex], lastDataUpdate[batteryIndex]);
+    
+    return length;
+}
+
+void WebServerManager::appendJson(char* buffer, size_t capacity, size_t& length, const char* format, ...) {
+    // Once the buffer is full, length stays at the capacity and nothing more is written
+    if (length >= capacity) {
+        return;
+    }
+    
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + length, capacity - length, format, args);
+    va_end(args);
+    
+    length = written >= 0 ? length + written : capacity;
+}
 
 void WebServerManager::handleRoot() {
-    if (webServer) {
-        webServer->send_P(200, "text/html", index_html);
+    if (!webServer) {
+        return;
     }
+    MetricTimer timer(metricHttpRoot);
+    
+    // The page only changes with a firmware update, browsers keep it and revalidate by ETag
+    webServer->sendHeader("ETag", INDEX_HTML_ETAG);
+    webServer->sendHeader("Cache-Control", "public, max-age=" + String(WEB_PAGE_MAX_AGE_S));
+    
+    if (webServer->header("If-None-Match") == INDEX_HTML_ETAG) {
+        webServer->send(304);
+        return;
+    }
+    
+    // Stored pre-gzipped in flash (generated from web/index.html at build time)
+    webServer->sendHeader("Content-Encoding", "gzip");
+    webServer->send_P(200, "text/html", (PGM_P)index_html_gz, index_html_gz_len);
 }
 
 void WebServerManager::handleApiData() {
     if (!webServer) {
         return;
     }
+    MetricTimer timer(metricHttpData);
     
-    // Pre-allocate string with estimated size to prevent frequent reallocations
-    String json;
-    json.reserve(2048); // Reserve space to prevent memory fragmentation
+    // Copy under the lock, a slow client must not hold up the data updates
+    char etag[sizeof(snapshotEtag)];
+    lock();
+    memcpy(etag, snapshotEtag, sizeof(etag));
+    size_t length = dataSnapshotLength;
+    memcpy(responseBuffer, dataSnapshot, length);
+    unlock();
     
-    json = "[";
-    for (int i = 0; i < BATTERY_COUNT; i++) {
-        if (i > 0) json += ",";
-        json += "{";
-        json += "\"soc\":" + String(latestBatteryData[i].soc) + ",";
-        json += "\"voltage\":" + String(latestBatteryData[i].voltage, 2) + ",";
-        json += "\"current\":" + String(latestBatteryData[i].current, 2) + ",";
-        json += "\"watts\":" + String(latestBatteryData[i].watts, 1) + ",";
-        json += "\"temperature\":" + String(latestBatteryData[i].temperature, 1) + ",";
-        json += "\"remainingAh\":" + String(latestBatteryData[i].remainingAh, 1) + ",";
-        json += "\"numCells\":" + String(latestBatteryData[i].numCells) + ",";
-        json += "\"cellVoltages\":[";
+    // Revalidation is always required, the uptime header lets the client age the data
+    webServer->sendHeader("ETag", etag);
+    webServer->sendHeader("Cache-Control", "no-cache");
+    webServer->sendHeader("X-Uptime-Ms", String(millis()));
+    
+    if (webServer->header("If-None-Match") == etag) {
+        webServer->send(304);
+        return;
+    }
+    
+    webServer->send_P(200, "application/json", responseBuffer, length);
+}
+
+void WebServerManager::handleApiLog() {
+    if (!webServer) {
+        return;
+    }
+    MetricTimer timer(metricHttpLog);
+    
+    // Stream the log ring in chunks straight from a stack buffer
+    webServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    webServer->send(200, "text/plain", "");
+    
+    char chunk[256];
+    uint32_t position = logger.getOldestPosition();
+    size_t length;
+    while ((length = logger.read(position, chunk, sizeof(chunk))) > 0) {
+        webServer->sendContent(chunk, length);
+    }
+    webServer->sendContent("", 0);
+}
+
+void WebServerManager::handleApiHistory() {
+    if (!webServer) {
+        return;
+    }
+    MetricTimer timer(metricHttpHistory);
+    
+    int batteryIndex = webServer->arg("battery").toInt() - 1;
+    if (batteryIndex < 0 || batteryIndex >= BATTERY_COUNT) {
+        webServer->send(400, "text/plain", "battery must be between 1 and " + String(BATTERY_COUNT));
+        return;
+    }
+    
+    // Times are uptime seconds, by default everything stored up to now. Unlike
+    // /api/export this works before NTP; the response carries the wall clock
+    // at "uptime" so clients can convert (0 while the clock is not set).
+    uint32_t now = uptimeSeconds();
+    time_t clock = time(nullptr);
+    uint32_t epoch = clock >= NTP_VALID_AFTER ? clock : 0;
+    uint32_t from = webServer->hasArg("from") ? webServer->arg("from").toInt() : history.getOldestTime(batteryIndex);
+    uint32_t to = webServer->hasArg("to") ? webServer->arg("to").toInt() : now + 1;
+    long points = webServer->hasArg("points") ? webServer->arg("points").toInt() : HISTORY_DEFAULT_POINTS;
+    points = constrain(points, 1, HISTORY_MAX_POINTS);
+    if (to <= from) {
+        webServer->send(400, "text/plain", "from must be before to");
+        return;
+    }
+    
+    // Nothing exists outside the stored range, clamping keeps the bucket width sane
+    to = min(to, now + 1);
+    from = min(max(from, history.getOldestTime(batteryIndex)), to);
+    uint32_t bucketSeconds = max((uint32_t)(((uint64_t)to - from + points - 1) / points), (uint32_t)1);
+    
+    // One min/avg/max row per non-empty bucket, streamed through a stack buffer
+    webServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    webServer->send(200, "application/json", "");
+    
+    char chunk[512];
+    size_t length = snprintf(chunk, sizeof(chunk),
+                             "{\"battery\":%d,\"from\":%u,\"to\":%u,\"bucketSeconds\":%u,\"uptime\":%u,\"epoch\":%lu,"
+                             "\"fields\":[\"time\",\"count\",\"voltageMin\",\"voltageAvg\",\"voltageMax\","
+                             "\"currentMin\",\"currentAvg\",\"currentMax\",\"soc\",\"temperature\"],\"buckets\":[",
+                             batteryIndex + 1, (unsigned)from, (unsigned)to, (unsigned)bucketSeconds, (unsigned)now,
+                             (unsigned long)epoch);
+    bool first = true;
+    
+    // The last bucket ends at to, so start never steps past it and cannot wrap
+    uint32_t end = from;
+    for (uint32_t start = from; start < to; start = end) {
+        end = to - start > bucketSeconds ? start + bucketSeconds : to;
+        HistoryBucket bucket;
+        if (!history.summarize(batteryIndex, start, end, bucket)) {
+            continue;
+        }
         
-        // Limit cell voltages to prevent excessive memory usage
-        int maxCells = min((int)latestBatteryData[i].numCells, 16); // Limit to 16 cells max
-        for (int j = 0; j < maxCells; j++) {
-            if (j > 0) json += ",";
-            json += String(latestBatteryData[i].cellVoltages[j], 3);
+        char temperature[12] = "null";
+        if (bucket.temperatureCount > 0) {
+            snprintf(temperature, sizeof(temperature), "%.1f",
+                     ((float)bucket.sumTemperature01K / bucket.temperatureCount - 2731.0f) * 0.1f);
         }
-        json += "],";
         
-        // Calculate age in seconds since last update
-        unsigned long currentTime = millis();
-        unsigned long ageSeconds = 0;
-        if (lastDataUpdate[i] > 0) {
-            if (currentTime >= lastDataUpdate[i]) {
-                ageSeconds = (currentTime - lastDataUpdate[i]) / 1000;
-            } else {
-                // Handle millis() overflow (happens every ~49 days)
-                // When overflow occurs, calculate the time correctly
-                unsigned long timeBeforeOverflow = (0xFFFFFFFF - lastDataUpdate[i]);
-                unsigned long timeAfterOverflow = currentTime;
-                ageSeconds = (timeBeforeOverflow + timeAfterOverflow + 1) / 1000;
+        if (length + 160 > sizeof(chunk)) {
+            webServer->sendContent(chunk, length);
+            length = 0;
+        }
+        length += snprintf(chunk + length, sizeof(chunk) - length,
+                           "%s[%u,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.1f,%s]", first ? "" : ",",
+                           (unsigned)start, (unsigned)bucket.count,
+                           bucket.minVoltage10mV / 100.0f, (float)bucket.sumVoltage10mV / bucket.count / 100.0f,
+                           bucket.maxVoltage10mV / 100.0f, bucket.minCurrent10mA / 100.0f,
+                           (float)bucket.sumCurrent10mA / bucket.count / 100.0f, bucket.maxCurrent10mA / 100.0f,
+                           (float)bucket.sumSoc01 / bucket.count / 10.0f, temperature);
+        first = false;
+    }
+    
+    length += snprintf(chunk + length, sizeof(chunk) - length, "]}");
+    webServer->sendContent(chunk, length);
+    webServer->sendContent("", 0);
+}
+
+void WebServerManager::handleApiExport() {
+    if (!webServer) {
+        return;
+    }
+    MetricTimer timer(metricHttpExport);
+    if (!timeSeriesLog) {
+        webServer->send(503, "text/plain", "Time-series log disabled");
+        return;
+    }
+    
+    // Times are UTC epoch seconds, by default everything stored
+    uint32_t from = webServer->hasArg("from") ? strtoul(webServer->arg("from").c_str(), nullptr, 10) : 0;
+    uint32_t to = webServer->hasArg("to") ? strtoul(webServer->arg("to").c_str(), nullptr, 10) : UINT32_MAX;
+    String format = webServer->hasArg("format") ? webServer->arg("format") : String("csv");
+    bool binary = format == "bin";
+    if (!binary && format != "csv") {
+        webServer->send(400, "text/plain", "format must be csv or bin");
+        return;
+    }
+    if (to < from) {
+        webServer->send(400, "text/plain", "from must not be after to");
+        return;
+    }
+    
+    unsigned long started = millis();
+    uint32_t freeHeap = esp_get_free_heap_size();
+    int segmentCount = timeSeriesLog->findSegments(from, to, exportSegments, TimeSeriesLog::MAX_SEGMENTS);
+    
+    webServer->sendHeader("Content-Disposition", binary ? "attachment; filename=\"export.bin\""
+                                                        : "attachment; filename=\"export.csv\"");
+    webServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    webServer->send(200, binary ? "application/octet-stream" : "text/csv", "");
+    
+    size_t length = 0;
+    size_t sent = 0;
+    uint32_t records = 0;
+    if (!binary) {
+        length = snprintf(exportBuffer, sizeof(exportBuffer),
+                          "time,battery,voltage,current,remaining,nominal,soc,temperature,switches,valid,cells\n");
+    }
+    
+    for (int i = 0; i < segmentCount; i++) {
+        if (WATCHDOG_ENABLED) {
+            esp_task_wdt_reset();
+        }
+        
+        if (!binary) {
+            exportCsv(exportSegments[i].sequence, from, to, length, sent, records);
+        } else if (!exportBinary(exportSegments[i], sent)) {
+            // Segment shrank or vanished under retention, a short frame would corrupt the stream
+            LOG_W("Web", "Export aborted at segment %lu", (unsigned long)exportSegments[i].sequence);
+            webServer->client().stop();
+            return;
+        }
+    }
+    
+    if (length > 0) {
+        webServer->sendContent(exportBuffer, length);
+        sent += length;
+    }
+    webServer->sendContent("", 0);
+    
+    unsigned long elapsed = millis() - started;
+    LOG_I("Web", "Export: %d segments, %lu records, %lu bytes in %lu ms (%lu KB/s), free heap %u -> %u",
+          segmentCount, (unsigned long)records, (unsigned long)sent, elapsed,
+          elapsed > 0 ? (unsigned long)(sent / elapsed) : 0UL, (unsigned)freeHeap, (unsigned)esp_get_free_heap_size());
+}
+
+void WebServerManager::handleMetrics() {
+    if (!webServer) {
+        return;
+    }
+    MetricTimer timer(metricHttpMetrics);
+    
+    // Battery values are copied under the lock, rendering happens outside
+    BatteryData batteries[BATTERY_COUNT];
+    unsigned long updated[BATTERY_COUNT];
+    bool present[BATTERY_COUNT];
+    int rssi[BATTERY_COUNT];
+    lock();
+    memcpy(batteries, latestBatteryData, sizeof(batteries));
+    memcpy(updated, lastDataUpdate, sizeof(updated));
+    memcpy(present, batteryPresent, sizeof(present));
+    memcpy(rssi, batteryRssi, sizeof(rssi));
+    unlock();
+    unsigned long now = millis();
+    
+    webServer->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    webServer->send(200, "text/plain; version=0.0.4", "");
+    size_t length = 0;
+    
+    // Registry: counters and histograms, HELP/TYPE once per name
+    const char* previousName = "";
+    for (const Metric* metric = Metric::first(); metric != nullptr; metric = metric->getNext()) {
+        bool header = strcmp(metric->getName(), previousName) != 0;
+        size_t rendered = metric->render(exportBuffer + length, sizeof(exportBuffer) - length, header);
+        if (length + rendered >= sizeof(exportBuffer)) {
+            // Did not fit behind the buffered text, send that and render again
+            webServer->sendContent(exportBuffer, length);
+            length = 0;
+            rendered = metric->render(exportBuffer, sizeof(exportBuffer), header);
+            if (rendered >= sizeof(exportBuffer)) {
+                LOG_E("Web", "Metric %s exceeds %u bytes", metric->getName(), (unsigned)sizeof(exportBuffer));
+                rendered = 0;
             }
-        } else {
-            ageSeconds = 999; // No data received yet
+        }
+        length += rendered;
+        previousName = metric->getName();
+    }
+    
+    // Battery gauges, only for batteries with data
+    static const struct {
+        const char* name;
+        const char* help;
+        float (BatteryData::*value)() const;
+        const char* format;
+    } BATTERY_GAUGES[] = {
+        { "battery_voltage_volts", "Pack voltage", &BatteryData::getVoltage, "%.2f" },
+        { "battery_current_amperes", "Pack current, positive while charging", &BatteryData::getCurrent, "%.2f" },
+        { "battery_power_watts", "Pack power", &BatteryData::getWatts, "%.1f" },
+        { "battery_soc_percent", "State of charge", &BatteryData::getSoc, "%.1f" },
+        { "battery_remaining_amperehours", "Remaining capacity", &BatteryData::getRemainingAh, "%.2f" },
+        { "battery_nominal_amperehours", "Nominal capacity", &BatteryData::getMaxAh, "%.2f" },
+        { "battery_temperature_celsius", "First NTC temperature", &BatteryData::getTemperature, "%.1f" },
+    };
+    for (size_t g = 0; g < sizeof(BATTERY_GAUGES) / sizeof(BATTERY_GAUGES[0]); g++) {
+        appendMetricLine(length, "# HELP %s %s\n# TYPE %s gauge\n",
+                         BATTERY_GAUGES[g].name, BATTERY_GAUGES[g].help, BATTERY_GAUGES[g].name);
+        for (int i = 0; i < BATTERY_COUNT; i++) {
+            const BatteryData& data = batteries[i];
+            if (updated[i] == 0 || !data.dataValid) {
+                continue;
+            }
+            if (BATTERY_GAUGES[g].value == &BatteryData::getTemperature && data.temperature01K == 0) {
+                continue;
+            }
+            char value[16];
+            snprintf(value, sizeof(value), BATTERY_GAUGES[g].format, (data.*BATTERY_GAUGES[g].value)());
+            appendMetricLine(length, "%s{battery=\"%d\"} %s\n", BATTERY_GAUGES[g].name, i + 1, value);
+        }
+    }
+    
+    appendMetricLine(length, "# HELP battery_cell_voltage_volts Cell voltage\n# TYPE battery_cell_voltage_volts gauge\n");
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (updated[i] == 0 || !batteries[i].dataValid) {
+            continue;
+        }
+        for (int c = 0; c < batteries[i].numCells && c < BATTERY_MAX_CELLS; c++) {
+            appendMetricLine(length, "battery_cell_voltage_volts{battery=\"%d\",cell=\"%d\"} %.3f\n",
+                             i + 1, c + 1, batteries[i].getCellVoltage(c));
+        }
+    }
+    
+    appendMetricLine(length, "# HELP battery_last_update_age_seconds Time since the last valid sample\n"
+                             "# TYPE battery_last_update_age_seconds gauge\n");
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (updated[i] != 0) {
+            appendMetricLine(length, "battery_last_update_age_seconds{battery=\"%d\"} %.1f\n",
+                             i + 1, (now - updated[i]) / 1000.0f);
+        }
+    }
+    
+    appendMetricLine(length, "# HELP battery_present Battery seen advertising recently\n# TYPE battery_present gauge\n");
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        appendMetricLine(length, "battery_present{battery=\"%d\"} %d\n", i + 1, present[i] ? 1 : 0);
+    }
+    
+    appendMetricLine(length, "# HELP battery_rssi_dbm Advertising signal strength\n# TYPE battery_rssi_dbm gauge\n");
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        if (present[i] && rssi[i] != 0) {
+            appendMetricLine(length, "battery_rssi_dbm{battery=\"%d\"} %d\n", i + 1, rssi[i]);
+        }
+    }
+    
+    // System
+    appendMetricLine(length, "# HELP uptime_seconds Time since boot\n# TYPE uptime_seconds gauge\nuptime_seconds %lu\n",
+                     (unsigned long)uptimeSeconds());
+    appendMetricLine(length, "# HELP heap_free_bytes Free heap\n# TYPE heap_free_bytes gauge\nheap_free_bytes %u\n",
+                     (unsigned)esp_get_free_heap_size());
+    appendMetricLine(length, "# HELP heap_min_free_bytes Lowest free heap since boot\n# TYPE heap_min_free_bytes gauge\n"
+                             "heap_min_free_bytes %u\n", (unsigned)esp_get_minimum_free_heap_size());
+    if (WiFi.status() == WL_CONNECTED) {
+        appendMetricLine(length, "# HELP wifi_rssi_dbm Access point signal strength\n# TYPE wifi_rssi_dbm gauge\nwifi_rssi_dbm %d\n",
+                         (int)WiFi.RSSI());
+    }
+    
+    if (timeSeriesLog) {
+        appendMetricLine(length, "# HELP tslog_stored_bytes Time-series log size on flash\n# TYPE tslog_stored_bytes gauge\n"
+                                 "tslog_stored_bytes %lu\n", (unsigned long)timeSeriesLog->getStoredBytes());
+        appendMetricLine(length, "# HELP tslog_written_bytes_total Bytes appended to the time-series log\n"
+                                 "# TYPE tslog_written_bytes_total counter\ntslog_written_bytes_total %lu\n",
+                         (unsigned long)timeSeriesLog->getBytesWritten());
+        appendMetricLine(length, "# HELP tslog_flushes_total Block writes of the time-series log\n"
+                                 "# TYPE tslog_flushes_total counter\ntslog_flushes_total %lu\n",
+                         (unsigned long)timeSeriesLog->getFlushCount());
+        appendMetricLine(length, "# HELP tslog_dropped_records_total Samples lost to failed writes\n"
+                                 "# TYPE tslog_dropped_records_total counter\ntslog_dropped_records_total %lu\n",
+                         (unsigned long)timeSeriesLog->getDroppedRecords());
+    }
+    
+    if (loopScheduler) {
+        uint8_t jobCount = loopScheduler->getJobCount();
+        appendMetricLine(length, "# HELP loop_job_runs_total Runs of a loop() job\n# TYPE loop_job_runs_total counter\n");
+        for (uint8_t i = 0; i < jobCount; i++) {
+            const LoopScheduler::JobStats& stats = loopScheduler->getJobStats(i);
+            appendMetricLine(length, "loop_job_runs_total{job=\"%s\"} %lu\n", stats.name, (unsigned long)stats.runs);
+        }
+        appendMetricLine(length, "# HELP loop_job_overruns_total Runs that exceeded the job's time budget\n"
+                                 "# TYPE loop_job_overruns_total counter\n");
+        for (uint8_t i = 0; i < jobCount; i++) {
+            const LoopScheduler::JobStats& stats = loopScheduler->getJobStats(i);
+            appendMetricLine(length, "loop_job_overruns_total{job=\"%s\"} %lu\n", stats.name, (unsigned long)stats.overruns);
+        }
+        appendMetricLine(length, "# HELP loop_job_budget_seconds Time budget per run\n# TYPE loop_job_budget_seconds gauge\n");
+        for (uint8_t i = 0; i < jobCount; i++) {
+            const LoopScheduler::JobStats& stats = loopScheduler->getJobStats(i);
+            appendMetricLine(length, "loop_job_budget_seconds{job=\"%s\"} %.3f\n", stats.name, stats.budgetMs / 1000.0f);
+        }
+        appendMetricLine(length, "# HELP loop_job_max_duration_seconds Longest run since boot\n"
+                                 "# TYPE loop_job_max_duration_seconds gauge\n");
+        for (uint8_t i = 0; i < jobCount; i++) {
+            const LoopScheduler::JobStats& stats = loopScheduler->getJobStats(i);
+            appendMetricLine(length, "loop_job_max_duration_seconds{job=\"%s\"} %.6f\n", stats.name, stats.maxDurationUs / 1e6f);
+        }
+        appendMetricLine(length, "# HELP loop_job_max_lateness_seconds Longest start delay past the deadline\n"
+                                 "# TYPE loop_job_max_lateness_seconds gauge\n");
+        for (uint8_t i = 0; i < jobCount; i++) {
+            const LoopScheduler::JobStats& stats = loopScheduler->getJobStats(i);
+            appendMetricLine(length, "loop_job_max_lateness_seconds{job=\"%s\"} %.3f\n", stats.name, stats.maxLatenessMs / 1000.0f);
+        }
+        appendMetricLine(length, "# HELP loop_overruns_total Budget overruns of all loop() jobs\n"
+                                 "# TYPE loop_overruns_total counter\nloop_overruns_total %lu\n",
+                         (unsigned long)loopScheduler->getTotalOverruns());
+    }
+    
+    // Samples and events lost or held back on the way from the BMS to the broker
+    if (bluetoothManager) {
+        appendMetricLine(length, "# HELP ble_dropped_notifications_total Notification fragments lost to a full ring\n"
+                                 "# TYPE ble_dropped_notifications_total counter\nble_dropped_notifications_total %lu\n",
+                         (unsigned long)bluetoothManager->getDroppedNotifications());
+    }
+    if (acquisitionTask) {
+        appendMetricLine(length, "# HELP acquisition_dropped_events_total Acquisition events lost to a full queue\n"
+                                 "# TYPE acquisition_dropped_events_total counter\nacquisition_dropped_events_total %lu\n",
+                         (unsigned long)acquisitionTask->getDroppedEvents());
+    }
+    if (mqttClient) {
+        appendMetricLine(length, "# HELP mqtt_queued_samples Samples waiting for the broker\n"
+                                 "# TYPE mqtt_queued_samples gauge\nmqtt_queued_samples %lu\n",
+                         (unsigned long)mqttClient->getQueuedSamples());
+        appendMetricLine(length, "# HELP mqtt_dropped_samples_total Queued samples given up for lack of space\n"
+                                 "# TYPE mqtt_dropped_samples_total counter\nmqtt_dropped_samples_total %lu\n",
+                         (unsigned long)mqttClient->getDroppedSamples());
+        appendMetricLine(length, "# HELP mqtt_suppressed_samples_total Samples skipped inside the deadband\n"
+                                 "# TYPE mqtt_suppressed_samples_total counter\nmqtt_suppressed_samples_total %lu\n",
+                         (unsigned long)mqttClient->getSuppressedSamples());
+    }
+    
+    if (length > 0) {
+        webServer->sendContent(exportBuffer, length);
+    }
+    webServer->sendContent("", 0);
+}
+
+void WebServerManager::appendMetricLine(size_t& length, const char* format, ...) {
+    // Every call writes well below METRIC_LINE_MAX, flush before the buffer could cut it off
+    if (length + METRIC_LINE_MAX > sizeof(exportBuffer)) {
+        webServer->sendContent(exportBuffer, length);
+        length = 0;
+    }
+    
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(exportBuffer + length, sizeof(exportBuffer) - length, format, args);
+    va_end(args);
+    if (written > 0) {
+        length += (size_t)written < sizeof(exportBuffer) - length ? written : sizeof(exportBuffer) - length - 1;
+    }
+}
+
+void WebServerManager::exportCsv(uint32_t sequence, uint32_t from, uint32_t to, size_t& length, size_t& sent, uint32_t& records) {
+    if (!exportReader.open(sequence)) {
+        return;
+    }
+    
+    int batteryIndex;
+    uint32_t time;
+    BatteryData data;
+    while (exportReader.next(batteryIndex, time, data)) {
+        if (time < from || time > to) {
+            continue;
         }
         
-        json += "\"ageSeconds\":" + String(ageSeconds);
-        json += "}";
+        if (length + EXPORT_ROW_MAX > sizeof(exportBuffer)) {
+            webServer->sendContent(exportBuffer, length);
+            sent += length;
+            length = 0;
+        }
+        
+        char temperature[12] = "";
+        if (data.temperature01K > 0) {
+            snprintf(temperature, sizeof(temperature), "%.1f", data.getTemperature());
+        }
+        length += snprintf(exportBuffer + length, sizeof(exportBuffer) - length,
+                           "%lu,%d,%.2f,%.2f,%.2f,%.2f,%.1f,%s,%u,%d,",
+                           (unsigned long)time, batteryIndex + 1, data.getVoltage(), data.getCurrent(),
+                           data.getRemainingAh(), data.getMaxAh(), data.getSoc(), temperature,
+                           (unsigned)data.switches, data.dataValid ? 1 : 0);
+        for (int i = 0; i < data.numCells; i++) {
+            length += snprintf(exportBuffer + length, sizeof(exportBuffer) - length, "%s%u",
+                               i > 0 ? " " : "", (unsigned)data.cellMillivolts[i]);
+        }
+        exportBuffer[length++] = '\n';
+        records++;
+    }
+    exportReader.close();
+}
+
+bool WebServerManager::exportBinary(const TimeSeriesLog::SegmentInfo& segment, size_t& sent) {
+    char path[24];
+    TimeSeriesLog::getSegmentPath(segment.sequence, path, sizeof(path));
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return false;
     }
-    json += "]";
     
-    webServer->send(200, "application/json", json);
+    // Frame: sequence and length (little endian), then the segment file as stored
+    uint32_t header[2] = { segment.sequence, segment.bytes };
+    memcpy(exportBuffer, header, sizeof(header));
+    size_t length = sizeof(header);
+    uint32_t remaining = segment.bytes;
+    
+    while (remaining > 0) {
+        size_t wanted = sizeof(exportBuffer) - length;
+        if (wanted > remaining) {
+            wanted = remaining;
+        }
+        size_t read = file.read((uint8_t*)exportBuffer + length, wanted);
+        if (read == 0) {
+            break;
+        }
+        length += read;
+        remaining -= read;
+        
+        webServer->sendContent(exportBuffer, length);
+        sent += length;
+        length = 0;
+    }
+    file.close();
+    return remaining == 0;
+}
+
+void WebServerManager::handleApiEvents() {
+    if (!webServer) {
+        return;
+    }
+    MetricTimer timer(metricHttpEvents);
+    
+    int slot = -1;
+    for (int i = 0; i < WEB_SSE_MAX_CLIENTS; i++) {
+        if (!eventClients[i].connected()) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        webServer->send(503, "text/plain", "Too many event streams");
+        return;
+    }
+    
+    // The stream is taken from the server, which goes on with the next request
+    WiFiClient client = webServer->detachClient();
+    client.setNoDelay(true);
+    client.print("HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/event-stream\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "Connection: keep-alive\r\n\r\n");
+    
+    // Full state first, only changed batteries follow
+    lock();
+    size_t snapshotLength = dataSnapshotLength;
+    memcpy(responseBuffer, dataSnapshot, snapshotLength);
+    unlock();
+    
+    int length = snprintf(eventBuffer, sizeof(eventBuffer), "event: snapshot\ndata: {\"uptimeMs\":%lu,\"batteries\":", millis());
+    client.write((const uint8_t*)eventBuffer, length);
+    client.write((const uint8_t*)responseBuffer, snapshotLength);
+    client.write((const uint8_t*)"}\n\n", 3);
+    
+    eventClients[slot] = client;
+    LOG_D("Web", "Event stream %d opened", slot);
+}
+
+void WebServerManager::pushEvents() {
+    bool anyClient = false;
+    for (int i = 0; i < WEB_SSE_MAX_CLIENTS; i++) {
+        anyClient = anyClient || eventClients[i].connected();
+    }
+    
+    lock();
+    uint32_t pending = pendingEvents;
+    pendingEvents = 0;
+    unlock();
+    
+    for (int i = 0; i < BATTERY_COUNT && anyClient && pending != 0; i++) {
+        if (!(pending & (1u << i))) {
+            continue;
+        }
+        
+        // Rendered under the lock, written to the streams outside of it
+        size_t length = snprintf(eventBuffer, sizeof(eventBuffer),
+                                 "event: battery\ndata: {\"index\":%d,\"uptimeMs\":%lu,\"battery\":", i, millis());
+        lock();
+        length += renderBattery(i, eventBuffer + length, sizeof(eventBuffer) - length - 3);
+        unlock();
+        if (length >= sizeof(eventBuffer) - 4) {
+            LOG_E("Web", "Event for battery %d exceeds %u bytes", i + 1, (unsigned)sizeof(eventBuffer));
+            continue;
+        }
+        memcpy(eventBuffer + length, "}\n\n", 3);
+        broadcastEvent(eventBuffer, length + 3);
+    }
+    
+    // Comment lines keep proxies from closing idle streams and reveal dead clients
+    if (millis() - lastEventKeepalive >= WEB_SSE_KEEPALIVE_MS) {
+        lastEventKeepalive = millis();
+        broadcastEvent(": ping\n\n", 8);
+    }
+}
+
+void WebServerManager::broadcastEvent(const char* event, size_t length) {
+    for (int i = 0; i < WEB_SSE_MAX_CLIENTS; i++) {
+        if (!eventClients[i].connected()) {
+            continue;
+        }
+        if (eventClients[i].write((const uint8_t*)event, length) != length) {
+            eventClients[i].stop();
+            LOG_D("Web", "Event stream %d closed", i);
+        }
+    }
 }
@@ -1,5 +1,7 @@
 #include "WiFiManager.h"
 #include <esp_system.h>
+#include "Logger.h"
+#include "Metrics.h"
 
 // Configuration variables (can be modified at runtime)
 static unsigned long reconnectInterval = RECONNECT_INTERVAL_MS;
@@ -25,8 +27,8 @@ void WiFiManager::begin(const String& ssid, const String& password) {
     this->ssid = ssid;
     this->password = password;
     
-    Serial.println("[WiFiManager] Initializing WiFi...");
-    Serial.println("[WiFiManager] SSID: " + ssid);
+    LOG_I("WiFiManager", "Initializing WiFi...");
+    LOG_I("WiFiManager", "SSID: %s", ssid.c_str());
     
     // Set WiFi mode
     WiFi.mode(WIFI_STA);
@@ -41,19 +43,17 @@ void WiFiManager::begin(const String& ssid, const String& password) {
     while (WiFi.status() != WL_CONNECTED && 
            (millis() - startTime) < INITIAL_CONNECT_TIMEOUT_MS) {
         delay(500);
-        Serial.print(".");
     }
     
     if (WiFi.status() == WL_CONNECTED) {
+        metricWifiConnectDuration.observe((millis() - startTime) * 1000);
         handleStateChange(WiFiState::CONNECTED);
-        Serial.println();
-        Serial.println("[WiFiManager] Connected successfully!");
-        Serial.println("[WiFiManager] IP: " + WiFi.localIP().toString());
-        Serial.println("[WiFiManager] Signal: " + String(WiFi.RSSI()) + " dBm");
+        LOG_I("WiFiManager", "Connected successfully!");
+        LOG_I("WiFiManager", "IP: %s", WiFi.localIP().toString().c_str());
+        LOG_I("WiFiManager", "Signal: %d dBm", (int)WiFi.RSSI());
     } else {
         handleStateChange(WiFiState::DISCONNECTED);
-        Serial.println();
-        Serial.println("[WiFiManager] Initial connection failed, will retry...");
+        LOG_W("WiFiManager", "Initial connection failed, will retry...");
     }
     
     isInitialized = true;
@@ -82,7 +82,7 @@ void WiFiManager::loop() {
     
     // Handle system restart if max attempts reached
     if (currentState == WiFiState::RESTART_PENDING) {
-        Serial.println("[WiFiManager] Restarting system in 5 seconds...");
+        LOG_W("WiFiManager", "Restarting system in 5 seconds...");
         delay(5000);
         restartSystem();
     }
@@ -94,6 +94,9 @@ void WiFiManager::checkConnection() {
     switch (status) {
         case WL_CONNECTED:
             if (currentState != WiFiState::CONNECTED) {
+                if (reconnectAttempts > 0) {
+                    metricWifiConnectDuration.observe((millis() - lastReconnectAttempt) * 1000);
+                }
                 handleStateChange(WiFiState::CONNECTED);
                 resetReconnectCounter();
             }
@@ -104,7 +107,8 @@ void WiFiManager::checkConnection() {
         case WL_CONNECTION_LOST:
         case WL_DISCONNECTED:
             if (currentState == WiFiState::CONNECTED) {
-                Serial.println("[WiFiManager] Connection lost, starting reconnection...");
+                LOG_W("WiFiManager", "Connection lost, starting reconnection...");
+                metricWifiDisconnects.increment();
                 handleStateChange(WiFiState::DISCONNECTED);
             }
             break;
@@ -117,7 +121,7 @@ void WiFiManager::checkConnection() {
 
 void WiFiManager::performReconnect() {
     if (reconnectAttempts >= maxReconnectAttempts) {
-        Serial.println("[WiFiManager] Maximum reconnect attempts reached!");
+        LOG_E("WiFiManager", "Maximum reconnect attempts reached!");
         handleStateChange(WiFiState::FAILED);
         
         if (onMaxAttemptsReachedCallback) {
@@ -132,9 +136,9 @@ void WiFiManager::performReconnect() {
     
     reconnectAttempts++;
     lastReconnectAttempt = millis();
+    metricWifiReconnectAttempts.increment();
     
-    Serial.println("[WiFiManager] Reconnect attempt " + String(reconnectAttempts) + 
-                   "/" + String(maxReconnectAttempts));
+    LOG_I("WiFiManager", "Reconnect attempt %d/%d", reconnectAttempts, maxReconnectAttempts);
     
     if (onReconnectAttemptCallback) {
         onReconnectAttemptCallback(reconnectAttempts);
@@ -151,12 +155,10 @@ void WiFiManager::performReconnect() {
 void WiFiManager::handleStateChange(WiFiState newState) {
     if (currentState == newState) return;
     
-    WiFiState oldState = currentState;
     String oldStateStr = getStateString();
     currentState = newState;
     
-    Serial.println("[WiFiManager] State change: " + oldStateStr + 
-                   " -> " + getStateString());
+    LOG_I("WiFiManager", "State change: %s -> %s", oldStateStr.c_str(), getStateString().c_str());
     
     // Trigger callbacks
     switch (newState) {
@@ -179,30 +181,30 @@ void WiFiManager::handleStateChange(WiFiState newState) {
 }
 
 void WiFiManager::restartSystem() {
-    Serial.println("[WiFiManager] Performing system restart...");
-    Serial.flush();
+    LOG_W("WiFiManager", "Performing system restart...");
+    logger.flush();
     esp_restart();
 }
 
 // Configuration methods
 void WiFiManager::setReconnectInterval(unsigned long intervalMs) {
     reconnectInterval = intervalMs;
-    Serial.println("[WiFiManager] Reconnect interval set to " + String(intervalMs) + "ms");
+    LOG_I("WiFiManager", "Reconnect interval set to %lums", (unsigned long)intervalMs);
 }
 
 void WiFiManager::setCheckInterval(unsigned long intervalMs) {
     checkInterval = intervalMs;
-    Serial.println("[WiFiManager] Check interval set to " + String(intervalMs) + "ms");
+    LOG_I("WiFiManager", "Check interval set to %lums", (unsigned long)intervalMs);
 }
 
 void WiFiManager::setMaxReconnectAttempts(int maxAttempts) {
     maxReconnectAttempts = maxAttempts;
-    Serial.println("[WiFiManager] Max reconnect attempts set to " + String(maxAttempts));
+    LOG_I("WiFiManager", "Max reconnect attempts set to %d", maxAttempts);
 }
 
 void WiFiManager::enableSystemRestart(bool enable) {
     systemRestartEnabled = enable;
-    Serial.println("[WiFiManager] System restart " + String(enable ? "enabled" : "disabled"));
+    LOG_I("WiFiManager", "System restart %s", enable ? "enabled" : "disabled");
 }
 
 // Status methods
@@ -246,7 +248,7 @@ int WiFiManager::getSignalStrength() const {
 
 // Control methods
 void WiFiManager::forceReconnect() {
-    Serial.println("[WiFiManager] Forced reconnect requested");
+    LOG_I("WiFiManager", "Forced reconnect requested");
     reconnectAttempts = 0;
     lastReconnectAttempt = 0;
     handleStateChange(WiFiState::DISCONNECTED);
@@ -254,7 +256,7 @@ void WiFiManager::forceReconnect() {
 
 void WiFiManager::resetReconnectCounter() {
     if (reconnectAttempts > 0) {
-        Serial.println("[WiFiManager] Reconnect counter reset");
+        LOG_I("WiFiManager", "Reconnect counter reset");
         reconnectAttempts = 0;
     }
 }
@@ -278,28 +280,22 @@ void WiFiManager::setOnMaxAttemptsReached(std::function<void()> callback) {
 
 // Utility methods
 void WiFiManager::printStatus() const {
-    Serial.println("=== WiFiManager Status ===");
-    Serial.println("State: " + getStateString());
-    Serial.println("Connected: " + String(isConnected() ? "Yes" : "No"));
-    Serial.println("SSID: " + ssid);
-    Serial.println("IP: " + getLocalIP());
-    Serial.println("Signal: " + String(getSignalStrength()) + " dBm");
-    Serial.println("Reconnect attempts: " + String(reconnectAttempts) + "/" + String(maxReconnectAttempts));
-    Serial.println("==========================");
+    LOG_I("WiFiManager", "State: %s, connected: %s", getStateString().c_str(), isConnected() ? "Yes" : "No");
+    LOG_I("WiFiManager", "SSID: %s, IP: %s, signal: %d dBm", ssid.c_str(), getLocalIP().c_str(), getSignalStrength());
+    LOG_I("WiFiManager", "Reconnect attempts: %d/%d", reconnectAttempts, maxReconnectAttempts);
 }
 
 void WiFiManager::scanNetworks() const {
-    Serial.println("[WiFiManager] Scanning for networks...");
+    LOG_I("WiFiManager", "Scanning for networks...");
     int n = WiFi.scanNetworks();
     
     if (n == 0) {
-        Serial.println("[WiFiManager] No networks found");
+        LOG_I("WiFiManager", "No networks found");
     } else {
-        Serial.println("[WiFiManager] Found " + String(n) + " networks:");
+        LOG_I("WiFiManager", "Found %d networks:", n);
         for (int i = 0; i < n; ++i) {
-            Serial.println("  " + String(i + 1) + ": " + WiFi.SSID(i) + 
-                          " (" + String(WiFi.RSSI(i)) + " dBm) " +
-                          (WiFi.encryptionType(i) == WIFI_AUTH_OPEN ? "[Open]" : "[Secured]"));
+            LOG_I("WiFiManager", "  %d: %s (%d dBm) %s", i + 1, WiFi.SSID(i).c_str(), (int)WiFi.RSSI(i),
+                  WiFi.encryptionType(i) == WIFI_AUTH_OPEN ? "[Open]" : "[Secured]");
         }
     }
     WiFi.scanDelete();
@@ -9,6 +9,11 @@
 #include "BluetoothManager.h"
 #include "WebServerManager.h"
 #include "WiFiManager.h"
+#include "PollScheduler.h"
+#include "AcquisitionTask.h"
+#include "LoopScheduler.h"
+#include "TimeSeriesLog.h"
+#include "Logger.h"
 
 
 // Global objects
@@ -17,6 +22,10 @@ MqttClient mqttClient;
 OTAManager otaManager;
 BluetoothManager bluetoothManager;
 WebServerManager webServerManager;
+PollScheduler pollScheduler;
+AcquisitionTask acquisitionTask(bluetoothManager, pollScheduler);
+LoopScheduler loopScheduler;
+TimeSeriesLog timeSeriesLog;
 
 // M5Stack Stamp S3 pin definitions
 #define LED_PIN 21        // RGB LED pin (WS2812B)
@@ -34,8 +43,8 @@ CRGB COLOR_YELLOW = CRGB::Yellow;
 CRGB COLOR_OFF = CRGB::Black;
 
 // State variables
-unsigned long lastScanTime = 0;
 unsigned long lastWatchdogFeed = 0;
+bool acquisitionWasPolling = false;
 
 // Button state
 bool lastButtonState = HIGH;
@@ -48,9 +57,9 @@ void setupWatchdog() {
     if (WATCHDOG_ENABLED) {
         esp_task_wdt_init(WATCHDOG_TIMEOUT_MS / 1000, true); // Convert to seconds
         esp_task_wdt_add(NULL); // Add current task to watchdog
-        Serial.println("[Main] Watchdog timer enabled (" + String(WATCHDOG_TIMEOUT_MS / 1000) + "s timeout)");
+        LOG_I("Main", "Watchdog timer enabled (%ds timeout)", WATCHDOG_TIMEOUT_MS / 1000);
     } else {
-        Serial.println("[Main] Watchdog timer disabled");
+        LOG_I("Main", "Watchdog timer disabled");
     }
 }
 
@@ -64,25 +73,6 @@ void feedWatchdog() {
     }
 }
 
-bool executeWithTimeout(std::function<bool()> operation, unsigned long timeoutMs, const String& operationName) {
-    unsigned long startTime = millis();
-    Serial.println("[Timeout] Starting " + operationName + " (timeout: " + String(timeoutMs) + "ms)");
-    
-    while ((millis() - startTime) < timeoutMs) {
-        feedWatchdog(); // Keep watchdog happy during operation
-        
-        if (operation()) {
-            Serial.println("[Timeout] " + operationName + " completed successfully");
-            return true;
-        }
-        
-        delay(100); // Small delay to prevent tight loop
-    }
-    
-    Serial.println("[Timeout] " + operationName + " timed out after " + String(timeoutMs) + "ms");
-    return false;
-}
-
 // LED control functions
 void setLED(CRGB color) {
     if (LED_ENABLED) {
@@ -91,6 +81,17 @@ void setLED(CRGB color) {
     }
 }
 
+void showStatusLED() {
+    // Show status LED based on WiFi and MQTT connection status
+    if (wifiManager.isConnected() && mqttClient.isConnected()) {
+        setLED(COLOR_GREEN);
+    } else if (wifiManager.isConnected()) {
+        setLED(COLOR_YELLOW);
+    } else {
+        setLED(COLOR_RED);
+    }
+}
+
 void updateButton() {
     bool currentButtonState = digitalRead(BUTTON_PIN);
     
@@ -120,27 +121,30 @@ void setupWiFi() {
     // Set up WiFi callbacks for status indication
     wifiManager.setOnConnected([]() {
         setLED(COLOR_GREEN);
-        Serial.println("[Main] WiFi connected" + String(LED_ENABLED ? " - LED set to GREEN" : ""));
+        LOG_I("Main", "WiFi connected%s", LED_ENABLED ? " - LED set to GREEN" : "");
     });
     
     wifiManager.setOnDisconnected([]() {
         setLED(COLOR_RED);
-        Serial.println("[Main] WiFi disconnected" + String(LED_ENABLED ? " - LED set to RED" : ""));
+        LOG_W("Main", "WiFi disconnected%s", LED_ENABLED ? " - LED set to RED" : "");
     });
     
     wifiManager.setOnReconnectAttempt([](int attempt) {
         setLED(COLOR_YELLOW);
-        Serial.println("[Main] WiFi reconnect attempt " + String(attempt) + String(LED_ENABLED ? " - LED set to YELLOW" : ""));
+        LOG_I("Main", "WiFi reconnect attempt %d%s", attempt, LED_ENABLED ? " - LED set to YELLOW" : "");
     });
     
     wifiManager.setOnMaxAttemptsReached([]() {
         setLED(COLOR_RED);
-        Serial.println("[Main] WiFi max attempts reached - System will restart!" + String(LED_ENABLED ? " - LED set to RED" : ""));
+        LOG_E("Main", "WiFi max attempts reached - System will restart!%s", LED_ENABLED ? " - LED set to RED" : "");
     });
     
     // Initialize WiFi with credentials from config
     setLED(COLOR_YELLOW);
     wifiManager.begin(WIFI_SSID, WIFI_PASSWORD);
+    
+    // UTC from NTP, the time-series log skips samples until the clock is set
+    configTime(0, 0, NTP_SERVER);
 }
 
 void setupMQTT() {
@@ -155,6 +159,7 @@ void setupOTA() {
     // Set up OTA callbacks
     otaManager.setOnStart([]() {
         setLED(COLOR_YELLOW);
+        timeSeriesLog.flush();
     });
     
     otaManager.setOnEnd([]() {
@@ -190,46 +195,113 @@ void setupBLE() {
     });
 }
 
-void readBatteryData(const String& macAddress) {
-    BatteryData batteryData;
+bool handleBatteryData(int batteryIndex, bool success, const BatteryData& batteryData) {
+    const String& macAddress = BATTERY_MAC_ADDRESSES[batteryIndex];
     
     try {
-        // Use BluetoothManager to read battery data
-        bool success = bluetoothManager.readBatteryData(macAddress, batteryData);
-        
         // Store data for web display and MQTT
         if (success && batteryData.dataValid) {
-            for (int i = 0; i < BATTERY_COUNT; i++) {
-                if (BATTERY_MAC_ADDRESSES[i] == macAddress) {
-                    // Update web server data with new values
-                    webServerManager.updateBatteryData(i, batteryData);
-                    webServerManager.setBatteryDataUpdateTime(i, millis());
-                    Serial.println("Battery data updated for battery " + String(i + 1));
-                    break;
-                }
-            }
+            // Update web server data with new values
+            webServerManager.updateBatteryData(batteryIndex, batteryData);
+            webServerManager.setBatteryDataUpdateTime(batteryIndex, millis());
+            uint32_t now = time(nullptr);
+            timeSeriesLog.append(batteryIndex, batteryData, now);
+            LOG_I("Main", "Battery data updated for battery %d", batteryIndex + 1);
             
-            // Publish battery data to MQTT
-            if (mqttClient.isConnected()) {
-                mqttClient.publishBatteryData(batteryData);
-            }
-        } else {
-            // Battery read failed - preserve existing data but don't update timestamp
-            // This allows the UI to detect the battery as offline while keeping last known values
-            Serial.println("Failed to read battery data from " + macAddress + " - preserving last known values");
+            // Publish battery data to MQTT, queued while the broker is unreachable
+            mqttClient.publishBatteryData(batteryData, now);
+            return true;
         }
+        
+        // Battery read failed - preserve existing data but don't update timestamp
+        // This allows the UI to detect the battery as offline while keeping last known values
+        LOG_W("Main", "Failed to read battery data from %s - preserving last known values", macAddress.c_str());
     } catch (...) {
-        Serial.println("Exception during battery data reading for " + macAddress + " - preserving last known values");
+        LOG_E("Main", "Exception during battery data handling for %s - preserving last known values", macAddress.c_str());
     }
+    return false;
 }
 
 void setupWebServer() {
+    if (TSLOG_ENABLED) {
+        webServerManager.setTimeSeriesLog(&timeSeriesLog);
+    }
+    webServerManager.setLoopScheduler(&loopScheduler);
+    webServerManager.setAcquisitionTask(&acquisitionTask);
+    webServerManager.setMqttClient(&mqttClient);
+    webServerManager.setBluetoothManager(&bluetoothManager);
     webServerManager.begin();
 }
 
+// Jobs of loop(), run by the cooperative scheduler
+void runWiFiJob() {
+    // WiFi management (reconnection, monitoring, etc.)
+    wifiManager.loop();
+}
+
+void runMqttJob() {
+    mqttClient.loop();
+}
+
+void runOtaJob() {
+    otaManager.loop();
+}
+
+void runButtonJob() {
+    updateButton();
+    
+    // Handle button press for manual scan
+    if (wasButtonPressed()) {
+        acquisitionTask.requestImmediate(); // Force immediate scan
+        LOG_I("Main", "Manual scan triggered by button press");
+    }
+}
+
+void runTimeSeriesLogJob() {
+    timeSeriesLog.loop();
+}
+
+void runStatusLedJob() {
+    // Indicate scanning while the acquisition task reads batteries
+    bool acquisitionPolling = acquisitionTask.isPolling();
+    if (acquisitionPolling != acquisitionWasPolling) {
+        if (acquisitionPolling) {
+            setLED(COLOR_BLUE);
+        } else {
+            showStatusLED();
+        }
+        acquisitionWasPolling = acquisitionPolling;
+    }
+}
+
+void setupJobs() {
+    //                   name      function               period  budget (ms)
+    loopScheduler.addJob("mqtt",   runMqttJob,            50,     50);
+    loopScheduler.addJob("ota",    runOtaJob,             100,    20);
+    loopScheduler.addJob("wifi",   runWiFiJob,            250,    20);
+    loopScheduler.addJob("button", runButtonJob,          10,     2);
+    loopScheduler.addJob("led",    runStatusLedJob,       100,    5);
+    loopScheduler.addJob("tslog",  runTimeSeriesLogJob,   1000,   50);
+}
+
+void processAcquisitionEvents() {
+    // Hand presence reports and samples from the acquisition task to web and MQTT
+    AcquisitionEvent event;
+    while (acquisitionTask.receive(event)) {
+        if (event.type == AcquisitionEvent::PRESENCE) {
+            webServerManager.updateBatteryPresence(event.batteryIndex, event.present, event.rssi);
+            mqttClient.publishPresence(event.batteryIndex, event.present, event.rssi);
+        } else {
+            handleBatteryData(event.batteryIndex, event.success, event.batteryData);
+        }
+        feedWatchdog();
+    }
+}
+
 void setup() {
     Serial.begin(115200);
-    Serial.println("[Main] System starting...");
+    logger.begin();
+    LOG_I("Main", "System starting...");
     
     // Initialize Watchdog Timer first
     setupWatchdog();
@@ -243,153 +315,66 @@ void setup() {
         FastLED.addLeds<WS2812B, LED_PIN, GRB>(leds, NUM_LEDS);
         FastLED.setBrightness(50); // Set brightness to 50%
         setLED(COLOR_RED);
-        Serial.println("[Main] LED indicators enabled");
+        LOG_I("Main", "LED indicators enabled");
     } else {
-        Serial.println("[Main] LED indicators disabled");
+        LOG_I("Main", "LED indicators disabled");
     }
     
     feedWatchdog();
     
     // Setup WiFi with timeout handling
-    Serial.println("[Main] Setting up WiFi...");
+    LOG_I("Main", "Setting up WiFi...");
     setupWiFi();
     feedWatchdog();
     
-    // Setup MQTT with timeout handling
-    Serial.println("[Main] Setting up MQTT...");
-    executeWithTimeout([]() {
-        setupMQTT();
-        return true; // MQTT setup doesn't have a return value, assume success
-    }, MANAGER_TIMEOUT_MS, "MQTT Setup");
+    // Setup MQTT
+    LOG_I("Main", "Setting up MQTT...");
+    setupMQTT();
     feedWatchdog();
     
-    // Setup OTA with timeout handling
-    Serial.println("[Main] Setting up OTA...");
-    executeWithTimeout([]() {
-        setupOTA();
-        return true; // OTA setup doesn't have a return value, assume success
-    }, MANAGER_TIMEOUT_MS, "OTA Setup");
+    // Setup OTA
+    LOG_I("Main", "Setting up OTA...");
+    setupOTA();
     feedWatchdog();
     
-    // Setup BLE with timeout handling
-    Serial.println("[Main] Setting up BLE...");
-    executeWithTimeout([]() {
-        setupBLE();
-        return true; // BLE setup doesn't have a return value, assume success
-    }, MANAGER_TIMEOUT_MS, "BLE Setup");
+    // Setup time-series log
+    LOG_I("Main", "Setting up time-series log...");
+    timeSeriesLog.begin();
     feedWatchdog();
     
-    // Setup Web Server with timeout handling
+    // Setup BLE
+    LOG_I("Main", "Setting up BLE...");
+    setupBLE();
+    feedWatchdog();
+    
+    // Setup Web Server
     if (wifiManager.isConnected()) {
-        Serial.println("[Main] Setting up Web Server...");
-        executeWithTimeout([]() {
-            setupWebServer();
-            return true; // WebServer setup doesn't have a return value, assume success
-        }, MANAGER_TIMEOUT_MS, "WebServer Setup");
-        Serial.println("Web server started at http://" + wifiManager.getLocalIP());
+        LOG_I("Main", "Setting up Web Server...");
+        setupWebServer();
+        LOG_I("Main", "Web server started at http://%s", wifiManager.getLocalIP().c_str());
     }
     feedWatchdog();
     
-    // Force first scan to happen soon
-    lastScanTime = millis() - SCAN_INTERVAL_MS + 5000; // Start first scan in 5 seconds
+    // First battery polls start in 5 seconds, all BLE work runs in the acquisition task from here on
+    pollScheduler.begin(5000);
+    if (!acquisitionTask.begin()) {
+        LOG_E("Main", "Battery acquisition could not be started");
+    }
+    
+    setupJobs();
     
     setLED(COLOR_GREEN);
-    Serial.println("[Main] System initialization completed");
+    LOG_I("Main", "System initialization completed");
 }
 
 void loop() {
     // Feed watchdog at the beginning of each loop iteration
     feedWatchdog();
     
-    // Update button state
-    updateButton();
-    
-    // Handle WiFi management (reconnection, monitoring, etc.) with timeout
-    executeWithTimeout([]() {
-        wifiManager.loop();
-        return true;
-    }, MANAGER_TIMEOUT_MS, "WiFi Manager Loop");
-    
-    // Handle MQTT with timeout
-    executeWithTimeout([]() {
-        mqttClient.loop();
-        return true;
-    }, MANAGER_TIMEOUT_MS, "MQTT Loop");
-    
-    // Handle OTA with timeout
-    executeWithTimeout([]() {
-        otaManager.loop();
-        return true;
-    }, MANAGER_TIMEOUT_MS, "OTA Loop");
-    
-    // Handle Web Server with timeout
-    executeWithTimeout([]() {
-        webServerManager.handleClient();
-        return true;
-    }, MANAGER_TIMEOUT_MS, "WebServer Loop");
-    
-    // Check if it's time to scan batteries
-    unsigned long currentTime = millis();
-    unsigned long timeSinceLastScan = currentTime - lastScanTime;
+    loopScheduler.runDue();
     
-    if (timeSinceLastScan >= SCAN_INTERVAL_MS) {
-        lastScanTime = currentTime;
-        
-        // Indicate scanning
-        setLED(COLOR_BLUE);
-        
-        // Read data from all batteries in sequence with timeout handling
-        Serial.println("Starting battery scan cycle...");
-        
-        for (int i = 0; i < BATTERY_COUNT; i++) {
-            String macAddress = BATTERY_MAC_ADDRESSES[i];
-            
-            Serial.println("Scanning battery " + String(i + 1) + ": " + macAddress);
-            
-            // Execute battery read with timeout
-            bool success = executeWithTimeout([macAddress]() {
-                readBatteryData(macAddress);
-                return true; // Assume success for now
-            }, CONNECTION_TIMEOUT_MS, "Battery " + String(i + 1) + " Read");
-            
-            if (!success) {
-                Serial.println("Battery " + String(i + 1) + " scan timed out");
-            }
-            
-            feedWatchdog(); // Feed watchdog between battery scans
-            
-            // Add delay between battery scans to prevent BLE conflicts
-            if (i < BATTERY_COUNT - 1) {
-                unsigned long delayStart = millis();
-                while (millis() - delayStart < 2000) {
-                    feedWatchdog();
-                    delay(100);
-                }
-            }
-        }
-        
-        Serial.println("Battery scan cycle completed.");
-        
-        // Show status LED based on WiFi and MQTT connection status
-        if (wifiManager.isConnected() && mqttClient.isConnected()) {
-            setLED(COLOR_GREEN);
-        } else if (wifiManager.isConnected()) {
-            setLED(COLOR_YELLOW);
-        } else {
-            setLED(COLOR_RED);
-        }
-    }
-    
-    // Handle button press for manual scan
-    if (wasButtonPressed()) {
-        lastScanTime = 0; // Force immediate scan
-        Serial.println("[Main] Manual scan triggered by button press");
-    }
-    
-    // Small delay with watchdog feeding
-    unsigned long delayStart = millis();
-    while (millis() - delayStart < 100) {
-        feedWatchdog();
-        delay(10);
+    // Sleep until the next job deadline, a sample from the acquisition task wakes the loop early
+    if (acquisitionTask.waitForEvent(loopScheduler.getMsUntilNextJob())) {
+        processAcquisitionEvents();
     }
 }
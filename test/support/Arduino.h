@@ -0,0 +1,130 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Minimal Arduino core for the native test environment. Only what the
+// modules under test use. Time is a fake clock the tests advance
+// themselves; threaded benchmarks switch to the host clock with
+// nativeUseHostClock(), then delay() really sleeps.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+using std::min;
+using std::max;
+
+#define PROGMEM
+#define PGM_P const char*
+#define constrain(value, low, high) ((value) < (low) ? (low) : ((value) > (high) ? (high) : (value)))
+
+inline unsigned long& nativeMillis() {
+    static unsigned long now = 0;
+    return now;
+}
+
+inline bool& nativeHostClock() {
+    static bool enabled = false;
+    return enabled;
+}
+
+inline void nativeUseHostClock() {
+    nativeHostClock() = true;
+}
+
+// Host time since the first call, so it starts near zero like after a reset
+inline unsigned long nativeHostMicros() {
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline unsigned long millis() { return nativeHostClock() ? nativeHostMicros() / 1000UL : nativeMillis(); }
+inline unsigned long micros() { return nativeHostClock() ? nativeHostMicros() : nativeMillis() * 1000UL; }
+
+inline void delay(unsigned long ms) {
+    if (nativeHostClock()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    } else {
+        nativeMillis() += ms;
+    }
+}
+
+inline void yield() {}
+
+// Deterministic stand-in for the hardware RNG, tests reseed it to vary jitter
+inline uint32_t& nativeRandomState() {
+    static uint32_t state = 2463534242UL;
+    return state;
+}
+
+inline uint32_t esp_random() {
+    uint32_t& x = nativeRandomState();
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+class String {
+public:
+    String() {}
+    String(const char* text) : value(text ? text : "") {}
+    String(const std::string& text) : value(text) {}
+    String(int number) : value(std::to_string(number)) {}
+    
+    const char* c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.size(); }
+    long toInt() const { return strtol(value.c_str(), nullptr, 10); }
+    bool operator==(const String& other) const { return value == other.value; }
+    bool operator==(const char* other) const { return value == other; }
+    bool operator!=(const String& other) const { return value != other.value; }
+    bool operator!=(const char* other) const { return value != other; }
+    String operator+(const String& other) const { return String(value + other.value); }
+    String& operator+=(const String& other) { value += other.value; return *this; }
+    
+    void replace(const char* find, const char* replacement) {
+        size_t findLength = strlen(find);
+        size_t replacementLength = strlen(replacement);
+        for (size_t at = value.find(find); findLength > 0 && at != std::string::npos;
+             at = value.find(find, at + replacementLength)) {
+            value.replace(at, findLength, replacement);
+        }
+    }
+    
+    void toLowerCase() {
+        for (size_t i = 0; i < value.size(); i++) {
+            value[i] = tolower((unsigned char)value[i]);
+        }
+    }
+
+private:
+    std::string value;
+};
+
+inline String operator+(const char* text, const String& other) {
+    return String(text) + other;
+}
+
+// Serial output goes to stdout
+class NativeSerial {
+public:
+    void println(const char* text) { puts(text); }
+    size_t write(const uint8_t* data, size_t length) { return fwrite(data, 1, length, stdout); }
+    void flush() { fflush(stdout); }
+};
+
+inline NativeSerial& nativeSerial() {
+    static NativeSerial instance;
+    return instance;
+}
+
+static NativeSerial& Serial = nativeSerial();
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,590 @@
+#ifndef NATIVE_BLE_DEVICE_H
+#define NATIVE_BLE_DEVICE_H
+
+// Host stand-in for the Bluedroid BLE client API, talking to simulated JBD
+// BMS peripherals. A stack thread plays the BLE task: scan results,
+// descriptor write responses, notifications and link drops reach the code
+// under test through the same callbacks and GATT event hook as on the
+// ESP32. Connection setup blocks the caller like BLEClient::connect does.
+// All latencies are host time, tests call nativeUseHostClock() first.
+
+#include <Arduino.h>
+#include "esp_err.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+typedef uint8_t esp_bd_addr_t[6];
+typedef uint8_t esp_gatt_if_t;
+
+typedef enum {
+    ESP_GATTC_NOTIFY_EVT,
+    ESP_GATTC_WRITE_DESCR_EVT,
+    ESP_GATTC_REG_FOR_NOTIFY_EVT,
+    ESP_GATTC_DISCONNECT_EVT
+} esp_gattc_cb_event_t;
+
+typedef enum {
+    ESP_GATT_OK = 0,
+    ESP_GATT_ERROR = 0x85
+} esp_gatt_status_t;
+
+typedef enum {
+    ESP_GATT_WRITE_TYPE_NO_RSP = 1,
+    ESP_GATT_WRITE_TYPE_RSP = 2
+} esp_gatt_write_type_t;
+
+typedef enum {
+    ESP_GATT_AUTH_REQ_NONE = 0
+} esp_gatt_auth_req_t;
+
+typedef union {
+    struct {
+        uint16_t conn_id;
+        esp_bd_addr_t remote_bda;
+        uint16_t handle;
+        uint16_t value_len;
+        uint8_t* value;
+        bool is_notify;
+    } notify;
+    struct {
+        esp_gatt_status_t status;
+        uint16_t conn_id;
+        uint16_t handle;
+        uint16_t offset;
+    } write;
+} esp_ble_gattc_cb_param_t;
+
+typedef void (*gattc_event_handler)(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t* param);
+
+class BLEUUID {
+public:
+    BLEUUID(const char* uuid) : text(uuid) {
+        for (size_t i = 0; i < text.size(); i++) {
+            text[i] = tolower((unsigned char)text[i]);
+        }
+    }
+    
+    // 16-bit UUIDs expand on the Bluetooth base UUID
+    BLEUUID(uint16_t uuid) {
+        char expanded[40];
+        snprintf(expanded, sizeof(expanded), "0000%04x-0000-1000-8000-00805f9b34fb", uuid);
+        text = expanded;
+    }
+    
+    bool equals(const BLEUUID& other) const { return text == other.text; }
+    std::string toString() const { return text; }
+
+private:
+    std::string text;
+};
+
+// Keeps the text as configured, so placeholder addresses still name a peripheral
+class BLEAddress {
+public:
+    BLEAddress() { memset(native, 0, sizeof(native)); }
+    
+    BLEAddress(const char* address) : text(address) {
+        unsigned int bytes[6];
+        memset(native, 0, sizeof(native));
+        if (sscanf(address, "%2x:%2x:%2x:%2x:%2x:%2x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) == 6) {
+            for (int i = 0; i < 6; i++) {
+                native[i] = bytes[i];
+            }
+        }
+        for (size_t i = 0; i < text.size(); i++) {
+            text[i] = tolower((unsigned char)text[i]);
+        }
+    }
+    
+    esp_bd_addr_t* getNative() { return &native; }
+    std::string toString() const { return text; }
+    bool equals(const BLEAddress& other) const { return text == other.text; }
+
+private:
+    std::string text;
+    esp_bd_addr_t native;
+};
+
+class BLERemoteDescriptor {
+public:
+    explicit BLERemoteDescriptor(uint16_t handle) : handle(handle) {}
+    uint16_t getHandle() { return handle; }
+
+private:
+    uint16_t handle;
+};
+
+class BLERemoteCharacteristic {
+public:
+    BLERemoteCharacteristic(const char* uuid, uint16_t handle, BLERemoteDescriptor* cccd)
+        : uuid(uuid), handle(handle), cccd(cccd) {}
+    
+    bool canNotify() { return cccd != nullptr; }
+    uint16_t getHandle() { return handle; }
+    BLEUUID getUUID() { return uuid; }
+    
+    BLERemoteDescriptor* getDescriptor(BLEUUID descriptorUuid) {
+        return (cccd && descriptorUuid.equals(BLEUUID((uint16_t)0x2902))) ? cccd : nullptr;
+    }
+
+private:
+    BLEUUID uuid;
+    uint16_t handle;
+    BLERemoteDescriptor* cccd;
+};
+
+// The BMS service: commands go to FF02, responses come as notifications on FF01
+class BLERemoteService {
+public:
+    static const uint16_t WRITE_HANDLE = 0x0010;
+    static const uint16_t READ_HANDLE = 0x0012;
+    static const uint16_t CCCD_HANDLE = 0x0013;
+    
+    BLERemoteService()
+        : cccd(CCCD_HANDLE)
+        , write("0000ff02-0000-1000-8000-00805f9b34fb", WRITE_HANDLE, nullptr)
+        , read("0000ff01-0000-1000-8000-00805f9b34fb", READ_HANDLE, &cccd) {}
+    
+    BLEUUID getUUID() { return BLEUUID("0000ff00-0000-1000-8000-00805f9b34fb"); }
+    
+    BLERemoteCharacteristic* getCharacteristic(const char* uuid) {
+        if (BLEUUID(uuid).equals(write.getUUID())) {
+            return &write;
+        }
+        if (BLEUUID(uuid).equals(read.getUUID())) {
+            return &read;
+        }
+        return nullptr;
+    }
+
+private:
+    BLERemoteDescriptor cccd;
+    BLERemoteCharacteristic write;
+    BLERemoteCharacteristic read;
+};
+
+class BLEClient;
+
+class BLEClientCallbacks {
+public:
+    virtual ~BLEClientCallbacks() {}
+    virtual void onConnect(BLEClient* client) = 0;
+    virtual void onDisconnect(BLEClient* client) = 0;
+};
+
+class BLEClient {
+public:
+    BLEClient(esp_gatt_if_t gattcIf, uint16_t connId)
+        : gattcIf(gattcIf), connId(connId), connected(false), rssi(0), callbacks(nullptr) {}
+    
+    bool connect(BLEAddress address);
+    void disconnect();
+    bool isConnected() { return connected; }
+    BLERemoteService* getService(const char* uuid);
+    void setClientCallbacks(BLEClientCallbacks* callbacks) { this->callbacks = callbacks; }
+    uint16_t getConnId() { return connId; }
+    esp_gatt_if_t getGattcIf() { return gattcIf; }
+    BLEAddress getPeerAddress() { return peer; }
+    int getRssi() { return connected ? rssi : 0; }
+
+private:
+    friend class NativeBleStack;
+    
+    esp_gatt_if_t gattcIf;
+    uint16_t connId;
+    std::atomic<bool> connected;
+    int rssi;
+    BLEAddress peer;
+    BLEClientCallbacks* callbacks;
+    BLERemoteService service;
+    
+    // The BMS answers one command after the other, a pipelined command waits for the previous response
+    std::chrono::steady_clock::time_point busyUntil;
+};
+
+class BLEAdvertisedDevice {
+public:
+    BLEAdvertisedDevice(const BLEAddress& address, int rssi) : address(address), rssi(rssi) {}
+    
+    BLEAddress getAddress() { return address; }
+    int getRSSI() { return rssi; }
+    bool haveRSSI() { return true; }
+
+private:
+    BLEAddress address;
+    int rssi;
+};
+
+class BLEAdvertisedDeviceCallbacks {
+public:
+    virtual ~BLEAdvertisedDeviceCallbacks() {}
+    virtual void onResult(BLEAdvertisedDevice advertisedDevice) = 0;
+};
+
+class BLEScanResults {
+};
+
+class BLEScan {
+public:
+    BLEScan() : callbacks(nullptr), generation(0) {}
+    
+    void setAdvertisedDeviceCallbacks(BLEAdvertisedDeviceCallbacks* callbacks, bool wantDuplicates = false, bool shouldParse = true) {
+        this->callbacks = callbacks;
+    }
+    void setActiveScan(bool active) {}
+    void setInterval(uint16_t interval) {}
+    void setWindow(uint16_t window) {}
+    
+    // Non-blocking with a completion callback, like the ESP32 scan
+    bool start(uint32_t durationSeconds, void (*complete)(BLEScanResults), bool continuePrevious);
+    
+    // A stopped window never completes
+    void stop() { generation++; }
+    void clearResults() {}
+
+private:
+    BLEAdvertisedDeviceCallbacks* callbacks;
+    std::atomic<uint32_t> generation;
+};
+
+// Behaviour of a simulated BMS, every link to it gets its own instance
+struct NativeBms {
+    bool advertising;               // Seen by scans and accepts connections
+    int rssi;
+    unsigned long connectMs;        // connect() blocks this long
+    unsigned long discoveryMs;      // getService() blocks this long
+    unsigned long responseMs;       // From a command write to the first notification
+    unsigned long fragmentGapMs;    // Between the notifications of one response
+    size_t fragmentSize;            // Notification payload, 20 bytes with the default ATT MTU
+    std::atomic<uint32_t> commands; // Command writes received
+    
+    NativeBms()
+        : advertising(true), rssi(-60), connectMs(40), discoveryMs(60), responseMs(20)
+        , fragmentGapMs(5), fragmentSize(20), commands(0) {}
+};
+
+class NativeBleStack {
+public:
+    static NativeBleStack& instance() {
+        // Never destroyed, the stack thread may still be waiting at exit
+        static NativeBleStack* stack = new NativeBleStack();
+        return *stack;
+    }
+    
+    // Adds a BMS or returns the existing one, addresses compare case-insensitively
+    NativeBms& addBms(const char* address) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return peripherals[BLEAddress(address).toString()];
+    }
+    
+    void setScanWindowMs(unsigned long windowMs) { scanWindowMs = windowMs; }
+    
+    void setGattcHandler(gattc_event_handler handler) { gattcHandler = handler; }
+    
+    BLEClient* createClient() {
+        std::lock_guard<std::mutex> lock(mutex);
+        BLEClient* client = new BLEClient(clients.size() + 3, clients.size());
+        clients.push_back(client);
+        return client;
+    }
+    
+    NativeBms* findBms(const BLEAddress& address) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, NativeBms>::iterator found = peripherals.find(address.toString());
+        return found != peripherals.end() ? &found->second : nullptr;
+    }
+    
+    BLEClient* findClient(esp_gatt_if_t gattcIf) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < clients.size(); i++) {
+            if (clients[i]->gattcIf == gattcIf) {
+                return clients[i];
+            }
+        }
+        return nullptr;
+    }
+    
+    // Runs work on the stack thread after delayMs
+    void schedule(unsigned long delayMs, std::function<void()> work) {
+        scheduleAt(std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs), work);
+    }
+    
+    void scheduleAt(std::chrono::steady_clock::time_point due, std::function<void()> work) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Event event = {due, nextSequence++, work};
+        events.push(event);
+        if (!worker.joinable()) {
+            worker = std::thread(&NativeBleStack::run, this);
+            worker.detach();
+        }
+        changed.notify_all();
+    }
+    
+    void deliver(esp_gattc_cb_event_t event, BLEClient* client, esp_ble_gattc_cb_param_t& param) {
+        if (gattcHandler) {
+            gattcHandler(event, client->gattcIf, &param);
+        }
+    }
+    
+    // Queues the response frames of one command as notifications
+    void answer(BLEClient* client, NativeBms* bms, uint8_t cmd) {
+        std::vector<uint8_t> frame = responseFrame(cmd);
+        if (frame.empty()) {
+            return;
+        }
+        
+        std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now() + std::chrono::milliseconds(bms->responseMs);
+        if (client->busyUntil > due) {
+            due = client->busyUntil;
+        }
+        
+        for (size_t offset = 0; offset < frame.size(); offset += bms->fragmentSize) {
+            std::vector<uint8_t> fragment(frame.begin() + offset,
+                                          frame.begin() + std::min(frame.size(), offset + bms->fragmentSize));
+            scheduleAt(due, [this, client, fragment]() {
+                if (!client->connected) {
+                    return;
+                }
+                std::vector<uint8_t> value(fragment);
+                esp_ble_gattc_cb_param_t param;
+                memset(&param, 0, sizeof(param));
+                param.notify.conn_id = client->connId;
+                param.notify.handle = BLERemoteService::READ_HANDLE;
+                param.notify.value = value.data();
+                param.notify.value_len = value.size();
+                param.notify.is_notify = true;
+                deliver(ESP_GATTC_NOTIFY_EVT, client, param);
+            });
+            due += std::chrono::milliseconds(bms->fragmentGapMs);
+        }
+        client->busyUntil = due;
+    }
+    
+    void reportAdvertisers(BLEAdvertisedDeviceCallbacks* callbacks) {
+        std::vector<std::pair<std::string, int> > seen;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::map<std::string, NativeBms>::iterator it = peripherals.begin(); it != peripherals.end(); ++it) {
+                if (it->second.advertising) {
+                    seen.push_back(std::make_pair(it->first, it->second.rssi));
+                }
+            }
+        }
+        for (size_t i = 0; i < seen.size() && callbacks; i++) {
+            callbacks->onResult(BLEAdvertisedDevice(BLEAddress(seen[i].first.c_str()), seen[i].second));
+        }
+    }
+    
+    unsigned long getScanWindowMs(uint32_t durationSeconds) const {
+        return scanWindowMs > 0 ? scanWindowMs : durationSeconds * 1000UL;
+    }
+
+private:
+    struct Event {
+        std::chrono::steady_clock::time_point due;
+        uint64_t sequence;
+        std::function<void()> work;
+        
+        // Earliest first, same time in scheduling order
+        bool operator<(const Event& other) const {
+            return due != other.due ? due > other.due : sequence > other.sequence;
+        }
+    };
+    
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::priority_queue<Event> events;
+    uint64_t nextSequence;
+    std::thread worker;
+    std::map<std::string, NativeBms> peripherals;
+    std::vector<BLEClient*> clients;
+    gattc_event_handler gattcHandler;
+    unsigned long scanWindowMs;
+    
+    NativeBleStack() : nextSequence(0), gattcHandler(nullptr), scanWindowMs(0) {}
+    
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (events.empty()) {
+                changed.wait(lock);
+                continue;
+            }
+            if (events.top().due > std::chrono::steady_clock::now()) {
+                changed.wait_until(lock, events.top().due);
+                continue;
+            }
+            
+            std::function<void()> work = events.top().work;
+            events.pop();
+            lock.unlock();
+            work();
+            lock.lock();
+        }
+    }
+    
+    // Frames as the BMS sends them: DD cmd status length payload checksum(2) 77
+    static std::vector<uint8_t> responseFrame(uint8_t cmd) {
+        static const uint8_t BASIC_PAYLOAD[27] = {
+            0x05, 0x32,         // 13.30 V
+            0xFF, 0x9C,         // -1.00 A
+            0x13, 0x88,         // 50.00 Ah remaining
+            0x27, 0x10,         // 100.00 Ah nominal
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0x03,               // Both FETs on
+            0, 0x01,
+            0x0B, 0xA5,         // 298.1 K
+            0, 0
+        };
+        static const uint8_t CELL_PAYLOAD[8] = {
+            0x0C, 0xF8, 0x0C, 0xF9, 0x0C, 0xFA, 0x0C, 0xFB
+        };
+        
+        const uint8_t* payload;
+        uint8_t length;
+        if (cmd == 0x03) {
+            payload = BASIC_PAYLOAD;
+            length = sizeof(BASIC_PAYLOAD);
+        } else if (cmd == 0x04) {
+            payload = CELL_PAYLOAD;
+            length = sizeof(CELL_PAYLOAD);
+        } else {
+            return std::vector<uint8_t>();
+        }
+        
+        std::vector<uint8_t> frame;
+        uint16_t sum = length;
+        frame.push_back(0xDD);
+        frame.push_back(cmd);
+        frame.push_back(0x00);
+        frame.push_back(length);
+        for (int i = 0; i < length; i++) {
+            frame.push_back(payload[i]);
+            sum += payload[i];
+        }
+        uint16_t checksum = 0x10000 - sum;
+        frame.push_back(checksum >> 8);
+        frame.push_back(checksum & 0xFF);
+        frame.push_back(0x77);
+        return frame;
+    }
+};
+
+inline NativeBleStack& nativeBle() {
+    return NativeBleStack::instance();
+}
+
+inline bool BLEClient::connect(BLEAddress address) {
+    NativeBms* bms = nativeBle().findBms(address);
+    std::this_thread::sleep_for(std::chrono::milliseconds(bms ? bms->connectMs : 1000));
+    if (bms == nullptr || !bms->advertising) {
+        return false;
+    }
+    
+    peer = address;
+    rssi = bms->rssi;
+    busyUntil = std::chrono::steady_clock::now();
+    connected = true;
+    if (callbacks) {
+        callbacks->onConnect(this);
+    }
+    return true;
+}
+
+// Reports the drop before returning, so a session can be destroyed right after
+inline void BLEClient::disconnect() {
+    if (connected.exchange(false) && callbacks) {
+        callbacks->onDisconnect(this);
+    }
+}
+
+inline BLERemoteService* BLEClient::getService(const char* uuid) {
+    NativeBms* bms = nativeBle().findBms(peer);
+    if (!connected || bms == nullptr) {
+        return nullptr;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(bms->discoveryMs));
+    return BLEUUID(uuid).equals(service.getUUID()) ? &service : nullptr;
+}
+
+inline bool BLEScan::start(uint32_t durationSeconds, void (*complete)(BLEScanResults), bool continuePrevious) {
+    uint32_t window = ++generation;
+    BLEScan* scan = this;
+    nativeBle().schedule(1, [scan, window]() {
+        if (scan->generation == window) {
+            nativeBle().reportAdvertisers(scan->callbacks);
+        }
+    });
+    nativeBle().schedule(nativeBle().getScanWindowMs(durationSeconds), [scan, window, complete]() {
+        if (scan->generation == window && complete) {
+            complete(BLEScanResults());
+        }
+    });
+    return true;
+}
+
+inline esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattcIf, uint8_t* serverAddress, uint16_t handle) {
+    BLEClient* client = nativeBle().findClient(gattcIf);
+    return (client && client->isConnected() && handle == BLERemoteService::READ_HANDLE) ? ESP_OK : ESP_FAIL;
+}
+
+inline esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattcIf, uint16_t connId, uint16_t handle, uint16_t length,
+                                                uint8_t* value, esp_gatt_write_type_t writeType, esp_gatt_auth_req_t auth) {
+    BLEClient* client = nativeBle().findClient(gattcIf);
+    if (client == nullptr || !client->isConnected() || client->getConnId() != connId) {
+        return ESP_FAIL;
+    }
+    
+    // Unknown handles are answered with an error status, like stale cached handles on a real link
+    esp_gatt_status_t status = handle == BLERemoteService::CCCD_HANDLE ? ESP_GATT_OK : ESP_GATT_ERROR;
+    nativeBle().schedule(1, [client, handle, status]() {
+        esp_ble_gattc_cb_param_t param;
+        memset(&param, 0, sizeof(param));
+        param.write.status = status;
+        param.write.conn_id = client->getConnId();
+        param.write.handle = handle;
+        nativeBle().deliver(ESP_GATTC_WRITE_DESCR_EVT, client, param);
+    });
+    return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattcIf, uint16_t connId, uint16_t handle, uint16_t length,
+                                          uint8_t* value, esp_gatt_write_type_t writeType, esp_gatt_auth_req_t auth) {
+    BLEClient* client = nativeBle().findClient(gattcIf);
+    if (client == nullptr || !client->isConnected() || client->getConnId() != connId) {
+        return ESP_FAIL;
+    }
+    
+    NativeBms* bms = nativeBle().findBms(client->getPeerAddress());
+    if (bms == nullptr) {
+        return ESP_FAIL;
+    }
+    
+    // Read commands: DD A5 cmd 00 checksum(2) 77, anything else goes unanswered
+    bms->commands++;
+    if (handle == BLERemoteService::WRITE_HANDLE && length >= 7 && value[0] == 0xDD && value[1] == 0xA5) {
+        nativeBle().answer(client, bms, value[2]);
+    }
+    return ESP_OK;
+}
+
+class BLEDevice {
+public:
+    static void init(const std::string& deviceName) {}
+    static void setCustomGattcHandler(gattc_event_handler handler) { nativeBle().setGattcHandler(handler); }
+    static BLEClient* createClient() { return nativeBle().createClient(); }
+    
+    static BLEScan* getScan() {
+        static BLEScan scan;
+        return &scan;
+    }
+};
+
+#endif // NATIVE_BLE_DEVICE_H
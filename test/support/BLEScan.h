@@ -0,0 +1,7 @@
+#ifndef NATIVE_BLE_SCAN_H
+#define NATIVE_BLE_SCAN_H
+
+// Everything lives in the BLEDevice.h stand-in
+#include "BLEDevice.h"
+
+#endif // NATIVE_BLE_SCAN_H
@@ -0,0 +1,7 @@
+#ifndef NATIVE_BLE_UTILS_H
+#define NATIVE_BLE_UTILS_H
+
+// Everything lives in the BLEDevice.h stand-in
+#include "BLEDevice.h"
+
+#endif // NATIVE_BLE_UTILS_H
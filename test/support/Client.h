@@ -0,0 +1,13 @@
+#ifndef NATIVE_CLIENT_H
+#define NATIVE_CLIENT_H
+
+#include <stdint.h>
+
+// Base of the network clients, as far as PubSubClient looks at it
+class Client {
+public:
+    virtual ~Client() {}
+    virtual uint8_t connected() = 0;
+};
+
+#endif // NATIVE_CLIENT_H
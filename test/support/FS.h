@@ -0,0 +1,146 @@
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// In-memory stand-in for the Arduino FS API. Open handles share the file
+// contents like on LittleFS. Everything written is counted, so tests can
+// check how much flash a module writes. LittleFS is copy-on-write, so a
+// write into the middle of a file costs far more than appending; such
+// writes are counted separately as overwritten bytes.
+namespace fs {
+
+class FS;
+
+class File {
+public:
+    File() : owner(nullptr), offset(0), writable(false) {}
+    File(FS* owner, std::shared_ptr<std::vector<uint8_t> > data, bool writable, size_t offset)
+        : owner(owner), data(data), offset(offset), writable(writable) {}
+    
+    operator bool() const { return (bool)data; }
+    
+    size_t write(const uint8_t* buffer, size_t length);
+    size_t write(uint8_t value) { return write(&value, 1); }
+    
+    size_t read(uint8_t* buffer, size_t length) {
+        if (!data || offset >= data->size()) {
+            return 0;
+        }
+        size_t count = std::min(length, data->size() - offset);
+        memcpy(buffer, data->data() + offset, count);
+        offset += count;
+        return count;
+    }
+    
+    int read() {
+        uint8_t value;
+        return read(&value, 1) == 1 ? value : -1;
+    }
+    
+    int available() const { return data && offset < data->size() ? (int)(data->size() - offset) : 0; }
+    
+    bool seek(uint32_t position) {
+        if (!data || position > data->size()) {
+            return false;
+        }
+        offset = position;
+        return true;
+    }
+    
+    size_t position() const { return offset; }
+    size_t size() const { return data ? data->size() : 0; }
+    void flush() {}
+    void close() { data.reset(); }
+
+private:
+    FS* owner;
+    std::shared_ptr<std::vector<uint8_t> > data;
+    size_t offset;
+    bool writable;
+};
+
+class FS {
+public:
+    FS() : bytesWritten(0), bytesOverwritten(0), writeCalls(0), writeOpens(0) {}
+    
+    bool begin(bool formatOnFail = false) { return true; }
+    bool mkdir(const char* path) { return true; }
+    bool exists(const char* path) const { return files.count(path) > 0; }
+    bool remove(const char* path) { return files.erase(path) > 0; }
+    
+    // Modes "r", "w", "a" and "r+"
+    File open(const char* path, const char* mode = "r") {
+        std::string mode_(mode);
+        std::map<std::string, std::shared_ptr<std::vector<uint8_t> > >::iterator it = files.find(path);
+        if (mode_ == "w" || ((mode_ == "a" || mode_ == "w+") && it == files.end())) {
+            std::shared_ptr<std::vector<uint8_t> > data(new std::vector<uint8_t>());
+            files[path] = data;
+            writeOpens++;
+            return File(this, data, true, 0);
+        }
+        if (it == files.end()) {
+            return File();
+        }
+        if (mode_ == "a" || mode_ == "r+") {
+            writeOpens++;
+        }
+        if (mode_ == "a") {
+            return File(this, it->second, true, it->second->size());
+        }
+        return File(this, it->second, mode_ == "r+", 0);
+    }
+    
+    // Test helpers
+    void format() {
+        files.clear();
+        resetCounters();
+    }
+    void resetCounters() {
+        bytesWritten = 0;
+        bytesOverwritten = 0;
+        writeCalls = 0;
+        writeOpens = 0;
+    }
+    size_t fileSize(const char* path) const {
+        std::map<std::string, std::shared_ptr<std::vector<uint8_t> > >::const_iterator it = files.find(path);
+        return it == files.end() ? 0 : it->second->size();
+    }
+    size_t fileCount() const { return files.size(); }
+    
+    size_t bytesWritten;
+    size_t bytesOverwritten;
+    size_t writeCalls;
+    size_t writeOpens;      // Each open for writing ends in at least one flash program on close
+
+private:
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t> > > files;
+};
+
+inline size_t File::write(const uint8_t* buffer, size_t length) {
+    if (!data || !writable) {
+        return 0;
+    }
+    if (offset < data->size()) {
+        owner->bytesOverwritten += std::min(length, data->size() - offset);
+    }
+    if (offset + length > data->size()) {
+        data->resize(offset + length);
+    }
+    memcpy(data->data() + offset, buffer, length);
+    offset += length;
+    owner->bytesWritten += length;
+    owner->writeCalls++;
+    return length;
+}
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+
+#endif // NATIVE_FS_H
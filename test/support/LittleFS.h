@@ -0,0 +1,14 @@
+#ifndef NATIVE_LITTLEFS_H
+#define NATIVE_LITTLEFS_H
+
+#include "FS.h"
+
+// One filesystem shared by all translation units
+inline fs::FS& nativeLittleFS() {
+    static fs::FS instance;
+    return instance;
+}
+
+static fs::FS& LittleFS = nativeLittleFS();
+
+#endif // NATIVE_LITTLEFS_H
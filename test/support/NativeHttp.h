@@ -0,0 +1,116 @@
+#ifndef NATIVE_HTTP_H
+#define NATIVE_HTTP_H
+
+#include <Arduino.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+
+// Minimal HTTP/1.1 client for benchmarks against the web server on the
+// loopback interface. Reads one response, plain or chunked, then closes.
+struct NativeHttpResponse {
+    int status;
+    std::string headers;
+    std::string body;
+};
+
+inline int nativeHttpConnect(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return fd;
+}
+
+// Reads until the buffer holds at least length bytes, false on EOF
+inline bool nativeHttpFill(int fd, std::string& buffer, size_t length) {
+    char chunk[4096];
+    while (buffer.size() < length) {
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, received);
+    }
+    return true;
+}
+
+inline bool nativeHttpFillUntil(int fd, std::string& buffer, const char* marker, size_t from, size_t& at) {
+    while ((at = buffer.find(marker, from)) == std::string::npos) {
+        if (!nativeHttpFill(fd, buffer, buffer.size() + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sends a GET on an open connection and reads the response head only
+inline bool nativeHttpRequest(int fd, const char* path, NativeHttpResponse& response, std::string& buffer) {
+    std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: logger\r\n\r\n";
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size()) {
+        return false;
+    }
+    size_t headEnd;
+    if (!nativeHttpFillUntil(fd, buffer, "\r\n\r\n", 0, headEnd)) {
+        return false;
+    }
+    response.status = atoi(buffer.c_str() + buffer.find(' ') + 1);
+    response.headers = buffer.substr(0, headEnd + 2);
+    response.body.clear();
+    buffer.erase(0, headEnd + 4);
+    return true;
+}
+
+// Reads the body after nativeHttpRequest(), plain or chunked
+inline bool nativeHttpReadBody(int fd, NativeHttpResponse& response, std::string& buffer) {
+    if (response.headers.find("Transfer-Encoding: chunked") == std::string::npos) {
+        size_t field = response.headers.find("Content-Length: ");
+        size_t length = field == std::string::npos ? 0 : strtoul(response.headers.c_str() + field + 16, nullptr, 10);
+        if (!nativeHttpFill(fd, buffer, length)) {
+            return false;
+        }
+        response.body = buffer.substr(0, length);
+        return true;
+    }
+    
+    while (true) {
+        size_t lineEnd;
+        if (!nativeHttpFillUntil(fd, buffer, "\r\n", 0, lineEnd)) {
+            return false;
+        }
+        size_t length = strtoul(buffer.c_str(), nullptr, 16);
+        if (!nativeHttpFill(fd, buffer, lineEnd + 2 + length + 2)) {
+            return false;
+        }
+        response.body.append(buffer, lineEnd + 2, length);
+        buffer.erase(0, lineEnd + 2 + length + 2);
+        if (length == 0) {
+            return true;
+        }
+    }
+}
+
+// One request on a new connection, false if it failed
+inline bool nativeHttpGet(uint16_t port, const char* path, NativeHttpResponse& response) {
+    int fd = nativeHttpConnect(port);
+    if (fd < 0) {
+        return false;
+    }
+    std::string buffer;
+    bool ok = nativeHttpRequest(fd, path, response, buffer) && nativeHttpReadBody(fd, response, buffer);
+    close(fd);
+    return ok;
+}
+
+#endif // NATIVE_HTTP_H
@@ -0,0 +1,64 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+// In-memory NVS shared by all Preferences objects, it survives until the
+// test binary exits like flash survives a reboot
+class Preferences {
+public:
+    Preferences() : open(false), readOnly(false) {}
+    
+    bool begin(const char* name, bool readOnly = false) {
+        space = name;
+        open = true;
+        this->readOnly = readOnly;
+        return true;
+    }
+    
+    void end() { open = false; }
+    
+    size_t putBytes(const char* key, const void* value, size_t length) {
+        if (!open || readOnly) {
+            return 0;
+        }
+        const uint8_t* bytes = static_cast<const uint8_t*>(value);
+        storage()[space + "/" + key].assign(bytes, bytes + length);
+        return length;
+    }
+    
+    size_t getBytesLength(const char* key) {
+        std::map<std::string, std::vector<uint8_t> >::iterator entry = storage().find(space + "/" + key);
+        return (open && entry != storage().end()) ? entry->second.size() : 0;
+    }
+    
+    size_t getBytes(const char* key, void* buffer, size_t length) {
+        size_t stored = getBytesLength(key);
+        if (stored == 0 || stored > length) {
+            return 0;
+        }
+        memcpy(buffer, storage()[space + "/" + key].data(), stored);
+        return stored;
+    }
+    
+    bool remove(const char* key) {
+        return open && !readOnly && storage().erase(space + "/" + key) > 0;
+    }
+    
+    // Test helper: forget everything, like a fresh flash
+    static void erase() { storage().clear(); }
+
+private:
+    std::string space;
+    bool open;
+    bool readOnly;
+    
+    static std::map<std::string, std::vector<uint8_t> >& storage() {
+        static std::map<std::string, std::vector<uint8_t> > entries;
+        return entries;
+    }
+};
+
+#endif // NATIVE_PREFERENCES_H
@@ -0,0 +1,145 @@
+#ifndef NATIVE_PUBSUBCLIENT_H
+#define NATIVE_PUBSUBCLIENT_H
+
+// PubSubClient against an in-process broker. The broker listens on a real
+// loopback port so the TCP part of a connection attempt runs for real; the
+// kernel completes the handshake from the listen backlog. CONNECT/CONNACK
+// and PUBLISH are simulated: connect() asks the broker whether it accepts,
+// publish() hands the message over directly.
+
+#include <Arduino.h>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "Client.h"
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+#define MQTT_CONNECT_UNAUTHORIZED 5
+
+struct NativeMqttMessage {
+    std::string topic;
+    std::string payload;
+    bool retained;
+};
+
+class NativeBroker {
+public:
+    bool accepting;                 // Answers CONNECT with an accepting CONNACK
+    bool recording;                 // Keeps every message; off for allocation benchmarks
+    uint32_t connects;
+    uint32_t publishes;
+    uint32_t generation;            // Bumped when the broker drops all sessions
+    std::vector<NativeMqttMessage> messages;
+    
+    NativeBroker() : accepting(true), recording(true), connects(0), publishes(0), generation(0), listener(-1) {}
+    
+    // Starts listening on 127.0.0.1, returns the port (0 on failure)
+    uint16_t listen() {
+        stop();
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            ::listen(listener, 128) != 0 || getsockname(listener, (struct sockaddr*)&address, &length) != 0) {
+            stop();
+            return 0;
+        }
+        return ntohs(address.sin_port);
+    }
+    
+    // Closes the port and drops every session, like a broker restart
+    void stop() {
+        if (listener >= 0) {
+            close(listener);
+            listener = -1;
+        }
+        dropSessions();
+    }
+    
+    void dropSessions() { generation++; }
+    
+    void clear() {
+        messages.clear();
+        connects = 0;
+        publishes = 0;
+    }
+    
+    void receive(const char* topic, const uint8_t* payload, size_t length, bool retained) {
+        publishes++;
+        if (recording) {
+            NativeMqttMessage message = {topic, std::string((const char*)payload, length), retained};
+            messages.push_back(message);
+        }
+    }
+
+private:
+    int listener;
+};
+
+inline NativeBroker& nativeBroker() {
+    static NativeBroker broker;
+    return broker;
+}
+
+class PubSubClient {
+public:
+    explicit PubSubClient(Client& client) : client(client), currentState(MQTT_DISCONNECTED), session(0) {}
+    
+    PubSubClient& setServer(const char* domain, uint16_t port) { return *this; }
+    PubSubClient& setSocketTimeout(uint16_t timeout) { return *this; }
+    bool setBufferSize(uint16_t size) { return true; }
+    
+    // Uses the already connected client like the real library does
+    bool connect(const char* id, const char* user, const char* password) {
+        if (!client.connected()) {
+            currentState = MQTT_CONNECT_FAILED;
+            return false;
+        }
+        if (!nativeBroker().accepting) {
+            currentState = MQTT_CONNECT_UNAUTHORIZED;
+            return false;
+        }
+        nativeBroker().connects++;
+        session = nativeBroker().generation;
+        currentState = MQTT_CONNECTED;
+        return true;
+    }
+    
+    bool connected() {
+        if (currentState == MQTT_CONNECTED && (session != nativeBroker().generation || !client.connected())) {
+            currentState = MQTT_CONNECTION_LOST;
+        }
+        return currentState == MQTT_CONNECTED;
+    }
+    
+    void disconnect() { currentState = MQTT_DISCONNECTED; }
+    bool loop() { return connected(); }
+    int state() { return currentState; }
+    
+    bool publish(const char* topic, const char* payload, bool retained) {
+        return publish(topic, (const uint8_t*)payload, strlen(payload), retained);
+    }
+    
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+        if (!connected()) {
+            return false;
+        }
+        nativeBroker().receive(topic, payload, length, retained);
+        return true;
+    }
+
+private:
+    Client& client;
+    int currentState;
+    uint32_t session;
+};
+
+#endif // NATIVE_PUBSUBCLIENT_H
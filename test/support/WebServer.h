@@ -0,0 +1,293 @@
+#ifndef NATIVE_WEBSERVER_H
+#define NATIVE_WEBSERVER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <strings.h>
+#include <functional>
+#include <utility>
+#include <vector>
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_POST };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+#define HTTP_MAX_DATA_WAIT 5000
+#define HTTP_MAX_CLOSE_WAIT 2000
+
+// Port the last WebServer listens on. Servers bind a free loopback port
+// instead of the one asked for, tests connect through this.
+inline uint16_t& nativeWebServerPort() {
+    static uint16_t port = 0;
+    return port;
+}
+
+// Stand-in for the Arduino WebServer on host sockets, with its connection
+// handling: one request at a time, each handleClient() call moves it on.
+// After the handler the server keeps the connection as its current client
+// until the peer closes it or HTTP_MAX_CLOSE_WAIT passed (HC_WAIT_CLOSE),
+// and accepts nothing else meanwhile. Responses close the connection.
+class WebServer {
+public:
+    typedef std::function<void()> THandlerFunction;
+    
+    explicit WebServer(int port = 80) : listener(-1), status(HC_NONE), statusChange(0),
+                                        contentLength(CONTENT_LENGTH_NOT_SET), chunked(false) {}
+    
+    virtual ~WebServer() {
+        if (listener >= 0) {
+            close(listener);
+        }
+    }
+    
+    void begin() {
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            listen(listener, 64) != 0 || getsockname(listener, (struct sockaddr*)&address, &length) != 0) {
+            return;
+        }
+        fcntl(listener, F_SETFL, O_NONBLOCK);
+        nativeWebServerPort() = ntohs(address.sin_port);
+    }
+    
+    void on(const char* path, THandlerFunction handler) { routes.push_back(std::make_pair(std::string(path), handler)); }
+    void onNotFound(THandlerFunction handler) { notFound = handler; }
+    void collectHeaders(const char** names, size_t count) {}
+    
+    void handleClient() {
+        if (status == HC_NONE) {
+            int fd = listener >= 0 ? accept(listener, nullptr, nullptr) : -1;
+            if (fd < 0) {
+                return;
+            }
+            _currentClient = WiFiClient(fd);
+            status = HC_WAIT_READ;
+            statusChange = millis();
+        }
+        
+        bool keepCurrentClient = false;
+        if (_currentClient.connected()) {
+            if (status == HC_WAIT_READ) {
+                if (_currentClient.available()) {
+                    if (parseRequest()) {
+                        handleRequest();
+                        if (_currentClient.connected()) {
+                            status = HC_WAIT_CLOSE;
+                            statusChange = millis();
+                            keepCurrentClient = true;
+                        }
+                    }
+                } else if (millis() - statusChange <= HTTP_MAX_DATA_WAIT) {
+                    keepCurrentClient = true;
+                }
+            } else if (status == HC_WAIT_CLOSE && millis() - statusChange <= HTTP_MAX_CLOSE_WAIT) {
+                keepCurrentClient = true;
+            }
+        }
+        
+        if (!keepCurrentClient) {
+            _currentClient = WiFiClient();
+            status = HC_NONE;
+        }
+    }
+    
+    // Request
+    String uri() { return String(path); }
+    bool hasArg(const char* name) { return findPair(args, name, false) != nullptr; }
+    String arg(const char* name) {
+        const std::string* value = findPair(args, name, false);
+        return value ? String(*value) : String();
+    }
+    bool hasHeader(const char* name) { return findPair(headers, name, true) != nullptr; }
+    String header(const char* name) {
+        const std::string* value = findPair(headers, name, true);
+        return value ? String(*value) : String();
+    }
+    WiFiClient client() { return _currentClient; }
+    
+    // Response
+    void sendHeader(const String& name, const String& value, bool first = false) {
+        std::string line = std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+        responseHeaders = first ? line + responseHeaders : responseHeaders + line;
+    }
+    
+    void setContentLength(size_t length) { contentLength = length; }
+    
+    void send(int code, const char* contentType = nullptr, const String& content = String()) {
+        sendResponseHeader(code, contentType, content.length());
+        if (content.length() > 0) {
+            sendContent(content.c_str(), content.length());
+        }
+    }
+    
+    void send_P(int code, PGM_P contentType, PGM_P content, size_t length) {
+        sendResponseHeader(code, contentType, length);
+        _currentClient.write((const uint8_t*)content, length);
+    }
+    
+    // Chunked after setContentLength(CONTENT_LENGTH_UNKNOWN), an empty chunk ends the response
+    void sendContent(const char* content, size_t length) {
+        if (!chunked) {
+            _currentClient.write((const uint8_t*)content, length);
+            return;
+        }
+        char size[12];
+        int sizeLength = snprintf(size, sizeof(size), "%zx\r\n", length);
+        _currentClient.write((const uint8_t*)size, sizeLength);
+        _currentClient.write((const uint8_t*)content, length);
+        _currentClient.write((const uint8_t*)"\r\n", 2);
+        if (length == 0) {
+            chunked = false;
+        }
+    }
+    
+    void sendContent(const String& content) {
+        if (content.length() > 0) {
+            sendContent(content.c_str(), content.length());
+        }
+    }
+
+protected:
+    WiFiClient _currentClient;
+
+private:
+    enum ClientStatus { HC_NONE, HC_WAIT_READ, HC_WAIT_CLOSE };
+    typedef std::vector<std::pair<std::string, std::string> > Pairs;
+    
+    int listener;
+    ClientStatus status;
+    unsigned long statusChange;
+    std::vector<std::pair<std::string, THandlerFunction> > routes;
+    THandlerFunction notFound;
+    
+    std::string path;
+    Pairs args;
+    Pairs headers;
+    std::string responseHeaders;
+    size_t contentLength;
+    bool chunked;
+    
+    static const std::string* findPair(const Pairs& pairs, const char* name, bool ignoreCase) {
+        for (size_t i = 0; i < pairs.size(); i++) {
+            if (ignoreCase ? strcasecmp(pairs[i].first.c_str(), name) == 0 : pairs[i].first == name) {
+                return &pairs[i].second;
+            }
+        }
+        return nullptr;
+    }
+    
+    static std::string urlDecode(const std::string& text) {
+        std::string decoded;
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] == '+') {
+                decoded += ' ';
+            } else if (text[i] == '%' && i + 2 < text.size()) {
+                decoded += (char)strtol(text.substr(i + 1, 2).c_str(), nullptr, 16);
+                i += 2;
+            } else {
+                decoded += text[i];
+            }
+        }
+        return decoded;
+    }
+    
+    // Reads the request head, bodies are not supported
+    bool parseRequest() {
+        std::string request;
+        char buffer[512];
+        unsigned long start = millis();
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            int received = _currentClient.read((uint8_t*)buffer, sizeof(buffer));
+            if (received <= 0 || millis() - start > HTTP_MAX_DATA_WAIT) {
+                return false;
+            }
+            request.append(buffer, received);
+        }
+        
+        size_t lineEnd = request.find("\r\n");
+        std::string line = request.substr(0, lineEnd);
+        size_t target = line.find(' ');
+        size_t version = line.find(' ', target + 1);
+        if (target == std::string::npos || version == std::string::npos) {
+            return false;
+        }
+        std::string url = line.substr(target + 1, version - target - 1);
+        
+        size_t query = url.find('?');
+        path = url.substr(0, query);
+        args.clear();
+        while (query != std::string::npos) {
+            size_t next = url.find('&', query + 1);
+            std::string pair = url.substr(query + 1, next == std::string::npos ? std::string::npos : next - query - 1);
+            size_t equals = pair.find('=');
+            args.push_back(std::make_pair(urlDecode(pair.substr(0, equals)),
+                                          equals == std::string::npos ? std::string() : urlDecode(pair.substr(equals + 1))));
+            query = next;
+        }
+        
+        headers.clear();
+        for (size_t at = lineEnd + 2; at < request.size();) {
+            size_t end = request.find("\r\n", at);
+            if (end == std::string::npos || end == at) {
+                break;
+            }
+            std::string field = request.substr(at, end - at);
+            size_t colon = field.find(':');
+            if (colon != std::string::npos) {
+                size_t value = field.find_first_not_of(' ', colon + 1);
+                headers.push_back(std::make_pair(field.substr(0, colon),
+                                                 value == std::string::npos ? std::string() : field.substr(value)));
+            }
+            at = end + 2;
+        }
+        return true;
+    }
+    
+    void handleRequest() {
+        responseHeaders.clear();
+        contentLength = CONTENT_LENGTH_NOT_SET;
+        chunked = false;
+        for (size_t i = 0; i < routes.size(); i++) {
+            if (routes[i].first == path) {
+                routes[i].second();
+                return;
+            }
+        }
+        if (notFound) {
+            notFound();
+        } else {
+            send(404, "text/plain", "Not found");
+        }
+    }
+    
+    void sendResponseHeader(int code, const char* contentType, size_t length) {
+        char head[256];
+        int headLength = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\n", code, code == 200 ? "OK" : code == 304 ? "Not Modified" : "Error");
+        std::string response(head, headLength);
+        if (contentType != nullptr) {
+            response += std::string("Content-Type: ") + contentType + "\r\n";
+        }
+        if (contentLength == CONTENT_LENGTH_UNKNOWN) {
+            response += "Transfer-Encoding: chunked\r\n";
+            chunked = true;
+        } else {
+            snprintf(head, sizeof(head), "Content-Length: %zu\r\n",
+                     contentLength == CONTENT_LENGTH_NOT_SET ? length : contentLength);
+            response += head;
+        }
+        response += "Connection: close\r\n" + responseHeaders + "\r\n";
+        responseHeaders.clear();
+        contentLength = CONTENT_LENGTH_NOT_SET;
+        _currentClient.write((const uint8_t*)response.data(), response.size());
+    }
+};
+
+#endif // NATIVE_WEBSERVER_H
@@ -0,0 +1,105 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include <Arduino.h>
+#include <errno.h>
+#include <memory>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "Client.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+// Host socket, closed with the last client that refers to it
+class NativeSocket {
+public:
+    explicit NativeSocket(int fd) : fd(fd) {}
+    ~NativeSocket() { close(fd); }
+    
+    const int fd;
+};
+
+// Wraps a host socket handed over by the code under test. Copies share the
+// socket like the ESP32 WiFiClient shares its handle: stop() lets go of this
+// copy, the socket is closed once no copy refers to it anymore.
+class WiFiClient : public Client {
+public:
+    WiFiClient() {}
+    explicit WiFiClient(int fd) : socket(std::make_shared<NativeSocket>(fd)) {}
+    
+    // Like lwIP: open until the peer closed and everything it sent was read
+    uint8_t connected() override {
+        if (!socket) {
+            return false;
+        }
+        char next;
+        ssize_t peeked = recv(socket->fd, &next, 1, MSG_PEEK | MSG_DONTWAIT);
+        return peeked > 0 || (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+    }
+    
+    int available() {
+        char next;
+        return socket && recv(socket->fd, &next, 1, MSG_PEEK | MSG_DONTWAIT) > 0;
+    }
+    
+    int read(uint8_t* buffer, size_t length) {
+        return socket ? recv(socket->fd, buffer, length, 0) : -1;
+    }
+    
+    // Blocks until everything is handed to the stack, 0 once the peer is gone
+    size_t write(const uint8_t* data, size_t length) {
+        size_t written = 0;
+        while (socket && written < length) {
+            ssize_t sent = send(socket->fd, data + written, length - written, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                return 0;
+            }
+            written += sent;
+        }
+        return written;
+    }
+    
+    size_t print(const char* text) { return write((const uint8_t*)text, strlen(text)); }
+    
+    void setNoDelay(bool noDelay) {
+        int value = noDelay ? 1 : 0;
+        if (socket) {
+            setsockopt(socket->fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+        }
+    }
+    
+    void stop() { socket.reset(); }
+    
+    operator bool() const { return (bool)socket; }
+
+private:
+    std::shared_ptr<NativeSocket> socket;
+};
+
+// Station status, tests take the link up and down
+class NativeWiFi {
+public:
+    NativeWiFi() : current(WL_CONNECTED) {}
+    
+    wl_status_t status() const { return current; }
+    void setStatus(wl_status_t status) { current = status; }
+    int8_t RSSI() const { return -60; }
+
+private:
+    wl_status_t current;
+};
+
+inline NativeWiFi& nativeWiFi() {
+    static NativeWiFi instance;
+    return instance;
+}
+
+static NativeWiFi& WiFi = nativeWiFi();
+
+#endif // NATIVE_WIFI_H
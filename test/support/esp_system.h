@@ -0,0 +1,49 @@
+#ifndef NATIVE_ESP_SYSTEM_H
+#define NATIVE_ESP_SYSTEM_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Heap figures of the ESP32-S3 without PSRAM. Benchmarks that count their
+// allocations report them through allocate() and release(); otherwise the
+// heap looks untouched.
+class NativeHeap {
+public:
+    static const size_t SIZE = 320 * 1024;
+    
+    NativeHeap() : used(0), peak(0) {}
+    
+    void allocate(size_t size) {
+        size_t now = used.fetch_add(size) + size;
+        size_t highest = peak.load();
+        while (now > highest && !peak.compare_exchange_weak(highest, now)) {
+        }
+    }
+    
+    void release(size_t size) { used.fetch_sub(size); }
+    
+    // Starts a new peak measurement from the current use
+    void resetPeak() { peak.store(used.load()); }
+    
+    size_t getUsed() const { return used.load(); }
+    size_t getPeak() const { return peak.load(); }
+
+private:
+    std::atomic<size_t> used;
+    std::atomic<size_t> peak;
+};
+
+inline NativeHeap& nativeHeap() {
+    static NativeHeap heap;
+    return heap;
+}
+
+inline uint32_t esp_get_free_heap_size() {
+    return NativeHeap::SIZE - nativeHeap().getUsed();
+}
+
+inline uint32_t esp_get_minimum_free_heap_size() {
+    return NativeHeap::SIZE - nativeHeap().getPeak();
+}
+
+#endif // NATIVE_ESP_SYSTEM_H
@@ -0,0 +1,13 @@
+#ifndef NATIVE_ESP_TASK_WDT_H
+#define NATIVE_ESP_TASK_WDT_H
+
+#include "esp_err.h"
+#include <freertos/FreeRTOS.h>
+
+// No watchdog on the host, subscribing and feeding always succeed
+inline esp_err_t esp_task_wdt_init(uint32_t timeoutSeconds, bool panic) { return ESP_OK; }
+inline esp_err_t esp_task_wdt_add(TaskHandle_t task) { return ESP_OK; }
+inline esp_err_t esp_task_wdt_delete(TaskHandle_t task) { return ESP_OK; }
+inline esp_err_t esp_task_wdt_reset() { return ESP_OK; }
+
+#endif // NATIVE_ESP_TASK_WDT_H
@@ -0,0 +1,101 @@
+#ifndef NATIVE_FREERTOS_H
+#define NATIVE_FREERTOS_H
+
+// Host stand-ins for the FreeRTOS types and calls used by the modules under
+// test. Tasks are std::threads, semaphores and queues are a mutex plus a
+// condition variable, so code that hands work from one task to another runs
+// for real. One tick is one millisecond of host time.
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef void* SemaphoreHandle_t;
+typedef void* QueueHandle_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define pdMS_TO_TICKS(ms) (ms)
+
+// Spinlock like on the dual-core ESP32, copying one yields a new unlocked lock
+struct portMUX_TYPE {
+    std::atomic<bool> locked;
+    
+    portMUX_TYPE() : locked(false) {}
+    portMUX_TYPE(const portMUX_TYPE&) : locked(false) {}
+};
+
+#define portMUX_INITIALIZER_UNLOCKED portMUX_TYPE()
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {
+    while (mux->locked.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+    mux->locked.store(false, std::memory_order_release);
+}
+
+// A task deleted by another one stops at its next blocking FreeRTOS call:
+// the call throws NativeTaskDeleted, which unwinds the task's thread.
+struct NativeTaskDeleted {};
+
+struct NativeTask {
+    std::thread thread;
+    std::atomic<bool> deleted;
+    
+    NativeTask() : deleted(false) {}
+};
+
+typedef NativeTask* TaskHandle_t;
+
+inline NativeTask*& nativeCurrentTask() {
+    static thread_local NativeTask* task = nullptr;
+    return task;
+}
+
+inline void nativeCheckDeleted() {
+    NativeTask* task = nativeCurrentTask();
+    if (task && task->deleted.load()) {
+        throw NativeTaskDeleted();
+    }
+}
+
+// Waits until ready() holds or the ticks run out, in short slices so a
+// deleted task notices. Returns ready().
+template <typename Ready>
+bool nativeWaitFor(std::unique_lock<std::mutex>& lock, std::condition_variable& changed, TickType_t ticks, Ready ready) {
+    const std::chrono::milliseconds SLICE(5);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+    
+    while (!ready()) {
+        nativeCheckDeleted();
+        if (ticks == 0) {
+            return false;
+        }
+        
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (ticks != portMAX_DELAY && now >= deadline) {
+            return false;
+        }
+        
+        std::chrono::steady_clock::time_point until = now + SLICE;
+        if (ticks != portMAX_DELAY && deadline < until) {
+            until = deadline;
+        }
+        changed.wait_until(lock, until);
+    }
+    return true;
+}
+
+#endif // NATIVE_FREERTOS_H
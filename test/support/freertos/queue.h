@@ -0,0 +1,76 @@
+#ifndef NATIVE_QUEUE_H
+#define NATIVE_QUEUE_H
+
+#include "FreeRTOS.h"
+#include <string.h>
+#include <vector>
+
+// Items are copied in and out like on FreeRTOS
+struct NativeQueue {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<uint8_t> storage;
+    size_t itemSize;
+    size_t length;
+    size_t head;
+    size_t count;
+    
+    NativeQueue(size_t length, size_t itemSize)
+        : storage(length * itemSize), itemSize(itemSize), length(length), head(0), count(0) {}
+};
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    return length > 0 ? new NativeQueue(length, itemSize) : nullptr;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t ticks) {
+    NativeQueue* queue = static_cast<NativeQueue*>(handle);
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!nativeWaitFor(lock, queue->changed, ticks, [queue]() { return queue->count < queue->length; })) {
+        return pdFALSE;
+    }
+    size_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[tail * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+inline BaseType_t xQueueSendToBack(QueueHandle_t handle, const void* item, TickType_t ticks) {
+    return xQueueSend(handle, item, ticks);
+}
+
+inline BaseType_t xQueuePeek(QueueHandle_t handle, void* item, TickType_t ticks) {
+    NativeQueue* queue = static_cast<NativeQueue*>(handle);
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!nativeWaitFor(lock, queue->changed, ticks, [queue]() { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+    memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+    return pdTRUE;
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t handle, void* item, TickType_t ticks) {
+    NativeQueue* queue = static_cast<NativeQueue*>(handle);
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    if (!nativeWaitFor(lock, queue->changed, ticks, [queue]() { return queue->count > 0; })) {
+        return pdFALSE;
+    }
+    memcpy(item, &queue->storage[queue->head * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+    NativeQueue* queue = static_cast<NativeQueue*>(handle);
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    return queue->count;
+}
+
+inline void vQueueDelete(QueueHandle_t handle) {
+    delete static_cast<NativeQueue*>(handle);
+}
+
+#endif // NATIVE_QUEUE_H
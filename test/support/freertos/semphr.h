@@ -0,0 +1,66 @@
+#ifndef NATIVE_SEMPHR_H
+#define NATIVE_SEMPHR_H
+
+#include "FreeRTOS.h"
+
+// Counting semaphore, binary semaphores and mutexes are the cases with a
+// maximum count of one. Mutexes have no owner or priority inheritance.
+struct NativeSemaphore {
+    std::mutex mutex;
+    std::condition_variable changed;
+    unsigned count;
+    unsigned maxCount;
+    bool heap;
+    
+    NativeSemaphore() : count(0), maxCount(1), heap(false) {}
+};
+
+typedef NativeSemaphore StaticSemaphore_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() {
+    NativeSemaphore* semaphore = new NativeSemaphore();
+    semaphore->heap = true;
+    return semaphore;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+    SemaphoreHandle_t semaphore = xSemaphoreCreateBinary();
+    static_cast<NativeSemaphore*>(semaphore)->count = 1;
+    return semaphore;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buffer) {
+    buffer->count = 1;
+    buffer->maxCount = 1;
+    return buffer;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks) {
+    NativeSemaphore* semaphore = static_cast<NativeSemaphore*>(handle);
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    if (!nativeWaitFor(lock, semaphore->changed, ticks, [semaphore]() { return semaphore->count > 0; })) {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+    NativeSemaphore* semaphore = static_cast<NativeSemaphore*>(handle);
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    if (semaphore->count >= semaphore->maxCount) {
+        return pdFALSE;
+    }
+    semaphore->count++;
+    semaphore->changed.notify_all();
+    return pdTRUE;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t handle) {
+    NativeSemaphore* semaphore = static_cast<NativeSemaphore*>(handle);
+    if (semaphore && semaphore->heap) {
+        delete semaphore;
+    }
+}
+
+#endif // NATIVE_SEMPHR_H
@@ -0,0 +1,53 @@
+#ifndef NATIVE_TASK_H
+#define NATIVE_TASK_H
+
+#include "FreeRTOS.h"
+
+// Tasks run on their own std::thread. Core and priority are ignored, the
+// host scheduler decides.
+typedef void (*TaskFunction_t)(void*);
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t entry, const char* name, uint32_t stackDepth, void* param,
+                                          UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    NativeTask* task = new NativeTask();
+    task->thread = std::thread([task, entry, param]() {
+        nativeCurrentTask() = task;
+        try {
+            entry(param);
+        } catch (const NativeTaskDeleted&) {
+        }
+    });
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+    std::mutex mutex;
+    std::condition_variable never;
+    std::unique_lock<std::mutex> lock(mutex);
+    nativeWaitFor(lock, never, ticks, []() { return false; });
+}
+
+// Deleting another task waits until it reached a blocking call and unwound.
+// A task deleting itself unwinds right away.
+inline void vTaskDelete(TaskHandle_t handle) {
+    NativeTask* task = handle ? handle : nativeCurrentTask();
+    if (task == nullptr) {
+        return;
+    }
+    
+    task->deleted = true;
+    if (task == nativeCurrentTask()) {
+        task->thread.detach();
+        delete task;
+        nativeCurrentTask() = nullptr;
+        throw NativeTaskDeleted();
+    }
+    
+    task->thread.join();
+    delete task;
+}
+
+#endif // NATIVE_TASK_H
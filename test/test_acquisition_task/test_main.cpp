@@ -0,0 +1,107 @@
+#include <unity.h>
+#include "AcquisitionTask.h"
+
+// Simulated batteries: a link takes about 200 ms to set up, a command about 60 ms
+static const unsigned long CONNECT_MS = 120;
+static const unsigned long DISCOVERY_MS = 80;
+static const unsigned long RESPONSE_MS = 40;
+
+// Stand-in for one pass of loop(): web, MQTT and OTA get a turn at most this far apart
+static const uint32_t LOOP_TICK_MS = 10;
+
+void setUp() {
+    nativeUseHostClock();
+    Preferences::erase();
+    nativeBle().setScanWindowMs(50);
+    
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        NativeBms& bms = nativeBle().addBms(BATTERY_MAC_ADDRESSES[i].c_str());
+        bms.connectMs = CONNECT_MS;
+        bms.discoveryMs = DISCOVERY_MS;
+        bms.responseMs = RESPONSE_MS;
+    }
+}
+
+void tearDown() {
+    BLEDevice::getScan()->stop();
+}
+
+void test_inline_reads_stall_the_loop() {
+    // The old loop(): battery reads run between two handleClient() calls
+    BluetoothManager bluetoothManager;
+    bluetoothManager.begin();
+    
+    int indices[BATTERY_COUNT];
+    BatteryData results[BATTERY_COUNT];
+    bool success[BATTERY_COUNT];
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        indices[i] = i;
+    }
+    
+    unsigned long start = millis();
+    int read = bluetoothManager.readBatteries(indices, BATTERY_COUNT, results, success);
+    unsigned long stall = millis() - start;
+    
+    printf("inline: %d batteries read, loop stalled %lu ms\n", read, stall);
+    TEST_ASSERT_EQUAL(BATTERY_COUNT, read);
+    TEST_ASSERT_GREATER_OR_EQUAL(BATTERY_COUNT * (CONNECT_MS + DISCOVERY_MS), stall);
+}
+
+void test_task_keeps_loop_responsive() {
+    BluetoothManager bluetoothManager;
+    PollScheduler pollScheduler;
+    bluetoothManager.begin();
+    pollScheduler.begin(0);
+    
+    unsigned long maxGap = 0;
+    unsigned long firstSample = 0;
+    int samples = 0;
+    int presence = 0;
+    unsigned long iterations = 0;
+    unsigned long start = millis();
+    
+    {
+        AcquisitionTask acquisitionTask(bluetoothManager, pollScheduler);
+        TEST_ASSERT_TRUE(acquisitionTask.begin());
+        
+        // Consume events like loop() does until every battery delivered a sample
+        unsigned long lastPass = millis();
+        while (samples < BATTERY_COUNT && millis() - start < 5000) {
+            if (acquisitionTask.waitForEvent(LOOP_TICK_MS)) {
+                AcquisitionEvent event;
+                while (acquisitionTask.receive(event)) {
+                    if (event.type == AcquisitionEvent::PRESENCE) {
+                        presence++;
+                    } else if (event.success && event.batteryData.dataValid) {
+                        if (samples++ == 0) {
+                            firstSample = millis() - start;
+                        }
+                    }
+                }
+            }
+            
+            unsigned long now = millis();
+            maxGap = max(maxGap, now - lastPass);
+            lastPass = now;
+            iterations++;
+        }
+        
+        TEST_ASSERT_EQUAL_UINT32(0, acquisitionTask.getDroppedEvents());
+    }
+    
+    printf("task: %d samples after %lu ms (first %lu ms), %lu loop passes, longest gap %lu ms\n",
+           samples, millis() - start, firstSample, iterations, maxGap);
+    TEST_ASSERT_EQUAL(BATTERY_COUNT, samples);
+    TEST_ASSERT_EQUAL(BATTERY_COUNT, presence);
+    
+    // The loop keeps its tick while the links are set up, with some slack for the host scheduler
+    TEST_ASSERT_LESS_OR_EQUAL(LOOP_TICK_MS * 5, maxGap);
+    TEST_ASSERT_GREATER_OR_EQUAL((BATTERY_COUNT * (CONNECT_MS + DISCOVERY_MS)) / LOOP_TICK_MS / 2, iterations);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_inline_reads_stall_the_loop);
+    RUN_TEST(test_task_keeps_loop_responsive);
+    return UNITY_END();
+}
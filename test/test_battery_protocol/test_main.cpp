@@ -0,0 +1,183 @@
+#include <unity.h>
+#include "BatteryProtocol.h"
+#include "config.h"
+
+// Frames as a BMS sends them: DD cmd status length payload checksum(2) 77
+static size_t buildFrame(uint8_t cmd, uint8_t status, const uint8_t* payload, uint8_t length, uint8_t* out) {
+    uint16_t sum = status + length;
+    out[0] = FRAME_START;
+    out[1] = cmd;
+    out[2] = status;
+    out[3] = length;
+    for (int i = 0; i < length; i++) {
+        out[4 + i] = payload[i];
+        sum += payload[i];
+    }
+    uint16_t checksum = 0x10000 - sum;
+    out[4 + length] = checksum >> 8;
+    out[5 + length] = checksum & 0xFF;
+    out[6 + length] = FRAME_END;
+    return 7 + length;
+}
+
+static const uint8_t BASIC_PAYLOAD[27] = {
+    0x05, 0x32,         // 13.30 V
+    0xFF, 0x9C,         // -1.00 A
+    0x13, 0x88,         // 50.00 Ah remaining
+    0x27, 0x10,         // 100.00 Ah nominal
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0x03,               // Both FETs on
+    0, 0x01,
+    0x0B, 0xA5,         // 298.1 K
+    0, 0
+};
+
+static const uint8_t CELL_PAYLOAD[8] = {
+    0x0C, 0xF8, 0x0C, 0xF9, 0x0C, 0xFA, 0x0C, 0x77     // Last cell contains the end byte value
+};
+
+static BatteryProtocol protocol;
+static BatteryData data;
+
+void setUp() {
+    protocol.resetParser();
+    data.clear();
+}
+
+void tearDown() {
+}
+
+// Feeds a whole buffer, returns the number of completed frames
+static int feedAll(const uint8_t* bytes, size_t length, FrameResult* lastError) {
+    int complete = 0;
+    while (length > 0) {
+        size_t consumed = 0;
+        FrameResult result = protocol.feed(bytes, length, consumed, data);
+        if (result == FrameResult::COMPLETE) {
+            complete++;
+        } else if (result != FrameResult::NEED_MORE && lastError) {
+            *lastError = result;
+        }
+        bytes += consumed;
+        length -= consumed;
+    }
+    return complete;
+}
+
+static void assertBasicFields() {
+    TEST_ASSERT_TRUE(data.dataValid);
+    TEST_ASSERT_EQUAL_UINT16(1330, data.voltage10mV);
+    TEST_ASSERT_EQUAL_INT16(-100, data.current10mA);
+    TEST_ASSERT_EQUAL_UINT16(5000, data.remaining10mAh);
+    TEST_ASSERT_EQUAL_UINT16(10000, data.nominal10mAh);
+    TEST_ASSERT_EQUAL_UINT8(0x03, data.switches);
+    TEST_ASSERT_EQUAL_UINT16(2981, data.temperature01K);
+}
+
+static void assertCellFields() {
+    TEST_ASSERT_EQUAL_UINT8(4, data.numCells);
+    TEST_ASSERT_EQUAL_UINT16(3320, data.cellMillivolts[0]);
+    TEST_ASSERT_EQUAL_UINT16(3321, data.cellMillivolts[1]);
+    TEST_ASSERT_EQUAL_UINT16(3322, data.cellMillivolts[2]);
+    TEST_ASSERT_EQUAL_UINT16(3191, data.cellMillivolts[3]);
+}
+
+void test_whole_frame() {
+    uint8_t frame[64];
+    size_t length = buildFrame(CMD_READ_BASIC_INFO, 0, BASIC_PAYLOAD, sizeof(BASIC_PAYLOAD), frame);
+    
+    size_t consumed = 0;
+    TEST_ASSERT_TRUE(protocol.feed(frame, length, consumed, data) == FrameResult::COMPLETE);
+    TEST_ASSERT_EQUAL(length, consumed);
+    TEST_ASSERT_EQUAL_UINT8(CMD_READ_BASIC_INFO, protocol.getLastFrameCommand());
+    assertBasicFields();
+}
+
+void test_random_fragmentation() {
+    // Both responses back to back, cut at random points like BLE notifications
+    uint8_t stream[128];
+    size_t length = buildFrame(CMD_READ_BASIC_INFO, 0, BASIC_PAYLOAD, sizeof(BASIC_PAYLOAD), stream);
+    length += buildFrame(CMD_READ_CELL_VOLTAGES, 0, CELL_PAYLOAD, sizeof(CELL_PAYLOAD), stream + length);
+    
+    uint32_t seed = 12345;
+    for (int round = 0; round < 1000; round++) {
+        setUp();
+        int complete = 0;
+        size_t position = 0;
+        while (position < length) {
+            seed = seed * 1103515245 + 12345;
+            size_t fragment = 1 + (seed >> 16) % 20;
+            if (fragment > length - position) {
+                fragment = length - position;
+            }
+            complete += feedAll(stream + position, fragment, nullptr);
+            position += fragment;
+        }
+        TEST_ASSERT_EQUAL(2, complete);
+        assertBasicFields();
+        assertCellFields();
+    }
+}
+
+void test_checksum_error_leaves_data_untouched() {
+    uint8_t frame[64];
+    size_t length = buildFrame(CMD_READ_BASIC_INFO, 0, BASIC_PAYLOAD, sizeof(BASIC_PAYLOAD), frame);
+    frame[length - 2] ^= 0x01;
+    
+    FrameResult error = FrameResult::NEED_MORE;
+    TEST_ASSERT_EQUAL(0, feedAll(frame, length, &error));
+    TEST_ASSERT_TRUE(error == FrameResult::CHECKSUM_ERROR);
+    TEST_ASSERT_FALSE(data.dataValid);
+    TEST_ASSERT_EQUAL_UINT16(0, data.voltage10mV);
+}
+
+void test_device_error() {
+    uint8_t frame[64];
+    size_t length = buildFrame(CMD_READ_BASIC_INFO, 0x80, BASIC_PAYLOAD, sizeof(BASIC_PAYLOAD), frame);
+    
+    FrameResult error = FrameResult::NEED_MORE;
+    TEST_ASSERT_EQUAL(0, feedAll(frame, length, &error));
+    TEST_ASSERT_TRUE(error == FrameResult::DEVICE_ERROR);
+    TEST_ASSERT_FALSE(data.dataValid);
+}
+
+void test_missing_end_byte() {
+    uint8_t frame[64];
+    size_t length = buildFrame(CMD_READ_CELL_VOLTAGES, 0, CELL_PAYLOAD, sizeof(CELL_PAYLOAD), frame);
+    frame[length - 1] = 0x00;
+    
+    FrameResult error = FrameResult::NEED_MORE;
+    TEST_ASSERT_EQUAL(0, feedAll(frame, length, &error));
+    TEST_ASSERT_TRUE(error == FrameResult::FORMAT_ERROR);
+}
+
+void test_resync_after_garbage() {
+    uint8_t stream[96] = { 0x12, 0x77, FRAME_START, 0x99, 0x00 };
+    size_t length = 5;
+    length += buildFrame(CMD_READ_CELL_VOLTAGES, 0, CELL_PAYLOAD, sizeof(CELL_PAYLOAD), stream + length);
+    
+    TEST_ASSERT_EQUAL(1, feedAll(stream, length, nullptr));
+    assertCellFields();
+}
+
+void test_command_frames() {
+    uint8_t command[7];
+    uint8_t length = 0;
+    protocol.createBasicInfoCommand(command, length);
+    
+    const uint8_t expected[] = { 0xDD, 0xA5, 0x03, 0x00, 0xFF, 0xFD, 0x77 };
+    TEST_ASSERT_EQUAL(7, length);
+    TEST_ASSERT_EQUAL_MEMORY(expected, command, sizeof(expected));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_whole_frame);
+    RUN_TEST(test_random_fragmentation);
+    RUN_TEST(test_checksum_error_leaves_data_untouched);
+    RUN_TEST(test_device_error);
+    RUN_TEST(test_missing_end_byte);
+    RUN_TEST(test_resync_after_garbage);
+    RUN_TEST(test_command_frames);
+    return UNITY_END();
+}
@@ -0,0 +1,89 @@
+#include <unity.h>
+#include "BluetoothManager.h"
+
+// Scan times against simulated batteries. Links are set up one after the
+// other, the commands then run on all links at once.
+
+static const unsigned long CONNECT_MS = 100;
+static const unsigned long DISCOVERY_MS = 150;
+static const unsigned long RESPONSE_MS = 80;
+static const int ROUNDS = 5;
+
+static BluetoothManager* bluetoothManager;
+static int indices[BATTERY_COUNT];
+static BatteryData results[BATTERY_COUNT];
+static bool success[BATTERY_COUNT];
+
+// Wall time of one readBatteries() call in milliseconds, all batteries must answer
+static unsigned long timedRead(const int* batteryIndices, int count) {
+    unsigned long start = micros();
+    int read = bluetoothManager->readBatteries(batteryIndices, count, results, success);
+    unsigned long elapsed = micros() - start;
+    
+    TEST_ASSERT_EQUAL(count, read);
+    return elapsed / 1000;
+}
+
+void setUp() {
+    if (bluetoothManager != nullptr) {
+        return;
+    }
+    
+    nativeUseHostClock();
+    Preferences::erase();
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        NativeBms& bms = nativeBle().addBms(BATTERY_MAC_ADDRESSES[i].c_str());
+        bms.connectMs = CONNECT_MS;
+        bms.discoveryMs = DISCOVERY_MS;
+        bms.responseMs = RESPONSE_MS;
+        indices[i] = i;
+    }
+    
+    bluetoothManager = new BluetoothManager();
+    bluetoothManager->begin();
+}
+
+void tearDown() {
+}
+
+void test_link_setup_is_sequential() {
+    // First boot: every link discovers the service, later ones reuse the cached handles
+    unsigned long discovering = timedRead(indices, BATTERY_COUNT);
+    bluetoothManager->disconnectAll();
+    unsigned long cached = timedRead(indices, BATTERY_COUNT);
+    
+    printf("cold scan of %d batteries: %lu ms with service discovery, %lu ms with cached handles\n",
+           BATTERY_COUNT, discovering, cached);
+    
+    TEST_ASSERT_GREATER_OR_EQUAL(BATTERY_COUNT * (CONNECT_MS + DISCOVERY_MS), discovering);
+    TEST_ASSERT_GREATER_OR_EQUAL(BATTERY_COUNT * CONNECT_MS, cached);
+    TEST_ASSERT_LESS_THAN(BATTERY_COUNT * (CONNECT_MS + DISCOVERY_MS), cached);
+}
+
+void test_open_links_are_read_in_parallel() {
+    unsigned long parallel = 0;
+    unsigned long sequential = 0;
+    
+    for (int round = 0; round < ROUNDS; round++) {
+        parallel += timedRead(indices, BATTERY_COUNT);
+        for (int i = 0; i < BATTERY_COUNT; i++) {
+            sequential += timedRead(&indices[i], 1);
+        }
+    }
+    parallel /= ROUNDS;
+    sequential /= ROUNDS;
+    
+    printf("warm scan of %d batteries: %lu ms in parallel, %lu ms one after the other\n",
+           BATTERY_COUNT, parallel, sequential);
+    
+    // About as long as one battery: basic info and cell voltages, pipelined
+    TEST_ASSERT_LESS_THAN(sequential * 3 / 4, parallel);
+    TEST_ASSERT_LESS_THAN(2 * RESPONSE_MS, parallel);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_link_setup_is_sequential);
+    RUN_TEST(test_open_links_are_read_in_parallel);
+    return UNITY_END();
+}
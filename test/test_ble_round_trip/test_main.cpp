@@ -0,0 +1,167 @@
+#include <unity.h>
+#include "BatterySession.h"
+
+// Command round trips against a simulated BMS: the event-driven request cycle
+// of BatterySession against the old wait, which polled a response flag every
+// 25 ms and slept another 100 ms once half the timeout had passed.
+
+static const unsigned long RESPONSE_MS[] = {10, 30, 60};
+static const int ROUNDS = 10;
+static const unsigned long TIMEOUT_MS = 5000;
+
+static BatterySession session;
+static SemaphoreHandle_t wakeSemaphore;
+static NativeBms* bms;
+
+// State of the old path, set from the BLE task
+static BLEClient* legacyClient;
+static BatteryProtocol legacyProtocol;
+static BatteryData legacyData;
+static volatile bool responseReceived;
+
+static void legacyGattcHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t* param) {
+    if (event != ESP_GATTC_NOTIFY_EVT || gattcIf != legacyClient->getGattcIf() || responseReceived) {
+        return;
+    }
+    
+    size_t offset = 0;
+    while (offset < param->notify.value_len && !responseReceived) {
+        size_t consumed = 0;
+        FrameResult result = legacyProtocol.feed(param->notify.value + offset, param->notify.value_len - offset, consumed, legacyData);
+        offset += consumed;
+        if (result != FrameResult::NEED_MORE) {
+            responseReceived = true;
+        }
+    }
+}
+
+// The wait loop of the old sendCommandAndWaitResponse(), returns the wall time in microseconds
+static unsigned long legacyRoundTrip(uint8_t cmd) {
+    uint8_t command[10];
+    uint8_t commandLength;
+    responseReceived = false;
+    legacyProtocol.resetParser();
+    legacyProtocol.createCommand(cmd, command, commandLength);
+    
+    unsigned long start = micros();
+    esp_ble_gattc_write_char(legacyClient->getGattcIf(), legacyClient->getConnId(), BLERemoteService::WRITE_HANDLE,
+                             commandLength, command, ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
+    
+    unsigned long startTime = millis();
+    int retryCount = 0;
+    while (!responseReceived && (millis() - startTime) < TIMEOUT_MS) {
+        delay(25);
+        if ((millis() - startTime) > (TIMEOUT_MS / 2) && retryCount < 3) {
+            retryCount++;
+            delay(100);
+            if (responseReceived) {
+                break;
+            }
+        }
+    }
+    
+    TEST_ASSERT_TRUE(responseReceived);
+    return micros() - start;
+}
+
+// One request through BatterySession, waiting on the semaphore like BluetoothManager::runRequests
+static unsigned long sessionRoundTrip(uint8_t cmd, unsigned long& measured) {
+    BatteryData data;
+    
+    unsigned long start = micros();
+    TEST_ASSERT_TRUE(session.startRequest(&cmd, 1, data, TIMEOUT_MS));
+    while (!session.serviceRequest()) {
+        long remaining = session.msUntilNextDeadline();
+        xSemaphoreTake(wakeSemaphore, pdMS_TO_TICKS(remaining > 0 ? remaining : 1));
+    }
+    session.endRequest();
+    unsigned long elapsed = micros() - start;
+    
+    TEST_ASSERT_TRUE(session.commandSucceeded(cmd));
+    TEST_ASSERT_TRUE(data.dataValid);
+    measured = session.getLastRoundTripMicros(cmd);
+    return elapsed;
+}
+
+void setUp() {
+    if (legacyClient != nullptr) {
+        return;
+    }
+    
+    nativeUseHostClock();
+    bms = &nativeBle().addBms(BATTERY_MAC_ADDRESSES[0].c_str());
+    bms->connectMs = 1;
+    bms->discoveryMs = 1;
+    
+    wakeSemaphore = xSemaphoreCreateBinary();
+    BLEDevice::setCustomGattcHandler(BatterySession::gattcEventHandler);
+    TEST_ASSERT_TRUE(session.begin(BATTERY_MAC_ADDRESSES[0], wakeSemaphore));
+    TEST_ASSERT_TRUE(session.connect());
+    
+    // A second link to the same BMS for the old path
+    legacyClient = BLEDevice::createClient();
+    TEST_ASSERT_TRUE(legacyClient->connect(BLEAddress(BATTERY_MAC_ADDRESSES[0].c_str())));
+}
+
+void tearDown() {
+}
+
+void test_round_trip_event_driven_vs_polling() {
+    printf("response   polling wait   event wait   measured round trip\n");
+    
+    for (size_t r = 0; r < sizeof(RESPONSE_MS) / sizeof(RESPONSE_MS[0]); r++) {
+        bms->responseMs = RESPONSE_MS[r];
+        unsigned long legacyTotal = 0;
+        unsigned long sessionTotal = 0;
+        unsigned long measuredTotal = 0;
+        
+        for (int i = 0; i < ROUNDS; i++) {
+            BLEDevice::setCustomGattcHandler(legacyGattcHandler);
+            legacyTotal += legacyRoundTrip(CMD_READ_BASIC_INFO);
+            
+            BLEDevice::setCustomGattcHandler(BatterySession::gattcEventHandler);
+            unsigned long measured = 0;
+            sessionTotal += sessionRoundTrip(CMD_READ_BASIC_INFO, measured);
+            measuredTotal += measured;
+        }
+        
+        unsigned long legacyMean = legacyTotal / ROUNDS;
+        unsigned long sessionMean = sessionTotal / ROUNDS;
+        unsigned long measuredMean = measuredTotal / ROUNDS;
+        printf("%5lu ms   %9.1f ms   %7.1f ms   %12.1f ms\n",
+               RESPONSE_MS[r], legacyMean / 1000.0, sessionMean / 1000.0, measuredMean / 1000.0);
+        
+        // Both see the same BMS; only the polling wait rounds up to its 25 ms grid
+        TEST_ASSERT_LESS_THAN(legacyMean, sessionMean);
+        TEST_ASSERT_GREATER_OR_EQUAL(RESPONSE_MS[r] * 1000, measuredMean);
+        TEST_ASSERT_LESS_OR_EQUAL(measuredMean + 5000, sessionMean);
+    }
+}
+
+void test_pipelined_commands_are_routed() {
+    // Both commands go out back to back, each frame completes its own entry
+    const uint8_t commands[] = {CMD_READ_BASIC_INFO, CMD_READ_CELL_VOLTAGES};
+    BatteryData data;
+    bms->responseMs = 20;
+    
+    TEST_ASSERT_TRUE(session.startRequest(commands, 2, data, TIMEOUT_MS));
+    while (!session.serviceRequest()) {
+        xSemaphoreTake(wakeSemaphore, pdMS_TO_TICKS(session.msUntilNextDeadline() + 1));
+    }
+    session.endRequest();
+    
+    TEST_ASSERT_TRUE(session.commandSucceeded(CMD_READ_BASIC_INFO));
+    TEST_ASSERT_TRUE(session.commandSucceeded(CMD_READ_CELL_VOLTAGES));
+    TEST_ASSERT_EQUAL_UINT16(1330, data.voltage10mV);
+    TEST_ASSERT_EQUAL_UINT8(4, data.numCells);
+    TEST_ASSERT_EQUAL_UINT16(3323, data.cellMillivolts[3]);
+    TEST_ASSERT_LESS_THAN(session.getLastRoundTripMicros(CMD_READ_CELL_VOLTAGES),
+                          session.getLastRoundTripMicros(CMD_READ_BASIC_INFO));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip_event_driven_vs_polling);
+    RUN_TEST(test_pipelined_commands_are_routed);
+    return UNITY_END();
+}
@@ -0,0 +1,94 @@
+#include <unity.h>
+#include "HistoryBuffer.h"
+
+// About 70 KB, too large for the stack
+static HistoryBuffer* history;
+
+void setUp() {
+    history = new HistoryBuffer();
+}
+
+void tearDown() {
+    delete history;
+}
+
+static BatteryData sample(uint16_t voltage10mV, int16_t current10mA) {
+    BatteryData data;
+    data.clear();
+    data.voltage10mV = voltage10mV;
+    data.current10mA = current10mA;
+    data.remaining10mAh = 5000;
+    data.nominal10mAh = 10000;
+    data.temperature01K = 2981;
+    return data;
+}
+
+void test_empty_history() {
+    HistoryBucket bucket;
+    TEST_ASSERT_EQUAL(0, history->size(0));
+    TEST_ASSERT_EQUAL_UINT32(0, history->getOldestTime(0));
+    TEST_ASSERT_FALSE(history->summarize(0, 0, 0xFFFFFFFF, bucket));
+}
+
+void test_summarize_range() {
+    for (uint32_t t = 0; t < 100; t++) {
+        history->add(0, sample(1300 + t, (int16_t)(t % 2 ? -100 : 100)), 1000 + t * 10);
+    }
+    
+    // Samples at 1100 ... 1190
+    HistoryBucket bucket;
+    TEST_ASSERT_TRUE(history->summarize(0, 1100, 1200, bucket));
+    TEST_ASSERT_EQUAL(10, bucket.count);
+    TEST_ASSERT_EQUAL(1310, bucket.minVoltage10mV);
+    TEST_ASSERT_EQUAL(1319, bucket.maxVoltage10mV);
+    TEST_ASSERT_EQUAL_INT32(13145, bucket.sumVoltage10mV);
+    TEST_ASSERT_EQUAL_INT16(-100, bucket.minCurrent10mA);
+    TEST_ASSERT_EQUAL_INT16(100, bucket.maxCurrent10mA);
+    TEST_ASSERT_EQUAL_INT32(0, bucket.sumCurrent10mA);
+    TEST_ASSERT_EQUAL_UINT32(5000, bucket.sumSoc01);
+    TEST_ASSERT_EQUAL(10, bucket.temperatureCount);
+    
+    // to is exclusive, gaps between samples are empty
+    TEST_ASSERT_FALSE(history->summarize(0, 1105, 1110, bucket));
+    TEST_ASSERT_TRUE(history->summarize(0, 1105, 1111, bucket));
+    TEST_ASSERT_EQUAL(1, bucket.count);
+    
+    // Other batteries are separate
+    TEST_ASSERT_FALSE(history->summarize(1, 0, 0xFFFFFFFF, bucket));
+}
+
+void test_full_ring_replaces_oldest() {
+    uint32_t total = HISTORY_SAMPLES + 100;
+    for (uint32_t t = 0; t < total; t++) {
+        history->add(0, sample(1300, 0), t);
+    }
+    TEST_ASSERT_EQUAL(HISTORY_SAMPLES, history->size(0));
+    TEST_ASSERT_EQUAL_UINT32(100, history->getOldestTime(0));
+    
+    HistoryBucket bucket;
+    TEST_ASSERT_FALSE(history->summarize(0, 0, 100, bucket));
+    TEST_ASSERT_TRUE(history->summarize(0, 0, 0xFFFFFFFF, bucket));
+    TEST_ASSERT_EQUAL(HISTORY_SAMPLES, bucket.count);
+    TEST_ASSERT_TRUE(history->summarize(0, total - 5, total, bucket));
+    TEST_ASSERT_EQUAL(5, bucket.count);
+}
+
+void test_invalid_arguments() {
+    history->add(-1, sample(1300, 0), 1);
+    history->add(BATTERY_COUNT, sample(1300, 0), 1);
+    
+    HistoryBucket bucket;
+    TEST_ASSERT_FALSE(history->summarize(BATTERY_COUNT, 0, 10, bucket));
+    history->add(0, sample(1300, 0), 5);
+    TEST_ASSERT_FALSE(history->summarize(0, 10, 10, bucket));
+    TEST_ASSERT_FALSE(history->summarize(0, 10, 5, bucket));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_history);
+    RUN_TEST(test_summarize_range);
+    RUN_TEST(test_full_ring_replaces_oldest);
+    RUN_TEST(test_invalid_arguments);
+    return UNITY_END();
+}
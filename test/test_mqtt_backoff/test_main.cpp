@@ -0,0 +1,166 @@
+#include <unity.h>
+#include "MqttClient.h"
+
+// Reconnect timing of MqttClient on the fake clock. Attempts go to a closed
+// loopback port, so every TCP connect is refused right away.
+
+static const unsigned long STEP_MS = 10;
+
+static uint16_t closedPort;
+
+// Runs loop() on the fake clock until the next connection attempt starts,
+// returns the time that took (0 if none within limitMs)
+static unsigned long untilNextAttempt(MqttClient& client, unsigned long limitMs) {
+    uint32_t attempts = client.getConnectAttempts();
+    unsigned long start = millis();
+    while (millis() - start < limitMs) {
+        nativeMillis() += STEP_MS;
+        client.loop();
+        if (client.getConnectAttempts() != attempts) {
+            return millis() - start;
+        }
+    }
+    return 0;
+}
+
+// Retry ceiling after the given number of failures in a row
+static unsigned long ceilingAfter(int failures) {
+    unsigned long ceiling = (unsigned long)MQTT_BACKOFF_MIN_MS << (failures - 1);
+    return ceiling < MQTT_BACKOFF_MAX_MS ? ceiling : MQTT_BACKOFF_MAX_MS;
+}
+
+void setUp() {
+    nativeMillis() = 100000;
+    nativeWiFi().setStatus(WL_CONNECTED);
+    nativeBroker().accepting = true;
+    if (closedPort == 0) {
+        closedPort = nativeBroker().listen();
+        nativeBroker().stop();
+    }
+}
+
+void tearDown() {
+}
+
+void test_backoff_doubles_up_to_the_limit() {
+    MqttClient* client = new MqttClient();
+    client->begin("127.0.0.1", closedPort, "user", "password", "backoff");
+    
+    // First attempt right away
+    TEST_ASSERT_LESS_OR_EQUAL(STEP_MS, untilNextAttempt(*client, 1000));
+    
+    for (int failures = 1; failures <= 10; failures++) {
+        unsigned long ceiling = ceilingAfter(failures);
+        unsigned long waited = untilNextAttempt(*client, MQTT_BACKOFF_MAX_MS + 1000);
+        
+        // Randomized within the upper half of the ceiling, the fake clock moves in steps
+        TEST_ASSERT_GREATER_OR_EQUAL(ceiling / 2, waited);
+        TEST_ASSERT_LESS_OR_EQUAL(ceiling + 2 * STEP_MS, waited);
+    }
+    
+    // The refused connect of the last attempt is picked up on the next pass
+    nativeMillis() += STEP_MS;
+    client->loop();
+    TEST_ASSERT_EQUAL_UINT32(11, client->getConnectAttempts());
+    TEST_ASSERT_EQUAL_UINT32(11, client->getConnectFailures());
+    TEST_ASSERT_FALSE(client->isConnected());
+}
+
+void test_jitter_spreads_retries() {
+    // Loggers that fail together must not retry together: two runs with
+    // different random sequences take different delays, and at the limit
+    // the delays cover the upper half of the ceiling
+    MqttClient* first = new MqttClient();
+    MqttClient* second = new MqttClient();
+    nativeRandomState() = 1;
+    first->begin("127.0.0.1", closedPort, "user", "password", "first");
+    nativeRandomState() = 2;
+    second->begin("127.0.0.1", closedPort, "user", "password", "second");
+    untilNextAttempt(*first, 1000);
+    untilNextAttempt(*second, 1000);
+    
+    int identical = 0;
+    unsigned long shortest = MQTT_BACKOFF_MAX_MS;
+    unsigned long longest = 0;
+    for (int failures = 1; failures <= 40; failures++) {
+        unsigned long a = untilNextAttempt(*first, MQTT_BACKOFF_MAX_MS + 1000);
+        unsigned long b = untilNextAttempt(*second, MQTT_BACKOFF_MAX_MS + 1000);
+        if (a == b) {
+            identical++;
+        }
+        if (ceilingAfter(failures) == MQTT_BACKOFF_MAX_MS) {
+            shortest = min(shortest, min(a, b));
+            longest = max(longest, max(a, b));
+        }
+    }
+    
+    TEST_ASSERT_LESS_OR_EQUAL(4, identical);
+    TEST_ASSERT_LESS_OR_EQUAL(MQTT_BACKOFF_MAX_MS * 6 / 10, shortest);
+    TEST_ASSERT_GREATER_OR_EQUAL(MQTT_BACKOFF_MAX_MS * 9 / 10, longest);
+}
+
+void test_no_attempts_without_wifi() {
+    MqttClient* client = new MqttClient();
+    nativeWiFi().setStatus(WL_DISCONNECTED);
+    client->begin("127.0.0.1", closedPort, "user", "password", "offline");
+    
+    TEST_ASSERT_EQUAL(0, untilNextAttempt(*client, 10000));
+    
+    nativeWiFi().setStatus(WL_CONNECTED);
+    TEST_ASSERT_LESS_OR_EQUAL(STEP_MS, untilNextAttempt(*client, 1000));
+}
+
+void test_lost_connection_retries_quickly() {
+    // A drop after a good session starts over at the shortest delay
+    uint16_t port = nativeBroker().listen();
+    MqttClient* client = new MqttClient();
+    client->begin("127.0.0.1", port, "user", "password", "drop");
+    
+    for (int i = 0; i < 100 && !client->isConnected(); i++) {
+        nativeMillis() += STEP_MS;
+        client->loop();
+    }
+    TEST_ASSERT_TRUE(client->isConnected());
+    
+    nativeBroker().dropSessions();
+    client->loop();
+    TEST_ASSERT_FALSE(client->isConnected());
+    
+    unsigned long waited = untilNextAttempt(*client, MQTT_BACKOFF_MAX_MS);
+    TEST_ASSERT_GREATER_OR_EQUAL(MQTT_BACKOFF_MIN_MS / 2, waited);
+    TEST_ASSERT_LESS_OR_EQUAL(MQTT_BACKOFF_MIN_MS + STEP_MS, waited);
+    
+    for (int i = 0; i < 100 && !client->isConnected(); i++) {
+        nativeMillis() += STEP_MS;
+        client->loop();
+    }
+    TEST_ASSERT_TRUE(client->isConnected());
+    nativeBroker().stop();
+}
+
+void test_rejected_handshake_backs_off() {
+    // TCP up but CONNECT refused counts as a failed attempt like a refused socket
+    uint16_t port = nativeBroker().listen();
+    nativeBroker().accepting = false;
+    MqttClient* client = new MqttClient();
+    client->begin("127.0.0.1", port, "user", "password", "rejected");
+    untilNextAttempt(*client, 1000);
+    
+    for (int failures = 1; failures <= 3; failures++) {
+        unsigned long waited = untilNextAttempt(*client, MQTT_BACKOFF_MAX_MS);
+        TEST_ASSERT_GREATER_OR_EQUAL(ceilingAfter(failures) / 2, waited);
+        TEST_ASSERT_FALSE(client->isConnected());
+    }
+    TEST_ASSERT_EQUAL_UINT32(client->getConnectAttempts() - 1, client->getConnectFailures());
+    nativeBroker().stop();
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_backoff_doubles_up_to_the_limit);
+    RUN_TEST(test_jitter_spreads_retries);
+    RUN_TEST(test_no_attempts_without_wifi);
+    RUN_TEST(test_lost_connection_retries_quickly);
+    RUN_TEST(test_rejected_handshake_backs_off);
+    return UNITY_END();
+}
@@ -0,0 +1,215 @@
+#include <unity.h>
+#include <new>
+#include <stdlib.h>
+#include "MqttClient.h"
+
+// Heap use and time per battery publish: MqttClient with its fixed document,
+// buffer and precomputed topics against the former path, which built a
+// DynamicJsonDocument(1024), serialized into a growable string and
+// concatenated the topic on every publish. Both publish into the same
+// in-process broker with message recording off, so the broker side
+// allocates nothing.
+
+static const int PUBLISHES = 2000;
+
+// Allocations of the whole binary while counting is on
+static bool counting;
+static uint32_t allocations;
+static size_t allocatedBytes;
+
+void* operator new(size_t size) {
+    if (counting) {
+        allocations++;
+        allocatedBytes += size;
+    }
+    void* block = malloc(size > 0 ? size : 1);
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+// DynamicJsonDocument allocates its pool through malloc, this allocator counts it the same way
+struct CountingAllocator {
+    void* allocate(size_t size) {
+        if (counting) {
+            allocations++;
+            allocatedBytes += size;
+        }
+        return malloc(size);
+    }
+    
+    void deallocate(void* block) {
+        free(block);
+    }
+    
+    void* reallocate(void* block, size_t size) {
+        if (counting) {
+            allocations++;
+            allocatedBytes += size;
+        }
+        return realloc(block, size);
+    }
+};
+
+struct Measurement {
+    uint32_t allocations;
+    size_t bytes;
+    unsigned long micros;
+};
+
+static MqttClient mqttClient;
+static WiFiClient baselineSocket;
+static PubSubClient baselineClient(baselineSocket);
+static BatteryData sample;
+
+// The old publishSample() and createBatteryTopic()
+static bool baselinePublish(const BatteryData& data) {
+    BasicJsonDocument<CountingAllocator> doc(1024);
+    
+    doc["timestamp"] = data.timestamp;
+    String macAddress = data.getMacAddress();
+    doc["macAddress"] = std::string(macAddress.c_str());
+    doc["voltage"] = data.getVoltage();
+    doc["current"] = data.getCurrent();
+    doc["remainingAh"] = data.getRemainingAh();
+    doc["maxAh"] = data.getMaxAh();
+    doc["watts"] = data.getWatts();
+    doc["soc"] = data.getSoc();
+    doc["temperature"] = data.getTemperature();
+    doc["switches"] = data.getSwitches();
+    doc["numCells"] = data.numCells;
+    doc["dataValid"] = data.dataValid;
+    
+    JsonArray cellVoltages = doc.createNestedArray("cellVoltages");
+    for (int i = 0; i < data.numCells && i < BATTERY_MAX_CELLS; i++) {
+        cellVoltages.add(data.getCellVoltage(i));
+    }
+    
+    // std::string stands in for the Arduino String, both grow on the heap
+    std::string jsonString;
+    serializeJson(doc, jsonString);
+    
+    String cleanMac = macAddress;
+    cleanMac.replace(":", "");
+    cleanMac.toLowerCase();
+    String topic = String(MQTT_TOPIC_PREFIX) + "/battery/" + cleanMac + "/" + "data";
+    
+    return baselineClient.publish(topic.c_str(), jsonString.c_str(), true);
+}
+
+// Each publish moves the voltage past the deadband, so none is suppressed
+static Measurement measure(bool baseline) {
+    BatteryData data = sample;
+    Measurement result;
+    
+    allocations = 0;
+    allocatedBytes = 0;
+    unsigned long start = micros();
+    counting = true;
+    for (int i = 0; i < PUBLISHES; i++) {
+        data.voltage10mV = sample.voltage10mV + (i % 2) * 10;
+        bool sent = baseline ? baselinePublish(data) : mqttClient.publishBatteryData(data, 1700000000UL + i);
+        TEST_ASSERT_TRUE(sent);
+    }
+    counting = false;
+    
+    result.micros = micros() - start;
+    result.allocations = allocations;
+    result.bytes = allocatedBytes;
+    return result;
+}
+
+static int connectTo(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL(0, connect(fd, (struct sockaddr*)&address, sizeof(address)));
+    return fd;
+}
+
+void setUp() {
+    if (mqttClient.isConnected()) {
+        return;
+    }
+    
+    nativeUseHostClock();
+    uint16_t port = nativeBroker().listen();
+    TEST_ASSERT_TRUE(port != 0);
+    
+    mqttClient.begin("127.0.0.1", port, "user", "password", "bench");
+    for (int i = 0; i < 100 && !mqttClient.isConnected(); i++) {
+        mqttClient.loop();
+        delay(1);
+    }
+    TEST_ASSERT_TRUE(mqttClient.isConnected());
+    
+    baselineSocket = WiFiClient(connectTo(port));
+    TEST_ASSERT_TRUE(baselineClient.connect("baseline", "user", "password"));
+    
+    sample.clear();
+    sample.setMacAddress(BATTERY_MAC_ADDRESSES[0]);
+    sample.voltage10mV = 1330;
+    sample.current10mA = -100;
+    sample.remaining10mAh = 5000;
+    sample.nominal10mAh = 10000;
+    sample.temperature01K = 2981;
+    sample.switches = 0x03;
+    sample.numCells = 4;
+    for (int i = 0; i < sample.numCells; i++) {
+        sample.cellMillivolts[i] = 3320 + i;
+    }
+    sample.dataValid = true;
+}
+
+void tearDown() {
+}
+
+void test_publish_payloads_match() {
+    // Same document layout on both paths, only the timestamp differs
+    nativeBroker().clear();
+    TEST_ASSERT_TRUE(baselinePublish(sample));
+    sample.voltage10mV += 10;
+    TEST_ASSERT_TRUE(mqttClient.publishBatteryData(sample, 1700000000UL));
+    sample.voltage10mV -= 10;
+    
+    TEST_ASSERT_EQUAL(2, nativeBroker().messages.size());
+    const NativeMqttMessage& before = nativeBroker().messages[0];
+    const NativeMqttMessage& after = nativeBroker().messages[1];
+    TEST_ASSERT_EQUAL_STRING(before.topic.c_str(), after.topic.c_str());
+    TEST_ASSERT_TRUE(after.retained);
+    TEST_ASSERT_TRUE(after.payload.find("\"macAddress\"") != std::string::npos);
+    TEST_ASSERT_TRUE(after.payload.find("\"cellVoltages\":[") != std::string::npos);
+    TEST_ASSERT_TRUE(after.payload.find("\"timestamp\":1700000000") != std::string::npos);
+}
+
+void test_publish_allocations_and_time() {
+    nativeBroker().recording = false;
+    Measurement baseline = measure(true);
+    Measurement fixed = measure(false);
+    nativeBroker().recording = true;
+    
+    printf("per publish: DynamicJsonDocument + String %.1f allocations, %.0f bytes, %.2f us\n",
+           (double)baseline.allocations / PUBLISHES, (double)baseline.bytes / PUBLISHES,
+           (double)baseline.micros / PUBLISHES);
+    printf("per publish: fixed document + buffer     %.1f allocations, %.0f bytes, %.2f us\n",
+           (double)fixed.allocations / PUBLISHES, (double)fixed.bytes / PUBLISHES,
+           (double)fixed.micros / PUBLISHES);
+    
+    TEST_ASSERT_EQUAL_UINT32(0, fixed.allocations);
+    TEST_ASSERT_GREATER_OR_EQUAL(1024 * PUBLISHES, baseline.bytes);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_publish_payloads_match);
+    RUN_TEST(test_publish_allocations_and_time);
+    return UNITY_END();
+}
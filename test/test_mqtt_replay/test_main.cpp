@@ -0,0 +1,145 @@
+#include <unity.h>
+#include <LittleFS.h>
+#include "MqttClient.h"
+
+// Store and forward end to end: MqttClient against the in-process broker,
+// which first refuses sessions and then accepts them again. Samples queued in
+// between must arrive in order with the time they were measured.
+
+static const unsigned long STEP_MS = 10;
+static const uint32_t FIRST_TIME = 1700000000UL;
+
+static MqttClient* mqttClient;
+
+static void runFor(unsigned long ms) {
+    for (unsigned long waited = 0; waited < ms; waited += STEP_MS) {
+        nativeMillis() += STEP_MS;
+        mqttClient->loop();
+    }
+}
+
+// Every sample differs from the previous one beyond the voltage deadband
+static BatteryData makeSample(uint32_t i) {
+    BatteryData data;
+    data.clear();
+    data.setMacAddress(BATTERY_MAC_ADDRESSES[0]);
+    data.voltage10mV = 1300 + (i % 2) * 5;
+    data.remaining10mAh = 5000;
+    data.nominal10mAh = 10000;
+    data.numCells = 4;
+    for (int cell = 0; cell < data.numCells; cell++) {
+        data.cellMillivolts[cell] = 3320;
+    }
+    data.dataValid = true;
+    return data;
+}
+
+// Measurement times of the battery messages the broker got, in arrival order
+static std::vector<uint32_t> receivedTimes() {
+    std::vector<uint32_t> times;
+    const std::vector<NativeMqttMessage>& messages = nativeBroker().messages;
+    for (size_t i = 0; i < messages.size(); i++) {
+        const std::string& topic = messages[i].topic;
+        if (topic.size() < 5 || topic.compare(topic.size() - 5, 5, "/data") != 0) {
+            continue;
+        }
+        size_t field = messages[i].payload.find("\"timestamp\":");
+        TEST_ASSERT_TRUE(field != std::string::npos);
+        times.push_back(strtoul(messages[i].payload.c_str() + field + 12, nullptr, 10));
+    }
+    return times;
+}
+
+void setUp() {
+    nativeMillis() = 100000;
+    nativeWiFi().setStatus(WL_CONNECTED);
+    LittleFS.format();
+    nativeBroker().accepting = true;
+    nativeBroker().clear();
+    
+    uint16_t port = nativeBroker().listen();
+    mqttClient = new MqttClient();
+    mqttClient->begin("127.0.0.1", port, "user", "password", "replay");
+    runFor(100);
+    TEST_ASSERT_TRUE(mqttClient->isConnected());
+}
+
+void tearDown() {
+    nativeBroker().stop();
+}
+
+static void replayAfterOutage(uint32_t count) {
+    // Broker gone: sessions drop and reconnects are refused
+    nativeBroker().accepting = false;
+    nativeBroker().dropSessions();
+    runFor(100);
+    TEST_ASSERT_FALSE(mqttClient->isConnected());
+    nativeBroker().clear();
+    
+    for (uint32_t i = 0; i < count; i++) {
+        TEST_ASSERT_FALSE(mqttClient->publishBatteryData(makeSample(i), FIRST_TIME + i));
+        runFor(1000);
+    }
+    TEST_ASSERT_EQUAL_UINT32(count, mqttClient->getQueuedSamples());
+    TEST_ASSERT_EQUAL_UINT32(0, nativeBroker().publishes);
+    
+    nativeBroker().accepting = true;
+    nativeBroker().clear();
+    LittleFS.resetCounters();
+    runFor(MQTT_BACKOFF_MAX_MS + (count / MQTT_REPLAY_BATCH + 1) * MQTT_REPLAY_INTERVAL_MS);
+    TEST_ASSERT_TRUE(mqttClient->isConnected());
+    TEST_ASSERT_EQUAL_UINT32(0, mqttClient->getQueuedSamples());
+    TEST_ASSERT_EQUAL_UINT32(0, mqttClient->getDroppedSamples());
+    
+    std::vector<uint32_t> times = receivedTimes();
+    TEST_ASSERT_EQUAL(count, times.size());
+    for (uint32_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL_UINT32(FIRST_TIME + i, times[i]);
+    }
+}
+
+void test_ram_queue_replays_in_order() {
+    replayAfterOutage(MQTT_QUEUE_RAM_SAMPLES / 2);
+    TEST_ASSERT_EQUAL_UINT32(0, LittleFS.writeOpens);
+}
+
+void test_spilled_queue_replays_in_order() {
+    uint32_t count = MQTT_QUEUE_RAM_SAMPLES + 2 * MQTT_QUEUE_SPILL_SEGMENT_SAMPLES + 7;
+    replayAfterOutage(count);
+    
+    // The read position is stored once per replay batch, not per sample
+    uint32_t spilled = count - MQTT_QUEUE_RAM_SAMPLES;
+    TEST_ASSERT_LESS_OR_EQUAL(spilled / MQTT_REPLAY_BATCH + 4, LittleFS.writeOpens);
+}
+
+void test_live_samples_wait_behind_the_queue() {
+    // A sample measured after the reconnect is published after the queued ones
+    nativeBroker().accepting = false;
+    nativeBroker().dropSessions();
+    runFor(100);
+    for (uint32_t i = 0; i < 10; i++) {
+        mqttClient->publishBatteryData(makeSample(i), FIRST_TIME + i);
+    }
+    
+    nativeBroker().accepting = true;
+    nativeBroker().clear();
+    while (!mqttClient->isConnected()) {
+        runFor(STEP_MS);
+    }
+    TEST_ASSERT_FALSE(mqttClient->publishBatteryData(makeSample(10), FIRST_TIME + 10));
+    runFor(10 * MQTT_REPLAY_INTERVAL_MS);
+    
+    std::vector<uint32_t> times = receivedTimes();
+    TEST_ASSERT_EQUAL(11, times.size());
+    for (uint32_t i = 0; i < times.size(); i++) {
+        TEST_ASSERT_EQUAL_UINT32(FIRST_TIME + i, times[i]);
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_ram_queue_replays_in_order);
+    RUN_TEST(test_spilled_queue_replays_in_order);
+    RUN_TEST(test_live_samples_wait_behind_the_queue);
+    return UNITY_END();
+}
@@ -0,0 +1,143 @@
+#include <unity.h>
+#include "NotificationRing.h"
+
+static NotificationRing* ring;
+
+void setUp() {
+    ring = new NotificationRing();
+}
+
+void tearDown() {
+    delete ring;
+}
+
+// Copies a record out of its one or two segments
+static size_t collect(const NotificationRing::RecordView& record, uint8_t* out) {
+    memcpy(out, record.first, record.firstLength);
+    memcpy(out + record.firstLength, record.second, record.secondLength);
+    return record.firstLength + record.secondLength;
+}
+
+static void fill(uint8_t* data, size_t length, uint8_t seed) {
+    for (size_t i = 0; i < length; i++) {
+        data[i] = (uint8_t)(seed + i * 7);
+    }
+}
+
+void test_empty_ring() {
+    NotificationRing::RecordView record;
+    TEST_ASSERT_FALSE(ring->peek(record));
+    ring->consume();
+    TEST_ASSERT_FALSE(ring->peek(record));
+}
+
+void test_records_keep_order_and_boundaries() {
+    uint8_t a[20], b[3], c[64];
+    fill(a, sizeof(a), 1);
+    fill(b, sizeof(b), 2);
+    fill(c, sizeof(c), 3);
+    TEST_ASSERT_TRUE(ring->push(a, sizeof(a), 100));
+    TEST_ASSERT_TRUE(ring->push(b, sizeof(b), 200));
+    TEST_ASSERT_TRUE(ring->push(c, sizeof(c), 0xDEADBEEF));
+    
+    const uint8_t* expected[] = {a, b, c};
+    const size_t lengths[] = {sizeof(a), sizeof(b), sizeof(c)};
+    const uint32_t times[] = {100, 200, 0xDEADBEEF};
+    
+    uint8_t out[128];
+    NotificationRing::RecordView record;
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_TRUE(ring->peek(record));
+        TEST_ASSERT_EQUAL_UINT32(times[i], record.timestampMicros);
+        TEST_ASSERT_EQUAL(lengths[i], collect(record, out));
+        TEST_ASSERT_EQUAL_MEMORY(expected[i], out, lengths[i]);
+        
+        // Peek does not consume
+        TEST_ASSERT_TRUE(ring->peek(record));
+        TEST_ASSERT_EQUAL_UINT32(times[i], record.timestampMicros);
+        ring->consume();
+    }
+    TEST_ASSERT_FALSE(ring->peek(record));
+}
+
+void test_payload_wraps_around_the_end() {
+    // Odd record sizes move the wrap point through every offset, headers included
+    uint8_t data[101];
+    uint8_t out[101];
+    NotificationRing::RecordView record;
+    bool split = false;
+    
+    for (int i = 0; i < 500; i++) {
+        size_t length = 1 + (i * 37) % sizeof(data);
+        fill(data, length, (uint8_t)i);
+        TEST_ASSERT_TRUE(ring->push(data, length, i));
+        
+        TEST_ASSERT_TRUE(ring->peek(record));
+        TEST_ASSERT_EQUAL_UINT32((uint32_t)i, record.timestampMicros);
+        TEST_ASSERT_EQUAL(length, collect(record, out));
+        TEST_ASSERT_EQUAL_MEMORY(data, out, length);
+        if (record.secondLength > 0) {
+            split = true;
+        }
+        ring->consume();
+    }
+    TEST_ASSERT_TRUE(split);
+    TEST_ASSERT_EQUAL_UINT32(0, ring->getDroppedFragments());
+}
+
+void test_full_ring_drops_whole_fragments() {
+    uint8_t data[250];
+    fill(data, sizeof(data), 9);
+    
+    // 256 bytes per record, eight fill the ring exactly
+    int pushed = 0;
+    while (ring->push(data, sizeof(data), pushed)) {
+        pushed++;
+    }
+    TEST_ASSERT_EQUAL(8, pushed);
+    TEST_ASSERT_EQUAL_UINT32(1, ring->getDroppedFragments());
+    
+    TEST_ASSERT_FALSE(ring->push(data, 1, 0));
+    TEST_ASSERT_EQUAL_UINT32(2, ring->getDroppedFragments());
+    
+    // Space becomes available again once a record is consumed
+    ring->consume();
+    TEST_ASSERT_TRUE(ring->push(data, sizeof(data), 99));
+    
+    NotificationRing::RecordView record;
+    TEST_ASSERT_TRUE(ring->peek(record));
+    TEST_ASSERT_EQUAL_UINT32(1, record.timestampMicros);
+}
+
+void test_rejects_invalid_fragments() {
+    uint8_t data[1] = {0};
+    TEST_ASSERT_FALSE(ring->push(nullptr, 1, 0));
+    TEST_ASSERT_FALSE(ring->push(data, 0, 0));
+    TEST_ASSERT_FALSE(ring->push(data, NotificationRing::CAPACITY, 0));
+}
+
+void test_clear_skips_pending_records() {
+    uint8_t data[10];
+    fill(data, sizeof(data), 4);
+    ring->push(data, sizeof(data), 1);
+    ring->push(data, sizeof(data), 2);
+    ring->clear();
+    
+    NotificationRing::RecordView record;
+    TEST_ASSERT_FALSE(ring->peek(record));
+    
+    ring->push(data, sizeof(data), 3);
+    TEST_ASSERT_TRUE(ring->peek(record));
+    TEST_ASSERT_EQUAL_UINT32(3, record.timestampMicros);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_ring);
+    RUN_TEST(test_records_keep_order_and_boundaries);
+    RUN_TEST(test_payload_wraps_around_the_end);
+    RUN_TEST(test_full_ring_drops_whole_fragments);
+    RUN_TEST(test_rejects_invalid_fragments);
+    RUN_TEST(test_clear_skips_pending_records);
+    return UNITY_END();
+}
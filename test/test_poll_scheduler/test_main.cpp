@@ -0,0 +1,123 @@
+#include <unity.h>
+#include "PollScheduler.h"
+
+static const long CAPACITY = (long)(POLL_DUTY_WINDOW_MS * POLL_RADIO_DUTY_PERCENT / 100);
+
+static PollScheduler scheduler;
+static BatteryData idle;
+static BatteryData charging;
+
+void setUp() {
+    nativeMillis() = 1000;
+    scheduler = PollScheduler();
+    scheduler.begin(0);
+    
+    idle.clear();
+    idle.voltage10mV = 1330;
+    idle.remaining10mAh = 5000;
+    idle.nominal10mAh = 10000;
+    idle.dataValid = true;
+    
+    charging = idle;
+    charging.current10mA = 1000;    // 10 A, 133 W
+}
+
+void tearDown() {
+}
+
+static void advance(unsigned long ms) {
+    nativeMillis() += ms;
+}
+
+void test_budget_refills_with_frequent_calls() {
+    // Drain the bucket, then check it every millisecond: each call earns
+    // less than a whole millisecond, the remainder must carry over
+    scheduler.recordPoll(0, true, idle, CAPACITY);
+    TEST_ASSERT_EQUAL(0, scheduler.getBudgetMs());
+    
+    for (int i = 0; i < 10000; i++) {
+        advance(1);
+        scheduler.nextDueBattery();
+    }
+    
+    long expected = 10000L * POLL_RADIO_DUTY_PERCENT / 100;
+    TEST_ASSERT_GREATER_OR_EQUAL(expected - 1, scheduler.getBudgetMs());
+    TEST_ASSERT_LESS_OR_EQUAL(expected, scheduler.getBudgetMs());
+}
+
+void test_budget_is_capped() {
+    scheduler.recordPoll(0, true, idle, 1000);
+    advance(10 * POLL_DUTY_WINDOW_MS);
+    scheduler.nextDueBattery();
+    TEST_ASSERT_EQUAL(CAPACITY, scheduler.getBudgetMs());
+    
+    // Time spent full is not banked
+    scheduler.recordPoll(0, true, idle, CAPACITY);
+    advance(1000);
+    scheduler.nextDueBattery();
+    TEST_ASSERT_LESS_OR_EQUAL(1000L * POLL_RADIO_DUTY_PERCENT / 100, scheduler.getBudgetMs());
+}
+
+void test_spent_budget_blocks_polls() {
+    scheduler.requestImmediate();
+    scheduler.recordPoll(0, true, idle, CAPACITY + 5000);
+    scheduler.requestImmediate();
+    
+    int indices[BATTERY_COUNT];
+    TEST_ASSERT_EQUAL(-1, scheduler.nextDueBattery());
+    TEST_ASSERT_EQUAL(0, scheduler.collectDueBatteries(indices, BATTERY_COUNT));
+    
+    advance(5000 * 100 / POLL_RADIO_DUTY_PERCENT + 100);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, scheduler.nextDueBattery());
+}
+
+void test_active_battery_polls_fast() {
+    scheduler.recordPoll(0, true, charging, 100);
+    TEST_ASSERT_EQUAL((unsigned long)POLL_INTERVAL_MIN_MS, scheduler.getInterval(0));
+    TEST_ASSERT_EQUAL(millis() + POLL_INTERVAL_MIN_MS, scheduler.getNextDue(0));
+}
+
+void test_idle_battery_backs_off() {
+    unsigned long interval = 0;
+    for (int i = 0; i < 10; i++) {
+        scheduler.recordPoll(0, true, idle, 100);
+        TEST_ASSERT_GREATER_OR_EQUAL(interval, scheduler.getInterval(0));
+        interval = scheduler.getInterval(0);
+        advance(interval);
+    }
+    TEST_ASSERT_EQUAL((unsigned long)POLL_INTERVAL_MAX_MS, interval);
+    
+    // A current step wakes it up again
+    scheduler.recordPoll(0, true, charging, 100);
+    TEST_ASSERT_EQUAL((unsigned long)POLL_INTERVAL_MIN_MS, scheduler.getInterval(0));
+}
+
+void test_failures_back_off() {
+    unsigned long before = scheduler.getInterval(1);
+    scheduler.recordPoll(1, false, idle, 100);
+    TEST_ASSERT_EQUAL(before * 2, scheduler.getInterval(1));
+}
+
+void test_due_batteries_most_overdue_first() {
+    scheduler.recordPoll(0, true, charging, 100);
+    advance(1000);
+    scheduler.recordPoll(1, true, charging, 100);
+    advance(2 * POLL_INTERVAL_MIN_MS);
+    
+    int indices[BATTERY_COUNT];
+    TEST_ASSERT_EQUAL(2, scheduler.collectDueBatteries(indices, BATTERY_COUNT));
+    TEST_ASSERT_EQUAL(0, indices[0]);
+    TEST_ASSERT_EQUAL(1, indices[1]);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_budget_refills_with_frequent_calls);
+    RUN_TEST(test_budget_is_capped);
+    RUN_TEST(test_spent_budget_blocks_polls);
+    RUN_TEST(test_active_battery_polls_fast);
+    RUN_TEST(test_idle_battery_backs_off);
+    RUN_TEST(test_failures_back_off);
+    RUN_TEST(test_due_batteries_most_overdue_first);
+    return UNITY_END();
+}
@@ -0,0 +1,156 @@
+#include <unity.h>
+#include <LittleFS.h>
+#include "PublishQueue.h"
+
+static PublishQueue* queue;
+
+void setUp() {
+    LittleFS.format();
+    queue = new PublishQueue();
+    TEST_ASSERT_TRUE(queue->begin());
+}
+
+void tearDown() {
+    delete queue;
+}
+
+// Samples are told apart by their timestamp
+static void pushSamples(uint32_t first, uint32_t count) {
+    BatteryData data;
+    data.clear();
+    data.dataValid = true;
+    for (uint32_t i = 0; i < count; i++) {
+        data.timestamp = first + i;
+        data.voltage10mV = 1300 + (first + i) % 100;
+        queue->push(data);
+    }
+}
+
+// Pops everything, checks the samples are strictly increasing; returns how many
+static uint32_t drain(uint32_t expectedFirst) {
+    BatteryData data;
+    uint32_t count = 0;
+    uint32_t last = 0;
+    while (queue->peek(data)) {
+        if (count == 0) {
+            TEST_ASSERT_EQUAL_UINT32(expectedFirst, data.timestamp);
+        } else {
+            TEST_ASSERT_GREATER_THAN(last, data.timestamp);
+        }
+        TEST_ASSERT_EQUAL(1300 + data.timestamp % 100, data.voltage10mV);
+        last = data.timestamp;
+        queue->pop();
+        count++;
+        if (count % MQTT_REPLAY_BATCH == 0) {
+            queue->savePosition();
+        }
+    }
+    TEST_ASSERT_TRUE(queue->isEmpty());
+    return count;
+}
+
+void test_ram_only() {
+    pushSamples(1, 10);
+    TEST_ASSERT_EQUAL_UINT32(10, queue->size());
+    TEST_ASSERT_EQUAL_UINT32(0, LittleFS.bytesWritten - LittleFS.fileSize("/mq/read.bin"));
+    TEST_ASSERT_EQUAL_UINT32(10, drain(1));
+}
+
+void test_spill_keeps_order() {
+    uint32_t total = MQTT_QUEUE_RAM_SAMPLES + 3 * MQTT_QUEUE_SPILL_SEGMENT_SAMPLES + 5;
+    pushSamples(1, total);
+    TEST_ASSERT_EQUAL_UINT32(total, queue->size());
+    TEST_ASSERT_EQUAL_UINT32(0, queue->getDroppedSamples());
+    TEST_ASSERT_EQUAL_UINT32(total, drain(1));
+    
+    // Replayed segments are deleted, only the read position remains
+    TEST_ASSERT_EQUAL(1, LittleFS.fileCount());
+}
+
+void test_flash_writes_are_appends() {
+    pushSamples(1, MQTT_QUEUE_RAM_SAMPLES);
+    LittleFS.resetCounters();
+    
+    uint32_t spilled = 10 * MQTT_QUEUE_SPILL_SEGMENT_SAMPLES;
+    pushSamples(MQTT_QUEUE_RAM_SAMPLES + 1, spilled);
+    
+    // Records plus one small header per segment, one open per batch
+    TEST_ASSERT_EQUAL_UINT32(0, LittleFS.bytesOverwritten);
+    TEST_ASSERT_LESS_OR_EQUAL(spilled * (sizeof(BatteryData) + 1), LittleFS.bytesWritten);
+    TEST_ASSERT_LESS_OR_EQUAL(spilled / MQTT_QUEUE_SPILL_BATCH + 1, LittleFS.writeOpens);
+    
+    // Replay only rewrites the small read position file, once per batch
+    // and when a segment is finished
+    LittleFS.resetCounters();
+    BatteryData data;
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_TRUE(queue->peek(data));
+        queue->pop();
+        if ((i + 1) % MQTT_REPLAY_BATCH == 0) {
+            queue->savePosition();
+        }
+    }
+    uint32_t positionWrites = 100 / MQTT_REPLAY_BATCH + 100 / MQTT_QUEUE_SPILL_SEGMENT_SAMPLES + 1;
+    TEST_ASSERT_EQUAL_UINT32(0, LittleFS.bytesOverwritten);
+    TEST_ASSERT_LESS_OR_EQUAL(positionWrites, LittleFS.writeOpens);
+    TEST_ASSERT_LESS_OR_EQUAL(positionWrites * 16, LittleFS.bytesWritten);
+}
+
+void test_resume_after_reboot() {
+    uint32_t spilled = 2 * MQTT_QUEUE_SPILL_SEGMENT_SAMPLES + 7;
+    pushSamples(1, spilled + MQTT_QUEUE_RAM_SAMPLES);
+    
+    BatteryData data;
+    for (int i = 0; i < 20; i++) {
+        queue->peek(data);
+        queue->pop();
+    }
+    queue->savePosition();
+    
+    // Popped without a stored position, these come back after the reboot
+    for (int i = 0; i < 3; i++) {
+        queue->peek(data);
+        queue->pop();
+    }
+    
+    // RAM samples are lost, the spilled ones continue after the last stored position.
+    // Spilling moves whole batches, so up to one batch more than spilled is on flash.
+    delete queue;
+    queue = new PublishQueue();
+    TEST_ASSERT_TRUE(queue->begin());
+    uint32_t resumed = queue->size();
+    TEST_ASSERT_GREATER_OR_EQUAL(spilled - 20, resumed);
+    TEST_ASSERT_LESS_THAN(spilled - 20 + MQTT_QUEUE_SPILL_BATCH, resumed);
+    
+    // New samples go behind them into a fresh segment
+    pushSamples(1000, MQTT_QUEUE_RAM_SAMPLES + 10);
+    for (uint32_t i = 0; i < resumed; i++) {
+        TEST_ASSERT_TRUE(queue->peek(data));
+        TEST_ASSERT_EQUAL_UINT32(21 + i, data.timestamp);
+        queue->pop();
+    }
+    TEST_ASSERT_EQUAL_UINT32(MQTT_QUEUE_RAM_SAMPLES + 10, drain(1000));
+}
+
+void test_capacity_drops_whole_segments() {
+    uint32_t total = MQTT_QUEUE_RAM_SAMPLES + MQTT_QUEUE_SPILL_SAMPLES + 3 * MQTT_QUEUE_SPILL_SEGMENT_SAMPLES;
+    pushSamples(1, total);
+    
+    TEST_ASSERT_LESS_OR_EQUAL(MQTT_QUEUE_RAM_SAMPLES + MQTT_QUEUE_SPILL_SAMPLES, queue->size());
+    TEST_ASSERT_EQUAL_UINT32(total, queue->size() + queue->getDroppedSamples());
+    TEST_ASSERT_EQUAL_UINT32(0, queue->getDroppedSamples() % MQTT_QUEUE_SPILL_SEGMENT_SAMPLES);
+    
+    // The oldest samples went, the rest is contiguous
+    uint32_t first = queue->getDroppedSamples() + 1;
+    TEST_ASSERT_EQUAL_UINT32(total - first + 1, drain(first));
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_ram_only);
+    RUN_TEST(test_spill_keeps_order);
+    RUN_TEST(test_flash_writes_are_appends);
+    RUN_TEST(test_resume_after_reboot);
+    RUN_TEST(test_capacity_drops_whole_segments);
+    return UNITY_END();
+}
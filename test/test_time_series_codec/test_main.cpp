@@ -0,0 +1,169 @@
+#include <unity.h>
+#include "TimeSeriesCodec.h"
+
+static uint32_t seed;
+
+static uint32_t nextRandom() {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static int32_t randomStep(int32_t range) {
+    return (int32_t)(nextRandom() % (2 * range + 1)) - range;
+}
+
+void setUp() {
+    seed = 42;
+}
+
+void tearDown() {
+}
+
+static BatteryData idleSample() {
+    BatteryData data;
+    data.clear();
+    data.voltage10mV = 1330;
+    data.current10mA = 0;
+    data.remaining10mAh = 5000;
+    data.nominal10mAh = 10000;
+    data.temperature01K = 2981;
+    data.switches = 0x03;
+    data.numCells = 4;
+    data.dataValid = true;
+    for (int i = 0; i < 4; i++) {
+        data.cellMillivolts[i] = 3325;
+    }
+    return data;
+}
+
+// A random walk over every field, cell count changes included
+static void mutate(BatteryData& data) {
+    data.voltage10mV += randomStep(5);
+    data.current10mA += randomStep(300);
+    data.remaining10mAh += randomStep(3);
+    if (nextRandom() % 50 == 0) {
+        data.nominal10mAh += randomStep(100);
+    }
+    data.temperature01K += randomStep(2);
+    if (nextRandom() % 20 == 0) {
+        data.switches ^= 1 << (nextRandom() % 2);
+    }
+    if (nextRandom() % 100 == 0) {
+        data.dataValid = !data.dataValid;
+    }
+    if (nextRandom() % 40 == 0) {
+        data.numCells = 1 + nextRandom() % BATTERY_MAX_CELLS;
+    }
+    for (int i = 0; i < data.numCells; i++) {
+        if (data.cellMillivolts[i] == 0) {
+            data.cellMillivolts[i] = 3300;
+        }
+        data.cellMillivolts[i] += randomStep(4);
+    }
+    for (int i = data.numCells; i < BATTERY_MAX_CELLS; i++) {
+        data.cellMillivolts[i] = 0;
+    }
+}
+
+static void assertSameSample(const BatteryData& expected, const BatteryData& actual) {
+    TEST_ASSERT_EQUAL(expected.voltage10mV, actual.voltage10mV);
+    TEST_ASSERT_EQUAL_INT16(expected.current10mA, actual.current10mA);
+    TEST_ASSERT_EQUAL(expected.remaining10mAh, actual.remaining10mAh);
+    TEST_ASSERT_EQUAL(expected.nominal10mAh, actual.nominal10mAh);
+    TEST_ASSERT_EQUAL(expected.temperature01K, actual.temperature01K);
+    TEST_ASSERT_EQUAL_UINT8(expected.switches, actual.switches);
+    TEST_ASSERT_EQUAL(expected.dataValid, actual.dataValid);
+    TEST_ASSERT_EQUAL_UINT8(expected.numCells, actual.numCells);
+    TEST_ASSERT_EQUAL_MEMORY(expected.cellMillivolts, actual.cellMillivolts, expected.numCells * sizeof(uint16_t));
+}
+
+void test_round_trip() {
+    TimeSeriesCodec encoder;
+    TimeSeriesCodec decoder;
+    BatteryData current[BATTERY_COUNT];
+    uint32_t times[BATTERY_COUNT];
+    for (int b = 0; b < BATTERY_COUNT; b++) {
+        current[b] = idleSample();
+        times[b] = 1700000000 + b;
+    }
+    
+    uint8_t buffer[TimeSeriesCodec::RECORD_MAX];
+    for (int i = 0; i < 5000; i++) {
+        int battery = nextRandom() % BATTERY_COUNT;
+        mutate(current[battery]);
+        
+        // Mostly steady intervals, sometimes jitter or a gap
+        times[battery] += 30 + (nextRandom() % 10 == 0 ? randomStep(5) : 0) + (nextRandom() % 200 == 0 ? 3600 : 0);
+        
+        size_t length = encoder.encode(battery, current[battery], times[battery], buffer);
+        TEST_ASSERT_LESS_OR_EQUAL(TimeSeriesCodec::RECORD_MAX, length);
+        
+        int decodedBattery = -1;
+        uint32_t decodedTime = 0;
+        BatteryData decoded;
+        TEST_ASSERT_EQUAL(length, decoder.decode(buffer, length, decodedBattery, decodedTime, decoded));
+        TEST_ASSERT_EQUAL(battery, decodedBattery);
+        TEST_ASSERT_EQUAL_UINT32(times[battery], decodedTime);
+        assertSameSample(current[battery], decoded);
+    }
+}
+
+void test_idle_battery_is_small() {
+    TimeSeriesCodec encoder;
+    BatteryData data = idleSample();
+    uint8_t buffer[TimeSeriesCodec::RECORD_MAX];
+    
+    encoder.encode(0, data, 1700000000, buffer);
+    encoder.encode(0, data, 1700000030, buffer);
+    
+    // Steady interval, nothing changed: index, zero time delta, empty mask
+    TEST_ASSERT_EQUAL(3, encoder.encode(0, data, 1700000060, buffer));
+    
+    data.voltage10mV++;
+    TEST_ASSERT_EQUAL(4, encoder.encode(0, data, 1700000090, buffer));
+}
+
+void test_truncated_record_is_rejected() {
+    TimeSeriesCodec encoder;
+    BatteryData data = idleSample();
+    data.current10mA = -1234;
+    uint8_t buffer[TimeSeriesCodec::RECORD_MAX];
+    size_t length = encoder.encode(1 % BATTERY_COUNT, data, 1700000000, buffer);
+    
+    for (size_t cut = 0; cut < length; cut++) {
+        TimeSeriesCodec decoder;
+        int battery;
+        uint32_t time;
+        BatteryData decoded;
+        TEST_ASSERT_EQUAL(0, decoder.decode(buffer, cut, battery, time, decoded));
+    }
+}
+
+void test_reset_starts_independent_run() {
+    TimeSeriesCodec encoder;
+    TimeSeriesCodec decoder;
+    BatteryData data = idleSample();
+    uint8_t buffer[TimeSeriesCodec::RECORD_MAX];
+    encoder.encode(0, data, 1700000000, buffer);
+    
+    // After a reset the first record is absolute again and decodes on its own
+    encoder.reset();
+    data.voltage10mV = 1290;
+    size_t length = encoder.encode(0, data, 1700000030, buffer);
+    
+    int battery;
+    uint32_t time;
+    BatteryData decoded;
+    TEST_ASSERT_EQUAL(length, decoder.decode(buffer, length, battery, time, decoded));
+    TEST_ASSERT_EQUAL_UINT32(1700000030, time);
+    assertSameSample(data, decoded);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_idle_battery_is_small);
+    RUN_TEST(test_truncated_record_is_rejected);
+    RUN_TEST(test_reset_starts_independent_run);
+    return UNITY_END();
+}
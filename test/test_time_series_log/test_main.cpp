@@ -0,0 +1,178 @@
+#include <unity.h>
+#include <LittleFS.h>
+#include "TimeSeriesLog.h"
+
+static const uint32_t START_TIME = 1700000000;
+static const uint32_t INTERVAL = 30;
+
+static TimeSeriesLog* tsLog;
+
+void setUp() {
+    LittleFS.format();
+    nativeMillis() = 0;
+    tsLog = new TimeSeriesLog();
+    TEST_ASSERT_TRUE(tsLog->begin());
+}
+
+void tearDown() {
+    delete tsLog;
+}
+
+// Deterministic sample i of a battery, slowly drifting like a real one
+static BatteryData makeSample(uint32_t i, int battery, bool noisy) {
+    BatteryData data;
+    data.clear();
+    data.voltage10mV = 1320 + (noisy ? (i * 7919 + battery) % 40 : i / 20 % 5);
+    data.current10mA = noisy ? (int16_t)((i * 104729) % 4000) - 2000 : (i / 10 % 2 ? -150 : -140);
+    data.remaining10mAh = 8000 - i / 50 % 1000;
+    data.nominal10mAh = 10000;
+    data.temperature01K = 2981 + i / 100 % 3;
+    data.switches = 0x03;
+    data.numCells = 4;
+    data.dataValid = true;
+    for (int c = 0; c < 4; c++) {
+        data.cellMillivolts[c] = 3300 + (noisy ? (i * 31 + c * 17) % 50 : (i / 15 + c) % 3);
+    }
+    return data;
+}
+
+// Appends count samples per battery at a steady interval, running loop() like main.cpp
+static void appendSamples(uint32_t first, uint32_t count, bool noisy) {
+    for (uint32_t i = first; i < first + count; i++) {
+        for (int b = 0; b < BATTERY_COUNT; b++) {
+            TEST_ASSERT_TRUE(tsLog->append(b, makeSample(i, b, noisy), START_TIME + i * INTERVAL));
+        }
+        nativeMillis() += INTERVAL * 1000;
+        tsLog->loop();
+    }
+}
+
+// Reads all segments back, checks every record against makeSample; returns the record count.
+// Segments can end between the batteries of one round, so the first record may be of any battery.
+static uint32_t readBack(uint32_t expectedFirst, bool noisy) {
+    TimeSeriesLog::SegmentInfo segments[TimeSeriesLog::MAX_SEGMENTS];
+    int segmentCount = tsLog->findSegments(0, 0xFFFFFFFF, segments, TimeSeriesLog::MAX_SEGMENTS);
+    
+    uint32_t records = 0;
+    uint32_t expected = expectedFirst;
+    int expectedBattery = 0;
+    for (int s = 0; s < segmentCount; s++) {
+        TimeSeriesReader reader;
+        TEST_ASSERT_TRUE(reader.open(segments[s].sequence));
+        
+        int battery;
+        uint32_t time;
+        BatteryData data;
+        uint32_t inSegment = 0;
+        while (reader.next(battery, time, data)) {
+            if (records == 0 && inSegment == 0) {
+                expectedBattery = battery;
+            }
+            BatteryData sample = makeSample(expected, battery, noisy);
+            TEST_ASSERT_EQUAL(expectedBattery, battery);
+            TEST_ASSERT_EQUAL_UINT32(START_TIME + expected * INTERVAL, time);
+            TEST_ASSERT_EQUAL(sample.voltage10mV, data.voltage10mV);
+            TEST_ASSERT_EQUAL_INT16(sample.current10mA, data.current10mA);
+            TEST_ASSERT_EQUAL(sample.remaining10mAh, data.remaining10mAh);
+            TEST_ASSERT_EQUAL(sample.temperature01K, data.temperature01K);
+            TEST_ASSERT_EQUAL_MEMORY(sample.cellMillivolts, data.cellMillivolts, 4 * sizeof(uint16_t));
+            
+            if (++expectedBattery == BATTERY_COUNT) {
+                expectedBattery = 0;
+                expected++;
+            }
+            inSegment++;
+        }
+        TEST_ASSERT_EQUAL_UINT32(segments[s].records, inSegment);
+        records += inSegment;
+    }
+    return records;
+}
+
+void test_samples_before_ntp_are_skipped() {
+    TEST_ASSERT_FALSE(tsLog->append(0, makeSample(0, 0, false), 1000));
+    TEST_ASSERT_FALSE(tsLog->append(BATTERY_COUNT, makeSample(0, 0, false), START_TIME));
+    TEST_ASSERT_EQUAL_UINT32(0, tsLog->getSegmentCount());
+}
+
+void test_round_trip_through_segments() {
+    // Noisy samples fill several segments
+    appendSamples(0, 3000, true);
+    TEST_ASSERT_GREATER_THAN(2, tsLog->getSegmentCount());
+    TEST_ASSERT_EQUAL_UINT32(3000 * BATTERY_COUNT, readBack(0, true));
+    TEST_ASSERT_EQUAL_UINT32(0, tsLog->getDroppedRecords());
+}
+
+void test_range_lookup() {
+    appendSamples(0, 3000, true);
+    
+    TimeSeriesLog::SegmentInfo segments[TimeSeriesLog::MAX_SEGMENTS];
+    uint32_t from = START_TIME + 1500 * INTERVAL;
+    int count = tsLog->findSegments(from, from, segments, TimeSeriesLog::MAX_SEGMENTS);
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_LESS_OR_EQUAL(from, segments[0].firstTime);
+    TEST_ASSERT_GREATER_OR_EQUAL(from, segments[0].lastTime);
+    
+    TEST_ASSERT_EQUAL(0, tsLog->findSegments(START_TIME + 4000 * INTERVAL, 0xFFFFFFFF, segments, TimeSeriesLog::MAX_SEGMENTS));
+}
+
+void test_open_segment_survives_reboot() {
+    appendSamples(0, 500, false);
+    tsLog->flush();
+    
+    delete tsLog;
+    tsLog = new TimeSeriesLog();
+    TEST_ASSERT_TRUE(tsLog->begin());
+    
+    // The segment open before the reboot is closed and indexed, new samples start a new one
+    appendSamples(500, 100, false);
+    TEST_ASSERT_EQUAL_UINT32(600 * BATTERY_COUNT, readBack(0, false));
+}
+
+void test_retention_deletes_oldest() {
+    // Far more noisy data than TSLOG_MAX_BYTES
+    uint32_t count = 3 * TSLOG_MAX_BYTES / 20 / BATTERY_COUNT;
+    appendSamples(0, count, true);
+    tsLog->flush();
+    
+    TEST_ASSERT_LESS_OR_EQUAL(TSLOG_MAX_BYTES + TSLOG_SEGMENT_SIZE, tsLog->getStoredBytes());
+    
+    // What is left is the newest part and still readable
+    TimeSeriesLog::SegmentInfo segments[TimeSeriesLog::MAX_SEGMENTS];
+    tsLog->findSegments(0, 0xFFFFFFFF, segments, TimeSeriesLog::MAX_SEGMENTS);
+    uint32_t first = (segments[0].firstTime - START_TIME) / INTERVAL;
+    TEST_ASSERT_GREATER_THAN(0, first);
+    uint32_t records = readBack(first, true);
+    TEST_ASSERT_GREATER_THAN((count - first - 1) * BATTERY_COUNT, records);
+    TEST_ASSERT_LESS_OR_EQUAL((count - first) * BATTERY_COUNT, records);
+}
+
+void test_write_amplification() {
+    // A day of idle batteries sampled every 30 s
+    uint32_t count = 24 * 3600 / INTERVAL;
+    LittleFS.resetCounters();
+    appendSamples(0, count, false);
+    tsLog->flush();
+    
+    uint32_t records = count * BATTERY_COUNT;
+    
+    // Only appends: segment headers, record blocks and index entries
+    TEST_ASSERT_EQUAL_UINT32(0, LittleFS.bytesOverwritten);
+    TEST_ASSERT_LESS_OR_EQUAL(tsLog->getBytesWritten() + 64 * tsLog->getSegmentCount(), LittleFS.bytesWritten);
+    
+    // About 3 bytes per idle record, written once per flush interval rather than per record
+    TEST_ASSERT_LESS_OR_EQUAL(6 * records, LittleFS.bytesWritten);
+    uint32_t flushesDue = count * INTERVAL * 1000 / TSLOG_FLUSH_INTERVAL_MS;
+    TEST_ASSERT_LESS_OR_EQUAL(flushesDue + 2 * tsLog->getSegmentCount() + 1, LittleFS.writeOpens);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_samples_before_ntp_are_skipped);
+    RUN_TEST(test_round_trip_through_segments);
+    RUN_TEST(test_range_lookup);
+    RUN_TEST(test_open_segment_survives_reboot);
+    RUN_TEST(test_retention_deletes_oldest);
+    RUN_TEST(test_write_amplification);
+    return UNITY_END();
+}
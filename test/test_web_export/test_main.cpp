@@ -0,0 +1,217 @@
+#include <unity.h>
+#include <LittleFS.h>
+#include <NativeHttp.h>
+#include <esp_system.h>
+#include <new>
+#include "WebServerManager.h"
+
+// /api/export against a local HTTP client: throughput and peak heap of the
+// streaming handler, next to a handler that builds the whole CSV in a String
+// first like handleApiData(). Heap use is counted for allocations made by
+// tasks, so the client on the test thread does not show up in it.
+
+static const uint32_t START_TIME = 1700000000;
+static const uint32_t INTERVAL = 30;
+static const uint32_t ROUNDS = 3000;
+static const size_t HEADER_SIZE = 16;          // Keeps the blocks aligned like malloc()
+
+void* operator new(size_t size) {
+    bool counted = nativeCurrentTask() != nullptr;
+    uint8_t* block = (uint8_t*)malloc(size + HEADER_SIZE);
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    *(size_t*)block = counted ? size : 0;
+    if (counted) {
+        nativeHeap().allocate(size);
+    }
+    return block + HEADER_SIZE;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (pointer == nullptr) {
+        return;
+    }
+    uint8_t* block = (uint8_t*)pointer - HEADER_SIZE;
+    nativeHeap().release(*(size_t*)block);
+    free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* pointer) noexcept { operator delete(pointer); }
+
+struct Transfer {
+    size_t bytes;
+    unsigned long ms;
+    size_t peakHeap;
+};
+
+static TimeSeriesLog* tsLog;
+static WebServerManager* webServerManager;
+static uint16_t exportPort;
+static WebServer* baselineServer;
+static uint16_t baselinePort;
+
+// Deterministic, noisy sample i of a battery (see test_time_series_log)
+static BatteryData makeSample(uint32_t i, int battery) {
+    BatteryData data;
+    data.clear();
+    data.voltage10mV = 1320 + (i * 7919 + battery) % 40;
+    data.current10mA = (int16_t)((i * 104729) % 4000) - 2000;
+    data.remaining10mAh = 8000 - i / 50 % 1000;
+    data.nominal10mAh = 10000;
+    data.temperature01K = 2981 + i / 100 % 3;
+    data.switches = 0x03;
+    data.numCells = 4;
+    data.dataValid = true;
+    for (int c = 0; c < 4; c++) {
+        data.cellMillivolts[c] = 3300 + (i * 31 + c * 17) % 50;
+    }
+    return data;
+}
+
+// The String-building way: the whole response exists in RAM before it is sent
+static void handleBaselineExport() {
+    TimeSeriesLog::SegmentInfo segments[TimeSeriesLog::MAX_SEGMENTS];
+    int segmentCount = tsLog->findSegments(0, UINT32_MAX, segments, TimeSeriesLog::MAX_SEGMENTS);
+    
+    String csv = "time,battery,voltage,current,remaining,nominal,soc,temperature,switches,valid,cells\n";
+    TimeSeriesReader reader;
+    for (int s = 0; s < segmentCount; s++) {
+        if (!reader.open(segments[s].sequence)) {
+            continue;
+        }
+        int battery;
+        uint32_t time;
+        BatteryData data;
+        while (reader.next(battery, time, data)) {
+            char row[160];
+            snprintf(row, sizeof(row), "%lu,%d,%.2f,%.2f,%.2f,%.2f,%.1f,%.1f,%u,%d,%u %u %u %u\n",
+                     (unsigned long)time, battery + 1, data.getVoltage(), data.getCurrent(),
+                     data.getRemainingAh(), data.getMaxAh(), data.getSoc(), data.getTemperature(),
+                     (unsigned)data.switches, data.dataValid ? 1 : 0, data.cellMillivolts[0],
+                     data.cellMillivolts[1], data.cellMillivolts[2], data.cellMillivolts[3]);
+            csv += row;
+        }
+        reader.close();
+    }
+    baselineServer->send(200, "text/csv", csv);
+}
+
+static void baselineTask(void* param) {
+    while (true) {
+        baselineServer->handleClient();
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+}
+
+// One request, with the peak task heap above what the tasks held before
+static Transfer fetch(uint16_t port, const char* path, NativeHttpResponse& response) {
+    size_t before = nativeHeap().getUsed();
+    nativeHeap().resetPeak();
+    unsigned long start = micros();
+    TEST_ASSERT_TRUE(nativeHttpGet(port, path, response));
+    Transfer transfer = { response.body.size(), (micros() - start) / 1000, nativeHeap().getPeak() - before };
+    TEST_ASSERT_EQUAL(200, response.status);
+    return transfer;
+}
+
+static void report(const char* name, const Transfer& transfer) {
+    unsigned long ms = transfer.ms > 0 ? transfer.ms : 1;
+    printf("%-16s %7lu bytes in %4lu ms (%5lu KB/s), peak heap %6lu bytes\n", name, (unsigned long)transfer.bytes,
+           transfer.ms, (unsigned long)(transfer.bytes / ms), (unsigned long)transfer.peakHeap);
+}
+
+static size_t countLines(const std::string& text) {
+    size_t lines = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        lines += text[i] == '\n';
+    }
+    return lines;
+}
+
+void setUp() {
+    if (webServerManager != nullptr) {
+        return;
+    }
+    
+    nativeUseHostClock();
+    LittleFS.format();
+    tsLog = new TimeSeriesLog();
+    TEST_ASSERT_TRUE(tsLog->begin());
+    for (uint32_t i = 0; i < ROUNDS; i++) {
+        for (int b = 0; b < BATTERY_COUNT; b++) {
+            TEST_ASSERT_TRUE(tsLog->append(b, makeSample(i, b), START_TIME + i * INTERVAL));
+        }
+    }
+    tsLog->flush();
+    
+    webServerManager = new WebServerManager();
+    webServerManager->setTimeSeriesLog(tsLog);
+    webServerManager->begin();
+    exportPort = nativeWebServerPort();
+    TEST_ASSERT_TRUE(webServerManager->isRunning());
+    
+    baselineServer = new WebServer(80);
+    baselineServer->on("/api/export", handleBaselineExport);
+    baselineServer->begin();
+    baselinePort = nativeWebServerPort();
+    xTaskCreatePinnedToCore(baselineTask, "baseline", 8192, nullptr, 1, nullptr, 0);
+}
+
+void tearDown() {
+}
+
+void test_csv_export_streams_in_constant_memory() {
+    NativeHttpResponse full;
+    Transfer streamed = fetch(exportPort, "/api/export?format=csv", full);
+    report("csv streamed", streamed);
+    TEST_ASSERT_EQUAL(1 + ROUNDS * BATTERY_COUNT, countLines(full.body));
+    
+    // A tenth of the range needs as much memory as all of it
+    char path[64];
+    snprintf(path, sizeof(path), "/api/export?format=csv&to=%lu", (unsigned long)(START_TIME + ROUNDS / 10 * INTERVAL));
+    NativeHttpResponse part;
+    Transfer partial = fetch(exportPort, path, part);
+    report("csv 1/10", partial);
+    TEST_ASSERT_EQUAL(1 + (ROUNDS / 10 + 1) * BATTERY_COUNT, countLines(part.body));
+    TEST_ASSERT_LESS_OR_EQUAL(partial.peakHeap + 256, streamed.peakHeap);
+    TEST_ASSERT_LESS_THAN(WEB_EXPORT_BUFFER_SIZE, streamed.peakHeap);
+    
+    // Building the response first costs at least its size
+    NativeHttpResponse built;
+    Transfer baseline = fetch(baselinePort, "/api/export", built);
+    report("csv String", baseline);
+    TEST_ASSERT_EQUAL(countLines(full.body), countLines(built.body));
+    TEST_ASSERT_GREATER_OR_EQUAL(built.body.size(), baseline.peakHeap);
+}
+
+void test_binary_export_frames_every_segment() {
+    TimeSeriesLog::SegmentInfo segments[TimeSeriesLog::MAX_SEGMENTS];
+    int segmentCount = tsLog->findSegments(0, UINT32_MAX, segments, TimeSeriesLog::MAX_SEGMENTS);
+    TEST_ASSERT_GREATER_THAN(2, segmentCount);
+    
+    NativeHttpResponse response;
+    Transfer transfer = fetch(exportPort, "/api/export?format=bin", response);
+    report("bin streamed", transfer);
+    
+    // Sequence and length before each segment, then the file as stored
+    size_t offset = 0;
+    for (int s = 0; s < segmentCount; s++) {
+        uint32_t header[2];
+        TEST_ASSERT_LESS_OR_EQUAL(response.body.size(), offset + sizeof(header));
+        memcpy(header, response.body.data() + offset, sizeof(header));
+        TEST_ASSERT_EQUAL_UINT32(segments[s].sequence, header[0]);
+        TEST_ASSERT_EQUAL_UINT32(segments[s].bytes, header[1]);
+        offset += sizeof(header) + header[1];
+    }
+    TEST_ASSERT_EQUAL(offset, response.body.size());
+    TEST_ASSERT_LESS_THAN(WEB_EXPORT_BUFFER_SIZE, transfer.peakHeap);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_csv_export_streams_in_constant_memory);
+    RUN_TEST(test_binary_export_frames_every_segment);
+    return UNITY_END();
+}
@@ -0,0 +1,162 @@
+#include <unity.h>
+#include <NativeHttp.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "WebServerManager.h"
+#include "BluetoothManager.h"
+
+// HTTP latency while battery scans run: the former arrangement, where loop()
+// called handleClient() between inline scans, against WebServerManager with
+// its own task. A client fires requests at a steady pace; every scan sets up
+// all links from scratch, so it takes as long as a first scan after boot.
+
+static const unsigned long CONNECT_MS = 150;
+static const unsigned long DISCOVERY_MS = 100;
+static const unsigned long RESPONSE_MS = 30;
+static const unsigned long SERVE_MS = 200;         // Time loop() spends elsewhere between two scans
+static const int REQUESTS = 100;
+static const unsigned long REQUEST_GAP_MS = 15;
+
+struct Latency {
+    unsigned long p50;
+    unsigned long p99;
+    unsigned long max;
+};
+
+static BluetoothManager* bluetoothManager;
+static WebServerManager* webServerManager;
+static uint16_t managerPort;
+static int indices[BATTERY_COUNT];
+
+// One scan like the first after boot: every link is set up again
+static void scan(BatteryData* results, bool* success) {
+    bluetoothManager->disconnectAll();
+    bluetoothManager->readBatteries(indices, BATTERY_COUNT, results, success);
+}
+
+// Fires the requests one after the other, returns latency percentiles in ms
+static Latency measure(uint16_t port, const char* path) {
+    std::vector<unsigned long> latencies;
+    for (int i = 0; i < REQUESTS; i++) {
+        NativeHttpResponse response;
+        unsigned long start = micros();
+        TEST_ASSERT_TRUE(nativeHttpGet(port, path, response));
+        latencies.push_back((micros() - start) / 1000);
+        TEST_ASSERT_EQUAL(200, response.status);
+        delay(REQUEST_GAP_MS);
+    }
+    
+    std::sort(latencies.begin(), latencies.end());
+    Latency result = { latencies[REQUESTS / 2], latencies[REQUESTS * 99 / 100], latencies.back() };
+    return result;
+}
+
+void setUp() {
+    if (bluetoothManager != nullptr) {
+        return;
+    }
+    
+    nativeUseHostClock();
+    Preferences::erase();
+    for (int i = 0; i < BATTERY_COUNT; i++) {
+        NativeBms& bms = nativeBle().addBms(BATTERY_MAC_ADDRESSES[i].c_str());
+        bms.connectMs = CONNECT_MS;
+        bms.discoveryMs = DISCOVERY_MS;
+        bms.responseMs = RESPONSE_MS;
+        indices[i] = i;
+    }
+    bluetoothManager = new BluetoothManager();
+    bluetoothManager->begin();
+    
+    webServerManager = new WebServerManager();
+    webServerManager->begin();
+    managerPort = nativeWebServerPort();
+    TEST_ASSERT_TRUE(webServerManager->isRunning());
+}
+
+void tearDown() {
+}
+
+void test_inline_scans_hold_up_requests() {
+    // The former loop(): handleClient() only runs between scans
+    WebServer server(80);
+    server.on("/api/data", [&server]() { server.send(200, "application/json", "[]"); });
+    server.begin();
+    uint16_t port = nativeWebServerPort();
+    
+    std::atomic<bool> running(true);
+    std::thread loop([&]() {
+        BatteryData results[BATTERY_COUNT];
+        bool success[BATTERY_COUNT];
+        while (running) {
+            scan(results, success);
+            for (unsigned long start = millis(); millis() - start < SERVE_MS && running;) {
+                server.handleClient();
+                delay(1);
+            }
+        }
+    });
+    
+    Latency latency = measure(port, "/api/data");
+    running = false;
+    loop.join();
+    
+    printf("inline scans: p50 %lu ms, p99 %lu ms, max %lu ms\n", latency.p50, latency.p99, latency.max);
+    TEST_ASSERT_GREATER_OR_EQUAL(CONNECT_MS + DISCOVERY_MS, latency.p99);
+}
+
+void test_web_task_serves_during_scans() {
+    // Scans with updates like handleBatteryData(), HTTP is left to the web task
+    std::atomic<bool> running(true);
+    std::atomic<int> scans(0);
+    std::thread loop([&]() {
+        BatteryData results[BATTERY_COUNT];
+        bool success[BATTERY_COUNT];
+        while (running) {
+            scan(results, success);
+            for (int i = 0; i < BATTERY_COUNT; i++) {
+                if (success[i]) {
+                    webServerManager->updateBatteryData(i, results[i]);
+                    webServerManager->setBatteryDataUpdateTime(i, millis());
+                }
+            }
+            scans++;
+            delay(SERVE_MS);
+        }
+    });
+    
+    Latency latency = measure(managerPort, "/api/data");
+    running = false;
+    loop.join();
+    
+    printf("web task:     p50 %lu ms, p99 %lu ms, max %lu ms (%d scans)\n",
+           latency.p50, latency.p99, latency.max, scans.load());
+    TEST_ASSERT_GREATER_OR_EQUAL(2, scans.load());
+    
+    // A few handleClient() passes at most, with slack for the host scheduler
+    TEST_ASSERT_LESS_THAN(CONNECT_MS / 3, latency.p99);
+}
+
+void test_event_stream_does_not_hold_the_server() {
+    // An open /api/events stream must not keep the server from the next request
+    int stream = nativeHttpConnect(managerPort);
+    NativeHttpResponse events;
+    std::string buffer;
+    TEST_ASSERT_TRUE(nativeHttpRequest(stream, "/api/events", events, buffer));
+    TEST_ASSERT_EQUAL(200, events.status);
+    
+    Latency latency = measure(managerPort, "/api/data");
+    close(stream);
+    
+    printf("event stream open: p50 %lu ms, p99 %lu ms\n", latency.p50, latency.p99);
+    TEST_ASSERT_LESS_THAN(HTTP_MAX_CLOSE_WAIT / 10, latency.max);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_inline_scans_hold_up_requests);
+    RUN_TEST(test_web_task_serves_during_scans);
+    RUN_TEST(test_event_stream_does_not_hold_the_server);
+    return UNITY_END();
+}